@@ -1,3 +1,5 @@
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <unordered_map>
@@ -27,16 +29,232 @@ public:
     }
 };
 
+// Little-endian encoding of the integers and strings in log records and snapshots
+class BinaryWriter {
+public:
+    std::string buffer;
+    
+    void putU64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) buffer.push_back(static_cast<char>(value >> (8 * i)));
+    }
+    
+    void putString(const std::string& text) {
+        putU64(text.size());
+        buffer += text;
+    }
+};
+
+class BinaryReader {
+private:
+    const std::string& data;
+    size_t position;
+    
+public:
+    bool ok = true;
+    
+    BinaryReader(const std::string& data, size_t position = 0) : data(data), position(position) {}
+    
+    uint64_t getU64() {
+        if (data.size() - position < 8) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(static_cast<unsigned char>(data[position + i])) << (8 * i);
+        position += 8;
+        return value;
+    }
+    
+    std::string getString() {
+        uint64_t length = getU64();
+        if (!ok || data.size() - position < length) {
+            ok = false;
+            return "";
+        }
+        std::string text = data.substr(position, length);
+        position += length;
+        return text;
+    }
+    
+    bool atEnd() const { return position == data.size(); }
+};
+
+// 64-bit FNV-1a, the checksum of every log record and snapshot
+uint64_t checksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Read a whole file into memory; false if it cannot be opened
+bool readWholeFile(const std::string& filename, std::string& contents) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+// Append-only write-ahead log of state changes since the last snapshot. Each record is
+// [payload bytes][checksum][payload], so a record torn by a crash fails its checksum and
+// recovery stops just before it. The header names the log's generation: a snapshot records
+// the last generation it contains, and a log that is not newer than that is ignored.
+class WriteAheadLog {
+public:
+    enum RecordType : uint8_t {
+        CounterDelta = 1,   // first: term, value: change in its flag count
+        NewEdge = 2,        // first, second: related terms
+        NewBannedWord = 3   // first: word; still replayed, though nothing adds words at run time now
+    };
+    
+    struct Record {
+        RecordType type;
+        std::string first;
+        std::string second;
+        int64_t value = 0;
+    };
+    
+private:
+    static constexpr char Magic[8] = {'C', 'M', 'S', 'W', 'A', 'L', '0', '1'};
+    static constexpr size_t HeaderBytes = sizeof(Magic) + 8;
+    
+    std::string filename;
+    std::ofstream file;
+    uint64_t bytes = 0;
+    
+public:
+    uint64_t generation = 0;
+    
+    // Read the intact records of the log at path. Returns false if there is no valid log;
+    // validBytes is where the intact records end.
+    static bool read(const std::string& path, uint64_t& generation, std::vector<Record>& records, uint64_t& validBytes) {
+        std::string contents;
+        if (!readWholeFile(path, contents) || contents.size() < HeaderBytes ||
+            contents.compare(0, sizeof(Magic), Magic, sizeof(Magic)) != 0) {
+            return false;
+        }
+        generation = BinaryReader(contents, sizeof(Magic)).getU64();
+        
+        size_t position = HeaderBytes;
+        while (true) {
+            BinaryReader header(contents, position);
+            uint64_t payloadBytes = header.getU64();
+            uint64_t expected = header.getU64();
+            if (!header.ok || contents.size() - position - 16 < payloadBytes) break;
+            
+            const char* payload = contents.data() + position + 16;
+            if (checksum(payload, payloadBytes) != expected) break;
+            
+            std::string body(payload, payloadBytes);
+            BinaryReader reader(body);
+            Record record;
+            record.type = static_cast<RecordType>(reader.getU64());
+            record.first = reader.getString();
+            record.second = reader.getString();
+            record.value = static_cast<int64_t>(reader.getU64());
+            if (!reader.ok) break;
+            
+            records.push_back(std::move(record));
+            position += 16 + payloadBytes;
+        }
+        validBytes = position;
+        return true;
+    }
+    
+    // Start an empty log of a new generation in place of the old file
+    bool reset(const std::string& path, uint64_t newGeneration) {
+        file.close();
+        filename = path;
+        generation = newGeneration;
+        
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream fresh(temporary, std::ios::binary | std::ios::trunc);
+            BinaryWriter header;
+            header.buffer.assign(Magic, sizeof(Magic));
+            header.putU64(generation);
+            fresh.write(header.buffer.data(), static_cast<std::streamsize>(header.buffer.size()));
+            if (!fresh) {
+                std::cerr << "Error opening file for writing: " << temporary << std::endl;
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            std::cerr << "Error replacing log: " << path << std::endl;
+            return false;
+        }
+        
+        file.open(path, std::ios::binary | std::ios::app);
+        bytes = HeaderBytes;
+        return file.is_open();
+    }
+    
+    // Continue an existing log, cutting off a torn record at its end
+    bool resume(const std::string& path, uint64_t existingGeneration, uint64_t validBytes) {
+        file.close();
+        filename = path;
+        generation = existingGeneration;
+        
+        std::error_code error;
+        if (std::filesystem::file_size(path, error) != validBytes) std::filesystem::resize_file(path, validBytes, error);
+        file.open(path, std::ios::binary | std::ios::app);
+        bytes = validBytes;
+        return file.is_open();
+    }
+    
+    void append(const Record& record) {
+        if (!file.is_open()) return;
+        BinaryWriter payload;
+        payload.putU64(record.type);
+        payload.putString(record.first);
+        payload.putString(record.second);
+        payload.putU64(static_cast<uint64_t>(record.value));
+        
+        BinaryWriter header;
+        header.putU64(payload.buffer.size());
+        header.putU64(checksum(payload.buffer.data(), payload.buffer.size()));
+        file.write(header.buffer.data(), static_cast<std::streamsize>(header.buffer.size()));
+        file.write(payload.buffer.data(), static_cast<std::streamsize>(payload.buffer.size()));
+        bytes += header.buffer.size() + payload.buffer.size();
+    }
+    
+    // Hand buffered records to the operating system
+    bool flush() {
+        if (!file.is_open()) return false;
+        file.flush();
+        if (!file) {
+            std::cerr << "Error writing file: " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    uint64_t size() const { return bytes; }
+};
+
 // Graph structure for representing relationships between flagged terms
 class Graph {
 private:
     std::unordered_map<std::string, std::vector<std::string>> adjacencyList;
+    WriteAheadLog* log = nullptr;
     
 public:
+    // Log every edge added from now on
+    void attachLog(WriteAheadLog* wal) {
+        log = wal;
+    }
+    
     // Add a connection between two words
     void addEdge(const std::string& word1, const std::string& word2) {
         adjacencyList[word1].push_back(word2);
         adjacencyList[word2].push_back(word1); // Undirected graph
+        if (log) log->append({WriteAheadLog::NewEdge, word1, word2});
     }
     
     // Get related words using BFS
@@ -87,51 +305,31 @@ public:
         }
         std::cout << std::endl;
     }
-
-    // Save graph to file for persistence
-    void saveToFile(const std::string& filename) {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error opening file for writing: " << filename << std::endl;
-            return;
-        }
-
+    
+    // Append the adjacency lists to a snapshot
+    void writeSnapshot(BinaryWriter& out) const {
+        out.putU64(adjacencyList.size());
         for (const auto& [word, neighbors] : adjacencyList) {
-            file << word;
+            out.putString(word);
+            out.putU64(neighbors.size());
             for (const auto& neighbor : neighbors) {
-                file << "," << neighbor;
+                out.putString(neighbor);
             }
-            file << std::endl;
         }
-        
-        std::cout << "Graph relationships saved to " << filename << std::endl;
     }
-
-    // Load graph from file
-    void loadFromFile(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Graph relationship file not found: " << filename << std::endl;
-            return;
-        }
-
+    
+    // Replace the graph with the adjacency lists read from a snapshot
+    bool readSnapshot(BinaryReader& in) {
         adjacencyList.clear();
-        std::string line;
-        
-        while (std::getline(file, line)) {
-            std::istringstream iss(line);
-            std::string word, neighbors;
-            
-            if (std::getline(iss, word, ',')) {
-                while (std::getline(iss, neighbors, ',')) {
-                    if (!neighbors.empty()) {
-                        adjacencyList[word].push_back(neighbors);
-                    }
-                }
+        uint64_t count = in.getU64();
+        for (uint64_t i = 0; i < count && in.ok; ++i) {
+            std::vector<std::string>& neighbors = adjacencyList[in.getString()];
+            uint64_t degree = in.getU64();
+            for (uint64_t j = 0; j < degree && in.ok; ++j) {
+                neighbors.push_back(in.getString());
             }
         }
-        
-        std::cout << "Graph relationships loaded from " << filename << std::endl;
+        return in.ok;
     }
 };
 
@@ -144,6 +342,16 @@ private:
     std::vector<std::pair<std::string, std::vector<std::string>>> flaggedContent;
     std::string dataDirectory;
     
+    // Persistence: a compacted snapshot of the whole state plus a log of the changes since
+    WriteAheadLog wal;
+    std::unordered_map<std::string, int> pendingCounts;    // Flag counts not logged yet
+    uint64_t snapshotBytes = 0;                             // Size of the last snapshot written
+    static constexpr uint64_t MinCompactionBytes = 64 * 1024;
+    static constexpr char SnapshotMagic[8] = {'C', 'M', 'S', 'S', 'N', 'A', 'P', '1'};
+    
+    std::string snapshotPath() const { return dataDirectory + "/state.snap"; }
+    std::string logPath() const { return dataDirectory + "/state.wal"; }
+    
     // Insert a word into the Trie
     void insertWord(const std::string& word) {
         TrieNode* current = root;
@@ -190,73 +398,154 @@ private:
             if (searchWord(word)) {
                 flaggedWords.push_back(word);
                 flaggedTermsFrequency[word]++;
+                pendingCounts[word]++;
             }
         }
         
+        // Log the new counts before the message is answered, so a crash of the process loses none of them
+        if (!flaggedWords.empty()) saveState();
         return flaggedWords;
     }
     
-    // Save banned words to file
-    void saveBannedWords(const std::string& filename) {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error opening file for writing: " << filename << std::endl;
-            return;
+    // Log the flag counts gathered since the last save, as deltas, and flush the log; called after
+    // every message that flagged something and on shutdown. Once the log outgrows half of the
+    // last snapshot the state is compacted into a new one, so the cost of rewriting everything
+    // is paid for by at least half as many bytes of changes.
+    void saveState() {
+        for (const auto& [term, delta] : pendingCounts) {
+            wal.append({WriteAheadLog::CounterDelta, term, "", delta});
         }
+        pendingCounts.clear();
+        wal.flush();
         
-        // Perform a DFS traversal of the Trie to get all words
+        if (wal.size() > std::max(MinCompactionBytes, snapshotBytes / 2)) {
+            writeSnapshot();
+        }
+    }
+    
+    // Write the whole state as a compacted binary snapshot, then start a new, empty log.
+    // The snapshot replaces the old one by a rename, so a crash leaves one or the other.
+    bool writeSnapshot() {
+        BinaryWriter payload;
+        std::vector<std::string> words;
         std::function<void(TrieNode*, std::string)> dfs = [&](TrieNode* node, std::string prefix) {
             if (node->isEndOfWord) {
-                file << prefix << std::endl;
+                words.push_back(prefix);
             }
             
             for (const auto& [ch, child] : node->children) {
                 dfs(child, prefix + ch);
             }
         };
-        
         dfs(root, "");
-        std::cout << "Banned words saved to " << filename << std::endl;
-    }
-    
-    // Save statistics to file
-    void saveStatistics(const std::string& filename) {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error opening file for writing: " << filename << std::endl;
-            return;
-        }
         
+        payload.putU64(words.size());
+        for (const auto& word : words) {
+            payload.putString(word);
+        }
+        termRelationships.writeSnapshot(payload);
+        payload.putU64(flaggedTermsFrequency.size());
         for (const auto& [term, freq] : flaggedTermsFrequency) {
-            file << term << "," << freq << std::endl;
+            payload.putString(term);
+            payload.putU64(static_cast<uint64_t>(static_cast<int64_t>(freq)));
         }
         
-        std::cout << "Statistics saved to " << filename << std::endl;
+        // Header: magic, last log generation included, payload size and checksum
+        BinaryWriter header;
+        header.buffer.assign(SnapshotMagic, sizeof(SnapshotMagic));
+        header.putU64(wal.generation);
+        header.putU64(payload.buffer.size());
+        header.putU64(checksum(payload.buffer.data(), payload.buffer.size()));
+        
+        std::string temporary = snapshotPath() + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(header.buffer.data(), static_cast<std::streamsize>(header.buffer.size()));
+            file.write(payload.buffer.data(), static_cast<std::streamsize>(payload.buffer.size()));
+            if (!file) {
+                std::cerr << "Error writing file: " << temporary << std::endl;
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, snapshotPath(), error);
+        if (error) {
+            std::cerr << "Error replacing snapshot: " << snapshotPath() << std::endl;
+            return false;
+        }
+        
+        // Counts still waiting to be logged are in the snapshot now
+        snapshotBytes = header.buffer.size() + payload.buffer.size();
+        pendingCounts.clear();
+        return wal.reset(logPath(), wal.generation + 1);
     }
     
-    // Load statistics from file
-    void loadStatistics(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Statistics file not found: " << filename << std::endl;
-            return;
+    // Read a snapshot into the empty system; returns the last log generation it includes
+    bool readSnapshot(uint64_t& covered) {
+        std::string contents;
+        if (!readWholeFile(snapshotPath(), contents)) return false;
+        
+        BinaryReader header(contents, sizeof(SnapshotMagic));
+        covered = header.getU64();
+        uint64_t payloadBytes = header.getU64();
+        uint64_t expected = header.getU64();
+        size_t headerBytes = sizeof(SnapshotMagic) + 24;
+        if (contents.compare(0, sizeof(SnapshotMagic), SnapshotMagic, sizeof(SnapshotMagic)) != 0 || !header.ok ||
+            contents.size() - headerBytes != payloadBytes || checksum(contents.data() + headerBytes, payloadBytes) != expected) {
+            std::cerr << "Snapshot is damaged and was ignored: " << snapshotPath() << std::endl;
+            covered = 0;
+            return false;
         }
         
-        flaggedTermsFrequency.clear();
-        std::string line;
+        BinaryReader payload(contents, headerBytes);
+        uint64_t wordCount = payload.getU64();
+        for (uint64_t i = 0; i < wordCount && payload.ok; ++i) {
+            insertWord(payload.getString());
+        }
+        termRelationships.readSnapshot(payload);
+        uint64_t termCount = payload.getU64();
+        for (uint64_t i = 0; i < termCount && payload.ok; ++i) {
+            std::string term = payload.getString();
+            flaggedTermsFrequency[term] = static_cast<int>(static_cast<int64_t>(payload.getU64()));
+        }
+        snapshotBytes = contents.size();
+        return payload.ok;
+    }
+    
+    // Rebuild the state from the last snapshot plus the log written after it. Only the log
+    // is replayed record by record; a torn record at its end is cut off.
+    void recoverState() {
+        uint64_t covered = 0;
+        bool haveSnapshot = readSnapshot(covered);
         
-        while (std::getline(file, line)) {
-            std::istringstream iss(line);
-            std::string term;
-            int freq;
-            
-            if (std::getline(iss, term, ',')) {
-                iss >> freq;
-                flaggedTermsFrequency[term] = freq;
+        uint64_t generation = 0;
+        uint64_t validBytes = 0;
+        std::vector<WriteAheadLog::Record> records;
+        bool haveLog = WriteAheadLog::read(logPath(), generation, records, validBytes) && generation > covered;
+        if (haveLog) {
+            for (const auto& record : records) {
+                switch (record.type) {
+                    case WriteAheadLog::CounterDelta:
+                        flaggedTermsFrequency[record.first] += static_cast<int>(record.value);
+                        break;
+                    case WriteAheadLog::NewEdge:
+                        termRelationships.addEdge(record.first, record.second);
+                        break;
+                    case WriteAheadLog::NewBannedWord:
+                        insertWord(record.first);
+                        break;
+                }
             }
+            wal.resume(logPath(), generation, validBytes);
+        } else {
+            wal.reset(logPath(), covered + 1);
         }
+        termRelationships.attachLog(&wal);
         
-        std::cout << "Statistics loaded from " << filename << std::endl;
+        if (haveSnapshot || haveLog) {
+            std::cout << "State recovered from " << dataDirectory << " (" << (haveLog ? records.size() : 0)
+                      << " log records replayed)" << std::endl;
+        }
     }
     
 public:
@@ -265,7 +554,9 @@ public:
         
         // Create data directory if it doesn't exist
         std::filesystem::create_directories(dataDirectory);
+        recoverState();
     }
     
     ~ContentModerationSystem() {
+        saveState();
         delete root;
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "moderation/content_moderation_system.h"
+#include "moderation/unicode.h"
+
+// Every global allocation is counted so the report can show allocations per message
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+// splitmix64: small, fast and identical on every platform, unlike the std distributions,
+// so a seed always produces the same dictionary and corpus
+class Random {
+private:
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    
+    // Uniform in [0, 1)
+    double uniform() {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+    
+    size_t below(size_t bound) {
+        return static_cast<size_t>(next() % bound);
+    }
+};
+
+// Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^s
+class ZipfSampler {
+private:
+    std::vector<double> cdf;
+
+public:
+    ZipfSampler(size_t n, double s) : cdf(n) {
+        double total = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            total += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf[i] = total;
+        }
+        for (double& value : cdf) value /= total;
+    }
+    
+    size_t sample(Random& random) const {
+        auto it = std::lower_bound(cdf.begin(), cdf.end(), random.uniform());
+        return std::min(static_cast<size_t>(it - cdf.begin()), cdf.size() - 1);
+    }
+};
+
+struct BenchOptions {
+    std::vector<size_t> dictionarySizes{10, 1000, 100000, 1000000};
+    size_t messages = 100000;
+    size_t wordsPerMessage = 16;
+    double hitRate = 0.05;                          // Share of message words that are banned terms
+    double zipf = 1.0;
+    double unicode = 0.0;                           // Share of filler words in mixed-case Cyrillic and Greek
+    double duplicates = 0.0;                        // Share of messages repeating an earlier one
+    size_t verdictCacheMegabytes = 0;
+    uint64_t seed = 42;
+    MatchMode mode = MatchMode::WordBoundary;
+    unsigned maxEdits = 1;                          // Only used by --match-mode=fuzzy
+    std::string saveFile;
+    std::string compareFile;
+    double tolerance = 10.0;                        // Allowed regression against the baseline, in percent
+};
+
+// Dictionary terms: lowercase words of 4 to 11 letters, made unique by a base-26 suffix
+std::vector<std::string> makeDictionary(size_t count, Random& random) {
+    std::vector<std::string> terms;
+    terms.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string term;
+        size_t length = 4 + random.below(8);
+        for (size_t j = 0; j < length; ++j) term += static_cast<char>('a' + random.below(26));
+        for (size_t n = i; n > 0; n /= 26) term += static_cast<char>('a' + n % 26);
+        terms.push_back(std::move(term));
+    }
+    return terms;
+}
+
+// Messages mixing Zipf-distributed banned terms into filler words. Filler words carry a digit,
+// so they never equal a dictionary term; with --unicode some are spelled in Cyrillic or Greek,
+// which sends their messages through case folding.
+std::vector<std::string> makeCorpus(const std::vector<std::string>& terms, const BenchOptions& options, Random& random) {
+    ZipfSampler zipf(terms.size(), options.zipf);
+    std::vector<std::string> filler;
+    for (size_t i = 0; i < 4096; ++i) {
+        std::string word;
+        size_t length = 2 + random.below(8);
+        if (options.unicode > 0.0 && random.uniform() < options.unicode) {
+            // Capital and small letters of one script: Cyrillic U+0410..U+044F or Greek U+0391..U+03CF
+            bool cyrillic = random.below(2) == 0;
+            for (size_t j = 0; j < length; ++j) {
+                uint32_t letter = static_cast<uint32_t>(random.below(cyrillic ? 64 : 56));
+                Utf8::append(word, cyrillic ? 0x410 + letter : (letter < 25 ? 0x391 + letter : 0x3B1 + letter - 25));
+            }
+        } else {
+            for (size_t j = 0; j < length; ++j) word += static_cast<char>('a' + random.below(26));
+        }
+        word += static_cast<char>('0' + i % 10);
+        filler.push_back(std::move(word));
+    }
+    
+    std::vector<std::string> corpus;
+    corpus.reserve(options.messages);
+    for (size_t i = 0; i < options.messages; ++i) {
+        if (i > 0 && random.uniform() < options.duplicates) {
+            corpus.push_back(corpus[random.below(i)]);
+            continue;
+        }
+        
+        std::string message;
+        for (size_t j = 0; j < options.wordsPerMessage; ++j) {
+            if (j > 0) message += random.below(8) == 0 ? ", " : " ";
+            if (random.uniform() < options.hitRate) {
+                message += terms[zipf.sample(random)];
+            } else {
+                message += filler[random.below(filler.size())];
+            }
+        }
+        message += '.';
+        corpus.push_back(std::move(message));
+    }
+    return corpus;
+}
+
+struct StageResult {
+    double messagesPerSecond = 0.0;
+    double megabytesPerSecond = 0.0;
+    double p50 = 0.0;                               // Latencies in microseconds
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double allocationsPerMessage = 0.0;
+};
+
+// Time f on every message: one untimed warmup pass, then a measured pass
+template <typename F>
+StageResult runStage(const std::vector<std::string>& corpus, F&& f) {
+    for (const std::string& message : corpus) f(message);
+    
+    std::vector<uint64_t> latencies(corpus.size());
+    size_t bytes = 0;
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        auto before = std::chrono::steady_clock::now();
+        f(corpus[i]);
+        auto after = std::chrono::steady_clock::now();
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count();
+        bytes += corpus[i].size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        size_t index = std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())));
+        return static_cast<double>(latencies[index]) / 1000.0;
+    };
+    
+    StageResult result;
+    result.messagesPerSecond = static_cast<double>(corpus.size()) / seconds;
+    result.megabytesPerSecond = static_cast<double>(bytes) / seconds / (1024.0 * 1024.0);
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    result.allocationsPerMessage = static_cast<double>(allocations) / static_cast<double>(corpus.size());
+    return result;
+}
+
+// Baseline files hold one "key value" pair per line
+std::map<std::string, double> readBaseline(const std::string& filename) {
+    std::map<std::string, double> values;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error opening baseline: " << filename << std::endl;
+        return values;
+    }
+    std::string key;
+    double value;
+    while (file >> key >> value) values[key] = value;
+    return values;
+}
+
+bool parseSizes(const std::string& text, std::vector<size_t>& sizes) {
+    sizes.clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        long long value = std::atoll(item.c_str());
+        if (value <= 0) return false;
+        sizes.push_back(static_cast<size_t>(value));
+    }
+    return !sizes.empty();
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    
+    // Command line: [--terms N,N,...] [--messages N] [--words N] [--hit-rate F] [--zipf S] [--unicode F] [--seed N]
+    //               [--duplicates F] [--verdict-cache MB]
+    //               [--match-mode=word|substring|token|fuzzy] [--max-edits N] [--save FILE] [--compare FILE] [--tolerance PCT]
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (arg == "--terms" && hasValue) {
+            if (!parseSizes(argv[++i], options.dictionarySizes)) {
+                std::cerr << "Invalid dictionary sizes: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--messages" && hasValue) {
+            options.messages = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--words" && hasValue) {
+            options.wordsPerMessage = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--hit-rate" && hasValue) {
+            options.hitRate = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        } else if (arg == "--zipf" && hasValue) {
+            options.zipf = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--unicode" && hasValue) {
+            options.unicode = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        } else if (arg == "--duplicates" && hasValue) {
+            options.duplicates = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        } else if (arg == "--verdict-cache" && hasValue) {
+            options.verdictCacheMegabytes = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--save" && hasValue) {
+            options.saveFile = argv[++i];
+        } else if (arg == "--compare" && hasValue) {
+            options.compareFile = argv[++i];
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--match-mode=substring") {
+            options.mode = MatchMode::Substring;
+        } else if (arg == "--match-mode=token") {
+            options.mode = MatchMode::Token;
+        } else if (arg == "--match-mode=word") {
+            options.mode = MatchMode::WordBoundary;
+        } else if (arg == "--match-mode=fuzzy") {
+            options.mode = MatchMode::Fuzzy;
+        } else if (arg == "--max-edits" && hasValue) {
+            options.maxEdits = static_cast<unsigned>(std::clamp(std::atoi(argv[++i]), 0, 3));
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    std::map<std::string, double> results;
+    std::cout << std::left << std::setw(9) << "terms" << std::setw(9) << "stage" << std::right
+              << std::setw(11) << "load ms" << std::setw(12) << "msgs/s" << std::setw(9) << "MB/s"
+              << std::setw(9) << "p50 us" << std::setw(9) << "p99 us" << std::setw(10) << "p999 us"
+              << std::setw(11) << "allocs/msg" << std::endl;
+    
+    for (size_t size : options.dictionarySizes) {
+        Random random(options.seed + size);
+        std::vector<std::string> terms = makeDictionary(size, random);
+        std::vector<std::string> corpus = makeCorpus(terms, options, random);
+        
+        // Load through the same path the application uses, from a real file
+        std::filesystem::path dictionaryFile = std::filesystem::temp_directory_path() /
+            ("moderation_bench_" + std::to_string(size) + ".txt");
+        {
+            std::ofstream file(dictionaryFile);
+            for (const std::string& term : terms) file << term << '\n';
+        }
+        
+        ContentModerationSystem cms;
+        std::ostringstream status;
+        cms.setStatusStream(status);
+        cms.setMatchMode(options.mode);
+        cms.setMaxEdits(options.maxEdits);
+        if (options.verdictCacheMegabytes > 0) cms.enableVerdictCache(options.verdictCacheMegabytes << 20, false);
+        auto loadStart = std::chrono::steady_clock::now();
+        cms.loadBannedWords(dictionaryFile.string());
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        std::filesystem::remove(dictionaryFile);
+        
+        std::vector<TermMatch> matches;
+        std::vector<std::pair<std::string, StageResult>> stages;
+        // scan: dictionary lookup alone; flag: lookup plus statistics and the recent-flag ring;
+        // verdict: the allow/deny fast path, which stops at the first match under the default threshold
+        stages.emplace_back("scan", runStage(corpus, [&](const std::string& message) {
+            matches.clear();
+            cms.findMatches(message, matches);
+        }));
+        stages.emplace_back("flag", runStage(corpus, [&](const std::string& message) {
+            cms.flagContent(message);
+        }));
+        stages.emplace_back("verdict", runStage(corpus, [&](const std::string& message) {
+            cms.checkContent(message);
+        }));
+        
+        for (const auto& [stage, result] : stages) {
+            std::cout << std::left << std::setw(9) << size << std::setw(9) << stage << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(11) << loadMs << std::setprecision(0)
+                      << std::setw(12) << result.messagesPerSecond << std::setprecision(1)
+                      << std::setw(9) << result.megabytesPerSecond << std::setprecision(2)
+                      << std::setw(9) << result.p50 << std::setw(9) << result.p99 << std::setw(10) << result.p999
+                      << std::setw(11) << result.allocationsPerMessage << std::endl;
+            
+            std::string prefix = std::to_string(size) + "." + stage + ".";
+            results[prefix + "msgs_per_s"] = result.messagesPerSecond;
+            results[prefix + "mb_per_s"] = result.megabytesPerSecond;
+            results[prefix + "p50_us"] = result.p50;
+            results[prefix + "p99_us"] = result.p99;
+            results[prefix + "p999_us"] = result.p999;
+            results[prefix + "allocs_per_msg"] = result.allocationsPerMessage;
+        }
+        results[std::to_string(size) + ".load_ms"] = loadMs;
+    }
+    
+    if (!options.saveFile.empty()) {
+        std::ofstream file(options.saveFile);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file for writing: " << options.saveFile << std::endl;
+            return 1;
+        }
+        file << std::setprecision(6);
+        for (const auto& [key, value] : results) file << key << " " << value << "\n";
+        std::cout << "Baseline saved to " << options.saveFile << std::endl;
+    }
+    
+    if (!options.compareFile.empty()) {
+        std::map<std::string, double> baseline = readBaseline(options.compareFile);
+        if (baseline.empty()) return 1;
+        
+        // Throughput may not drop and p99 latency may not rise by more than the tolerance
+        bool regressed = false;
+        double limit = options.tolerance / 100.0;
+        std::cout << "\nComparison with " << options.compareFile << " (tolerance " << options.tolerance << "%):" << std::endl;
+        for (const auto& [key, value] : results) {
+            auto it = baseline.find(key);
+            if (it == baseline.end() || it->second == 0.0) continue;
+            double change = (value - it->second) / it->second;
+            bool throughput = key.find("_per_s") != std::string::npos;
+            bool latency = key.find("p99_us") != std::string::npos;
+            bool worse = (throughput && change < -limit) || (latency && change > limit);
+            regressed = regressed || worse;
+            std::cout << "  " << std::left << std::setw(32) << key << std::right << std::setprecision(2)
+                      << std::setw(14) << it->second << " -> " << std::setw(14) << value
+                      << std::showpos << std::setw(9) << change * 100.0 << "%" << std::noshowpos
+                      << (worse ? "  REGRESSION" : "") << std::endl;
+        }
+        if (regressed) {
+            std::cout << "Performance regressed beyond the tolerance" << std::endl;
+            return 1;
+        }
+        std::cout << "No regressions" << std::endl;
+    }
+    
+    return 0;
+}
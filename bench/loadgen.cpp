@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "moderation/text.h"
+
+// Load generator for `serve`: each connection is a thread with a keep-alive socket that sends
+// one request, waits for the response and sends the next, until the duration is over
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    size_t connections = 16;
+    double seconds = 5.0;
+    size_t batch = 0;                               // Messages per /moderate/batch request; 0 uses /moderate
+    std::string inputFile;                          // One message per line; synthetic messages if empty
+};
+
+struct ConnectionResult {
+    std::vector<uint64_t> latencies;                // Nanoseconds per request
+    size_t errors = 0;
+};
+
+std::vector<std::string> syntheticMessages() {
+    const char* words[] = {"hello", "thanks", "for", "the", "update", "see", "you", "at", "meeting", "tomorrow",
+                           "great", "work", "on", "release", "please", "review", "my", "change", "today", "lunch"};
+    const char* banned[] = {"scam", "fraud", "hate", "abuse"};
+    std::vector<std::string> messages;
+    uint64_t state = 42;
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string message;
+        for (size_t w = 0; w < 12; ++w) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            uint64_t r = state >> 33;
+            if (w > 0) message.push_back(' ');
+            message += (r % 20 == 0) ? banned[(r >> 8) % 4] : words[(r >> 8) % 20];
+        }
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+int connectTo(const LoadOptions& options) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    std::string host = options.host == "localhost" ? "127.0.0.1" : options.host;
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) return -1;
+    
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return fd;
+}
+
+// Send a request and read one response; returns the HTTP status, or 0 if the connection failed
+int exchange(int fd, const std::string& request, std::string& buffer) {
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t n = ::send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return 0;
+        sent += static_cast<size_t>(n);
+    }
+    
+    char chunk[16 * 1024];
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return 0;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    
+    int status = std::atoi(buffer.c_str() + 9);
+    size_t contentLength = 0;
+    size_t field = buffer.find("Content-Length:");
+    if (field != std::string::npos && field < headerEnd) contentLength = std::strtoull(buffer.c_str() + field + 15, nullptr, 10);
+    
+    size_t total = headerEnd + 4 + contentLength;
+    while (buffer.size() < total) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return 0;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    buffer.erase(0, total);
+    return status;
+}
+
+std::string buildRequest(const LoadOptions& options, const std::vector<std::string>& messages, size_t& next) {
+    std::string body;
+    std::string path;
+    if (options.batch == 0) {
+        path = "/moderate";
+        body = "{\"text\":";
+        appendJsonString(body, messages[next++ % messages.size()]);
+        body += "}";
+    } else {
+        path = "/moderate/batch";
+        body = "[";
+        for (size_t i = 0; i < options.batch; ++i) {
+            if (i > 0) body.push_back(',');
+            appendJsonString(body, messages[next++ % messages.size()]);
+        }
+        body += "]";
+    }
+    return "POST " + path + " HTTP/1.1\r\nHost: " + options.host + "\r\nContent-Type: application/json\r\nContent-Length: "
+        + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    
+    // Command line: [--host ADDR] [--port N] [--connections N] [--seconds S] [--batch N] [--input FILE]
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--connections" && hasValue) {
+            options.connections = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::max(0.1, std::atof(argv[++i]));
+        } else if (arg == "--batch" && hasValue) {
+            options.batch = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--input" && hasValue) {
+            options.inputFile = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    std::vector<std::string> messages;
+    if (!options.inputFile.empty()) {
+        std::ifstream file(options.inputFile);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file: " << options.inputFile << std::endl;
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line)) messages.push_back(line);
+    }
+    if (messages.empty()) messages = syntheticMessages();
+    
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    std::atomic<bool> connectFailed{false};
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.seconds));
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c] {
+            ConnectionResult& result = results[c];
+            int fd = connectTo(options);
+            if (fd < 0) {
+                connectFailed = true;
+                return;
+            }
+            
+            std::string buffer;
+            size_t next = c * 7919;
+            while (std::chrono::steady_clock::now() < deadline) {
+                std::string request = buildRequest(options, messages, next);
+                auto before = std::chrono::steady_clock::now();
+                int status = exchange(fd, request, buffer);
+                auto after = std::chrono::steady_clock::now();
+                if (status == 0) {
+                    // Count the failure and reconnect; the server closes the socket after some errors
+                    ++result.errors;
+                    ::close(fd);
+                    buffer.clear();
+                    fd = connectTo(options);
+                    if (fd < 0) return;
+                    continue;
+                }
+                if (status != 200) ++result.errors;
+                result.latencies.push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+            }
+            ::close(fd);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    if (connectFailed) {
+        std::cerr << "Could not connect to " << options.host << ":" << options.port << std::endl;
+        return 1;
+    }
+    
+    std::vector<uint64_t> latencies;
+    size_t errors = 0;
+    for (const auto& result : results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+    }
+    if (latencies.empty()) {
+        std::cerr << "No requests completed" << std::endl;
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        size_t index = std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())));
+        return static_cast<double>(latencies[index]) / 1000.0;
+    };
+    
+    size_t perRequest = std::max<size_t>(1, options.batch);
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "Requests: " << latencies.size() << " in " << std::setprecision(2) << elapsed << "s over "
+              << options.connections << " connections (" << errors << " errors)" << std::endl;
+    std::cout << std::setprecision(0) << "Throughput: " << static_cast<double>(latencies.size()) / elapsed << " requests/s, "
+              << static_cast<double>(latencies.size() * perRequest) / elapsed << " messages/s" << std::endl;
+    std::cout << std::setprecision(1) << "Latency (us): p50 " << percentile(0.5) << ", p99 " << percentile(0.99)
+              << ", p99.9 " << percentile(0.999) << ", max " << static_cast<double>(latencies.back()) / 1000.0 << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -1,336 +1,235 @@
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <queue>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <algorithm>
-#include <chrono>
-#include <ctime>
 
-// Trie node structure for efficient keyword matching
-class TrieNode {
-public:
-    std::unordered_map<char, TrieNode*> children;
-    bool isEndOfWord;
-    std::string word;
-    
-    TrieNode() : isEndOfWord(false) {}
-    
-    ~TrieNode() {
-        for (auto& pair : children) {
-            delete pair.second;
-        }
-    }
-};
+#include "moderation/batch.h"
+#include "moderation/content_moderation_system.h"
+#include "moderation/corpus_scan.h"
+#include "moderation/http_server.h"
+#include "moderation/tokenizer.h"
+#include "moderation/unicode.h"
 
-// Graph structure for representing relationships between flagged terms
-class Graph {
-private:
-    std::unordered_map<std::string, std::vector<std::string>> adjacencyList;
-    
-public:
-    // Add a connection between two words
-    void addEdge(const std::string& word1, const std::string& word2) {
-        adjacencyList[word1].push_back(word2);
-        adjacencyList[word2].push_back(word1); // Undirected graph
-    }
+int main(int argc, char* argv[]) {
+    // Create and initialize the content moderation system
+    ContentModerationSystem cms;
+    bool batchMode = false;
+    bool historyMode = false;
+    bool compileMode = false;
+    bool statsMode = false;
+    bool serveMode = false;
+    bool scanMode = false;
+    bool streamMode = false;
+    size_t chunkBytes = 0;
+    ServerOptions serverOptions;
+    bool statsJson = false;
+    std::string metricsFile;
+    std::string compileOutput;
+    BatchOptions batchOptions;
+    std::string flagLogDirectory = "flag_log";
+    std::string feedbackLogFile = "feedback.log";
+    size_t historySkip = 0;
+    size_t historyLimit = 20;
+    size_t verdictCacheMegabytes = 0;
+    bool nearDuplicates = false;
     
-    // Get related words using BFS
-    std::vector<std::string> getRelatedWords(const std::string& startWord, int maxDepth = 2) {
-        std::unordered_set<std::string> visited;
-        std::queue<std::pair<std::string, int>> queue; // Word, depth
-        std::vector<std::string> relatedWords;
-        
-        queue.push({startWord, 0});
-        visited.insert(startWord);
+    // Command line: [batch [--input FILE] [--threads N] [--format jsonl|tsv] [--dict FILE] [--block-size N] [--verdict-only]
+    //                      [--policies NAME,...]]
+    //               [history [--skip N] [--limit N]] [--flag-log DIR] [compile [--dict FILE] [--output FILE]]
+    //               [stats [--json] [--input FILE] [--dict FILE]] [--metrics-file FILE]
+    //               [serve [--host ADDR] [--port N] [--threads N] [--max-batch N] [--dict FILE]]
+    //               [--match-mode=word|substring|token|fuzzy] [--max-edits N] [--threshold N] [--self-test]
+    //               [scan FILE [--threads N] [--format jsonl|tsv] [--dict FILE]]
+    //               [stream [FILE] [--chunk-bytes N] [--format jsonl|tsv] [--dict FILE]]
+    //               [--verdict-cache MB] [--near-duplicates] [--feedback-log FILE]
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
         
-        while (!queue.empty()) {
-            auto [currentWord, depth] = queue.front();
-            queue.pop();
-            
-            if (depth > 0) { // Don't include the starting word
-                relatedWords.push_back(currentWord);
+        if (arg == "batch") {
+            batchMode = true;
+        } else if (arg == "history") {
+            historyMode = true;
+        } else if (arg == "compile") {
+            compileMode = true;
+        } else if (arg == "stats") {
+            statsMode = true;
+        } else if (arg == "serve") {
+            serveMode = true;
+        } else if (arg == "scan") {
+            scanMode = true;
+            if (hasValue && argv[i + 1][0] != '-') batchOptions.inputFile = argv[++i];
+        } else if (arg == "stream") {
+            streamMode = true;
+            if (hasValue && argv[i + 1][0] != '-') batchOptions.inputFile = argv[++i];
+        } else if (arg == "--chunk-bytes" && hasValue) {
+            chunkBytes = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--host" && hasValue) {
+            serverOptions.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            int port = std::atoi(argv[++i]);
+            if (port <= 0 || port > 65535) {
+                std::cerr << "Invalid port: " << argv[i] << std::endl;
+                return 1;
             }
-            
-            if (depth < maxDepth) {
-                for (const auto& neighbor : adjacencyList[currentWord]) {
-                    if (visited.find(neighbor) == visited.end()) {
-                        visited.insert(neighbor);
-                        queue.push({neighbor, depth + 1});
-                    }
-                }
+            serverOptions.port = static_cast<uint16_t>(port);
+        } else if (arg == "--max-batch" && hasValue) {
+            serverOptions.maxBatchMessages = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json") {
+            statsJson = true;
+        } else if (arg == "--metrics-file" && hasValue) {
+            metricsFile = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            compileOutput = argv[++i];
+        } else if (arg == "--flag-log" && hasValue) {
+            flagLogDirectory = argv[++i];
+        } else if (arg == "--feedback-log" && hasValue) {
+            feedbackLogFile = argv[++i];
+        } else if (arg == "--skip" && hasValue) {
+            historySkip = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--limit" && hasValue) {
+            historyLimit = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--input" && hasValue) {
+            batchOptions.inputFile = argv[++i];
+        } else if (arg == "--dict" && hasValue) {
+            batchOptions.bannedWordsFile = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            batchOptions.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--block-size" && hasValue) {
+            batchOptions.blockSize = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format != "jsonl" && format != "tsv") {
+                std::cerr << "Unknown output format: " << format << std::endl;
+                return 1;
             }
-        }
-        
-        return relatedWords;
-    }
-    
-    // Visualize graph connections for a specific word
-    void visualizeConnections(const std::string& word) {
-        if (adjacencyList.find(word) == adjacencyList.end()) {
-            std::cout << "No connections found for word: " << word << std::endl;
-            return;
-        }
-        
-        std::cout << "Connections for '" << word << "':" << std::endl;
-        std::cout << word << " -> ";
-        
-        bool first = true;
-        for (const auto& neighbor : adjacencyList[word]) {
-            if (!first) std::cout << ", ";
-            std::cout << neighbor;
-            first = false;
-        }
-        std::cout << std::endl;
-    }
-};
-
-// Content Moderation System class
-class ContentModerationSystem {
-private:
-    TrieNode* root;
-    Graph termRelationships;
-    std::unordered_map<std::string, int> flaggedTermsFrequency;
-    std::vector<std::pair<std::string, std::vector<std::string>>> flaggedContent;
-    
-    // Insert a word into the Trie
-    void insertWord(const std::string& word) {
-        TrieNode* current = root;
-        
-        for (char c : word) {
-            if (current->children.find(c) == current->children.end()) {
-                current->children[c] = new TrieNode();
+            batchOptions.format = (format == "tsv") ? OutputFormat::TSV : OutputFormat::JSONL;
+        } else if (arg == "--self-test") {
+            // Check the vectorized tokenizer and UTF-8 normalizer against reference implementations and exit
+            bool tokenizerOk = runTokenizerSelfTest();
+            bool unicodeOk = runUnicodeSelfTest();
+            return tokenizerOk && unicodeOk ? 0 : 1;
+        } else if (arg == "--match-mode=substring") {
+            cms.setMatchMode(MatchMode::Substring);
+        } else if (arg == "--match-mode=token") {
+            cms.setMatchMode(MatchMode::Token);
+        } else if (arg == "--match-mode=word") {
+            cms.setMatchMode(MatchMode::WordBoundary);
+        } else if (arg == "--match-mode=fuzzy") {
+            cms.setMatchMode(MatchMode::Fuzzy);
+        } else if (arg == "--max-edits" && hasValue) {
+            int edits = std::atoi(argv[++i]);
+            if (edits < 0 || edits > 3) {
+                std::cerr << "Invalid edit distance (0-3): " << argv[i] << std::endl;
+                return 1;
             }
-            current = current->children[c];
-        }
-        
-        current->isEndOfWord = true;
-        current->word = word;
-    }
-    
-    // Search for a word in the Trie
-    bool searchWord(const std::string& word) {
-        TrieNode* current = root;
-        
-        for (char c : word) {
-            if (current->children.find(c) == current->children.end()) {
-                return false;
+            cms.setMaxEdits(static_cast<unsigned>(edits));
+        } else if (arg == "--threshold" && hasValue) {
+            long threshold = std::atol(argv[++i]);
+            if (threshold < 1 || threshold > UINT32_MAX) {
+                std::cerr << "Invalid verdict threshold: " << argv[i] << std::endl;
+                return 1;
             }
-            current = current->children[c];
+            cms.setVerdictThreshold(static_cast<uint32_t>(threshold));
+        } else if (arg == "--verdict-cache" && hasValue) {
+            verdictCacheMegabytes = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--near-duplicates") {
+            nearDuplicates = true;
+        } else if (arg == "--verdict-only") {
+            batchOptions.verdictOnly = true;
+        } else if (arg == "--policies" && hasValue) {
+            batchOptions.policies = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
         }
-        
-        return current->isEndOfWord;
     }
     
-    // Search for flagged words in a given text
-    std::vector<std::string> searchFlaggedWords(const std::string& text) {
-        std::vector<std::string> flaggedWords;
-        std::string lowerText = text;
-        std::transform(lowerText.begin(), lowerText.end(), lowerText.begin(), ::tolower);
-        
-        std::istringstream iss(lowerText);
-        std::string word;
-        
-        while (iss >> word) {
-            // Remove punctuation
-            word.erase(std::remove_if(word.begin(), word.end(), 
-                [](char c) { return std::ispunct(static_cast<unsigned char>(c)); }), word.end());
-            
-            if (searchWord(word)) {
-                flaggedWords.push_back(word);
-                flaggedTermsFrequency[word]++;
-            }
-        }
-        
-        return flaggedWords;
-    }
+#ifdef SIGHUP
+    std::signal(SIGHUP, requestDictionaryReload);
+#endif
     
-public:
-    ContentModerationSystem() {
-        root = new TrieNode();
+    if (compileMode) {
+        return runCompile(batchOptions.bannedWordsFile, compileOutput);
     }
     
-    ~ContentModerationSystem() {
-        delete root;
+    if (nearDuplicates && verdictCacheMegabytes == 0) {
+        std::cerr << "--near-duplicates needs --verdict-cache MB" << std::endl;
+        return 1;
+    }
+    if (verdictCacheMegabytes > 0) {
+        cms.enableVerdictCache(verdictCacheMegabytes << 20, nearDuplicates);
     }
     
-    // Load banned words from file
-    void loadBannedWords(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error opening file: " << filename << std::endl;
-            return;
-        }
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            // Remove any whitespace
-            line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
-            
-            if (!line.empty()) {
-                std::transform(line.begin(), line.end(), line.begin(), ::tolower);
-                insertWord(line);
-            }
-        }
-        
-        std::cout << "Banned words loaded successfully." << std::endl;
+    // Prometheus text file, refreshed in the background and once more on exit
+    if (!metricsFile.empty()) {
+        cms.setMetricsFile(metricsFile);
     }
     
-    // Add relationships between terms
-    void addTermRelationship(const std::string& term1, const std::string& term2) {
-        termRelationships.addEdge(term1, term2);
+    // Confirmed false positives stay allowlisted in every mode; the interactive and serve modes
+    // take new feedback, so they create the log if it is missing
+    bool takesFeedback = serveMode || !(batchMode || historyMode || statsMode || scanMode || streamMode);
+    if (takesFeedback || std::ifstream(feedbackLogFile).good()) {
+        cms.openFeedbackLog(feedbackLogFile);
     }
     
-    // Flag content if it contains banned words
-    bool flagContent(const std::string& content) {
-        std::vector<std::string> flagged = searchFlaggedWords(content);
-        
-        if (!flagged.empty()) {
-            flaggedContent.push_back({content, flagged});
-            return true;
-        }
-        
-        return false;
+    if (statsMode) {
+        return runStats(cms, batchOptions, statsJson);
     }
     
-    // Process and analyze content
-    void processContent(const std::string& content) {
-        std::cout << "\n====== CONTENT ANALYSIS ======" << std::endl;
-        std::cout << "Content: \"" << content << "\"" << std::endl;
-        
-        bool isFlagged = flagContent(content);
-        
-        if (isFlagged) {
-            std::cout << "STATUS: FLAGGED" << std::endl;
-            
-            const auto& lastFlagged = flaggedContent.back();
-            std::cout << "Flagged terms:" << std::endl;
-            
-            for (const auto& term : lastFlagged.second) {
-                std::cout << "- \"" << term << "\"";
-                
-                // Show the frequency of this term
-                std::cout << " (Occurrence frequency: " << flaggedTermsFrequency[term] << ")" << std::endl;
-                
-                // Find related terms
-                std::vector<std::string> relatedTerms = termRelationships.getRelatedWords(term);
-                if (!relatedTerms.empty()) {
-                    std::cout << "  Related terms: ";
-                    for (size_t i = 0; i < relatedTerms.size(); ++i) {
-                        if (i > 0) std::cout << ", ";
-                        std::cout << relatedTerms[i];
-                    }
-                    std::cout << std::endl;
-                }
-            }
-        } else {
-            std::cout << "STATUS: APPROVED (No banned words detected)" << std::endl;
-        }
-        
-        std::cout << "=============================" << std::endl;
+    if (scanMode) {
+        ScanOptions scanOptions;
+        scanOptions.inputFile = batchOptions.inputFile;
+        scanOptions.bannedWordsFile = batchOptions.bannedWordsFile;
+        scanOptions.threads = batchOptions.threads;
+        scanOptions.format = batchOptions.format;
+        if (chunkBytes > 0) scanOptions.chunkBytes = chunkBytes;
+        return runScan(cms, scanOptions);
     }
     
-    // Get user feedback on flagged content
-    void collectFeedback() {
-        if (flaggedContent.empty()) {
-            std::cout << "No flagged content to review." << std::endl;
-            return;
-        }
-        
-        const auto& lastFlagged = flaggedContent.back();
-        std::cout << "\n====== FEEDBACK REQUEST ======" << std::endl;
-        std::cout << "Is the flagging correct for: \"" << lastFlagged.first << "\"?" << std::endl;
-        std::cout << "1. Yes, correct flagging" << std::endl;
-        std::cout << "2. No, this is a false positive" << std::endl;
-        
-        int choice;
-        std::cin >> choice;
-        std::cin.ignore(); // Clear newline
-        
-        if (choice == 2) {
-            std::cout << "Thank you for your feedback. This will help improve the system." << std::endl;
-            // In a real system, this would be logged for model improvement
-        } else {
-            std::cout << "Thank you for confirming." << std::endl;
-        }
+    if (streamMode) {
+        ScanOptions streamOptions;
+        streamOptions.inputFile = batchOptions.inputFile;
+        streamOptions.bannedWordsFile = batchOptions.bannedWordsFile;
+        streamOptions.chunkBytes = chunkBytes > 0 ? chunkBytes : 64u << 10;
+        streamOptions.format = batchOptions.format;
+        return runStream(cms, streamOptions);
     }
     
-    // Visualize the graph of term relationships
-    void visualizeTermGraph() {
-        std::cout << "\n====== TERM RELATIONSHIPS ======" << std::endl;
-        
-        for (const auto& [term, _] : flaggedTermsFrequency) {
-            termRelationships.visualizeConnections(term);
-        }
-        
-        std::cout << "===============================" << std::endl;
+    if (serveMode) {
+        serverOptions.bannedWordsFile = batchOptions.bannedWordsFile;
+        serverOptions.threads = batchOptions.threads;
+        return runServer(cms, serverOptions);
     }
     
-    // Add a new banned word to the system
-    void addBannedWord(const std::string& word, const std::string& filename) {
-        std::string lowerWord = word;
-        std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower);
-        insertWord(lowerWord); // Insert the word into the Trie
-		
-		std::ofstream file(filename, std::ios::app);  // Open file in append mode
-		if (file.is_open()) {
-        file << lowerWord << "\n";
-        file.close();
-        std::cout << "Added \"" << lowerWord << "\" to banned words list." << std::endl;
-		} else {
-        std::cerr << "Error opening file: " << filename << std::endl;
-		}
+    if (batchMode) {
+        return runBatch(cms, batchOptions);
     }
     
-    // Show statistics
-    void showStatistics() {
-        std::cout << "\n====== MODERATION STATISTICS ======" << std::endl;
-        std::cout << "Total flagged content: " << flaggedContent.size() << std::endl;
-        
-        std::cout << "Top flagged terms:" << std::endl;
-        std::vector<std::pair<std::string, int>> terms(flaggedTermsFrequency.begin(), flaggedTermsFrequency.end());
-        std::sort(terms.begin(), terms.end(), 
-            [](const auto& a, const auto& b) { return a.second > b.second; });
-        
-        int count = 0;
-        for (const auto& [term, freq] : terms) {
-            std::cout << "- \"" << term << "\": " << freq << " times" << std::endl;
-            if (++count >= 5) break; // Show top 5
+    if (historyMode) {
+        // Term ids in the log are resolved against the current dictionary file
+        cms.setStatusStream(std::cerr);
+        if (std::ifstream(batchOptions.bannedWordsFile).good()) {
+            cms.loadBannedWords(batchOptions.bannedWordsFile);
         }
-        
-        std::cout << "=================================" << std::endl;
+        if (!cms.openFlagLog(flagLogDirectory)) return 1;
+        cms.showFlagHistory(historySkip, historyLimit);
+        return 0;
     }
-};
-
-// Create a banned words file with sample content
-void createSampleBannedWordsFile(const std::string& filename) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error creating file: " << filename << std::endl;
-        return;
-    }
-    
-    file << "hate\nscam\nfraud\nracism\nabuse\nviolence\nbullying\ndiscrimination\n";
-    file.close();
     
-    std::cout << "Sample banned words file created: " << filename << std::endl;
-}
-
-int main() {
     std::cout << "==== Content Moderation System ====\n" << std::endl;
     
-    // Create and initialize the content moderation system
-    ContentModerationSystem cms;
-    
     // Create sample banned words file
     std::string bannedWordsFile = "banned_words.txt";
     createSampleBannedWordsFile(bannedWordsFile);
     
-    // Load banned words
-    cms.loadBannedWords(bannedWordsFile);
+    // Load banned words, and pick up edits to the file (or SIGHUP) while running
+    if (!cms.loadBannedWords(bannedWordsFile)) return 1;
+    cms.watchBannedWordsFile(bannedWordsFile);
+    
+    // Keep the flag history on disk rather than in memory
+    cms.openFlagLog(flagLogDirectory);
     
     // Add term relationships (graph edges)
     cms.addTermRelationship("hate", "racism");
@@ -349,7 +248,8 @@ int main() {
         std::cout << "2. View term relationships" << std::endl;
         std::cout << "3. Add banned word" << std::endl;
         std::cout << "4. Show statistics" << std::endl;
-        std::cout << "5. Exit" << std::endl;
+        std::cout << "5. Review the last flag" << std::endl;
+        std::cout << "6. Exit" << std::endl;
         std::cout << "Choose an option: ";
         
         int choice;
@@ -361,7 +261,6 @@ int main() {
                 std::cout << "Enter content to analyze: ";
                 std::getline(std::cin, input);
                 cms.processContent(input);
-                cms.collectFeedback();
                 break;
                 
             case 2:
@@ -379,6 +278,10 @@ int main() {
                 break;
                 
             case 5:
+                cms.collectFeedback();
+                break;
+                
+            case 6:
                 std::cout << "Exiting program. Goodbye!" << std::endl;
                 return 0;
                 
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "moderation/dictionary_snapshot.h"
+#include "moderation/policy.h"
+#include "moderation/term_dictionary.h"
+#include "moderation/text.h"
+
+// Matches held back by a verdict scan until it knows whether an allowlisted phrase covers them
+struct AllowScan {
+    struct Span {
+        size_t start;
+        size_t end;     // Raw index of the last byte
+    };
+    
+    struct Held {
+        Span span;
+        uint16_t severity;
+        PolicyMask policies;
+    };
+    
+    std::vector<Span> phrases;
+    std::vector<Held> held;
+    
+    void clear() {
+        phrases.clear();
+        held.clear();
+    }
+    
+    bool covered(const Span& span) const {
+        for (const Span& phrase : phrases) {
+            if (phrase.start <= span.start && span.end <= phrase.end) return true;
+        }
+        return false;
+    }
+    
+    // Count every held match no phrase covers; stops when count returns false
+    template <typename Count>
+    void release(Count&& count) const {
+        for (const Held& match : held) {
+            if (!covered(match.span) && !count(match)) return;
+        }
+    }
+};
+
+// Context phrases confirmed as false positives. A phrase is a term of the base or delta, so the
+// automaton finds it in the same scan as the banned terms, and a banned match that lies inside a
+// phrase match is dropped rather than reported. Matches end in scan order, so a banned term can
+// be reported before the phrase around it is complete: verdict scans hold back only the terms
+// that occur inside some phrase, and count every other match at once. The token modes look
+// words up one at a time, so once a token hits such a term they find the phrases around it with
+// one word-mode scan of the same text. Phrase terms are no banned terms: the dictionary leaves
+// them out of its counts, its find() and the per-token indexes.
+class AllowList {
+public:
+    enum Kind : uint8_t {
+        Banned = 0,
+        Phrase = 1,
+        Covered = 2,    // A banned term that occurs inside some phrase
+    };
+
+private:
+    std::vector<uint8_t> kinds; // Kind of each shared term id
+    std::vector<uint32_t> ids;  // The phrases, sorted
+    size_t phraseTotal = 0;
+    size_t pendingPhrases = 0;  // Phrases held by the delta
+    size_t longestPhrase = 0;
+    
+    void mark(uint32_t id, Kind kind) {
+        if (id >= kinds.size()) kinds.resize(id + 1, Banned);
+        if (kinds[id] != Phrase) kinds[id] = kind;
+    }
+
+public:
+    // Classify the terms of base and delta against the phrases with the given ids
+    AllowList(const std::vector<uint32_t>& phraseIds, const TermDictionary& names,
+              const DictionarySnapshot& base, const DictionarySnapshot& delta) {
+        for (uint32_t id : phraseIds) mark(id, Phrase);
+        ids = phraseIds;
+        std::sort(ids.begin(), ids.end());
+        
+        // Substring matches are a superset of what the other automaton modes find in a phrase
+        for (uint32_t id : phraseIds) {
+            std::string_view phrase = names.text(id);
+            longestPhrase = std::max(longestPhrase, phrase.size());
+            if (base.contains(phrase)) ++phraseTotal;
+            if (delta.contains(phrase)) {
+                ++phraseTotal;
+                ++pendingPhrases;
+            }
+            for (const DictionarySnapshot* snapshot : {&base, &delta}) {
+                if (snapshot->termCount() == 0) continue;
+                snapshot->forEachMatch(phrase, MatchMode::Substring, [&](int local, size_t) {
+                    mark(snapshot->termId(local), Covered);
+                    return true;
+                });
+            }
+        }
+    }
+    
+    Kind kind(uint32_t id) const {
+        return id < kinds.size() ? static_cast<Kind>(kinds[id]) : Banned;
+    }
+    
+    // Phrase terms in base and delta together, and in the delta alone
+    size_t phraseCount() const {
+        return phraseTotal;
+    }
+    
+    size_t pendingCount() const {
+        return pendingPhrases;
+    }
+    
+    // Does the list hold exactly these phrases? Indexes built without them can then be kept.
+    bool samePhrases(const std::vector<uint32_t>& phraseIds) const {
+        return phraseIds.size() == ids.size() && std::is_permutation(phraseIds.begin(), phraseIds.end(), ids.begin());
+    }
+    
+    // Normalized length of the longest phrase: how far past a match a phrase covering it can end
+    size_t maxPhraseLength() const {
+        return longestPhrase;
+    }
+    
+    size_t memoryBytes() const {
+        return kinds.capacity() + ids.capacity() * sizeof(uint32_t);
+    }
+    
+    // For a verdict scan: note a phrase match or hold back a match a phrase may cover. False if
+    // the match should be counted right away.
+    bool hold(const DictionarySnapshot& snapshot, std::string_view text, int local, size_t end, AllowScan& scan) const {
+        Kind termKind = kind(snapshot.termId(local));
+        if (termKind == Banned) return false;
+        AllowScan::Span span{snapshot.matchStart(text, end, local), end};
+        if (termKind == Phrase) {
+            scan.phrases.push_back(span);
+        } else {
+            scan.held.push_back({span, snapshot.severity(local), snapshot.policies(local)});
+        }
+        return true;
+    }
+    
+    // Raw span of a token as a phrase match would cover it: without the punctuation around it
+    static AllowScan::Span tokenSpan(std::string_view text, size_t offset, size_t length) {
+        const unsigned char* classes = TextClass::table();
+        size_t start = offset;
+        size_t end = offset + length - 1;
+        while (start < end && classes[static_cast<unsigned char>(text[start])] == TextClass::Skip) ++start;
+        while (end > start && classes[static_cast<unsigned char>(text[end])] == TextClass::Skip) --end;
+        return {start, end};
+    }
+    
+    // Add the phrases in the text to scan; phrases are whole words, so word mode finds every
+    // one a token lies in
+    void findPhrases(const DictionarySnapshot& base, const DictionarySnapshot& delta, std::string_view text, AllowScan& scan) const {
+        for (const DictionarySnapshot* snapshot : {&base, &delta}) {
+            if (snapshot->termCount() == 0) continue;
+            snapshot->forEachMatch(text, MatchMode::WordBoundary, [&](int local, size_t end) {
+                if (kind(snapshot->termId(local)) == Phrase) scan.phrases.push_back({snapshot->matchStart(text, end, local), end});
+                return true;
+            });
+        }
+    }
+    
+    // Remove the token matches in matches[first, end) that lie inside a phrase of the text they
+    // were found in. Only a token of a term that occurs in some phrase costs the scan for them.
+    void filterTokens(const DictionarySnapshot& base, const DictionarySnapshot& delta, std::string_view text,
+                      std::vector<TermMatch>& matches, size_t first) const {
+        auto inPhrase = [&](const TermMatch& match) { return kind(match.termId) == Covered; };
+        if (std::none_of(matches.begin() + static_cast<std::ptrdiff_t>(first), matches.end(), inPhrase)) return;
+        static thread_local AllowScan scan;
+        scan.clear();
+        findPhrases(base, delta, text, scan);
+        if (scan.phrases.empty()) return;
+        
+        auto allowed = [&](const TermMatch& match) {
+            return inPhrase(match) && scan.covered(tokenSpan(text, match.offset, match.length));
+        };
+        matches.erase(std::remove_if(matches.begin() + static_cast<std::ptrdiff_t>(first), matches.end(), allowed), matches.end());
+    }
+    
+    // Remove the phrase matches from matches[first, end), and every match inside one
+    void filter(std::vector<TermMatch>& matches, size_t first) const {
+        static thread_local AllowScan scan;
+        scan.clear();
+        for (size_t i = first; i < matches.size(); ++i) {
+            const TermMatch& match = matches[i];
+            if (kind(match.termId) == Phrase) scan.phrases.push_back({match.offset, match.offset + match.length - 1});
+        }
+        if (scan.phrases.empty()) return;
+        
+        auto allowed = [&](const TermMatch& match) {
+            return kind(match.termId) == Phrase || scan.covered({match.offset, match.offset + match.length - 1});
+        };
+        matches.erase(std::remove_if(matches.begin() + static_cast<std::ptrdiff_t>(first), matches.end(), allowed), matches.end());
+    }
+};
@@ -0,0 +1,336 @@
+#include "moderation/batch.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "moderation/work_stealing_pool.h"
+
+void createSampleBannedWordsFile(const std::string& filename, std::ostream& status) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error creating file: " << filename << std::endl;
+        return;
+    }
+    
+    file << "hate\nscam\nfraud\nracism\nabuse\nviolence\nbullying\ndiscrimination\n";
+    file.close();
+    
+    status << "Sample banned words file created: " << filename << std::endl;
+}
+
+void appendVerdictFields(std::string& out, const DictionaryVersion& dictionary, const std::vector<TermMatch>& matches) {
+    out += "\"status\":";
+    out += matches.empty() ? "\"approved\"" : "\"flagged\"";
+    out += ",\"terms\":[";
+    for (size_t m = 0; m < matches.size(); ++m) {
+        if (m > 0) out.push_back(',');
+        out += "{\"term\":";
+        appendJsonString(out, dictionary.term(matches[m].termId));
+        out += ",\"offset\":" + std::to_string(matches[m].offset);
+        out += ",\"length\":" + std::to_string(matches[m].length) + "}";
+    }
+    out += "]";
+}
+
+void appendScoreFields(std::string& out, const Verdict& verdict) {
+    out += "\"status\":";
+    out += verdict.flagged ? "\"flagged\"" : "\"approved\"";
+    out += ",\"score\":" + std::to_string(verdict.score);
+}
+
+void appendPolicyFields(std::string& out, const PolicyVerdicts& verdicts, const std::vector<std::string>& names) {
+    out += "\"policies\":{";
+    bool first = true;
+    for (PolicyMask rest = verdicts.requested; rest; rest &= rest - 1) {
+        int bit = __builtin_ctzll(rest);
+        if (!first) out.push_back(',');
+        first = false;
+        appendJsonString(out, names[bit]);
+        out += (verdicts.flagged >> bit & 1) ? ":{\"status\":\"flagged\"" : ":{\"status\":\"approved\"";
+        out += ",\"score\":" + std::to_string(verdicts.scores[bit]) + "}";
+    }
+    out += "}";
+}
+
+// Reads newline-delimited messages, moderates them on a work-stealing pool that shares the
+// read-only dictionary, and writes one verdict per message in input order
+class BatchProcessor {
+private:
+    struct Block {
+        size_t firstId;
+        std::vector<std::string> messages;
+    };
+    
+    ContentModerationSystem& cms;
+    BatchOptions options;
+    
+    // Completed blocks waiting for their turn to be written, keyed by sequence number
+    std::mutex doneMutex;
+    std::condition_variable doneSignal;
+    std::map<size_t, std::string> done;
+    std::atomic<size_t> flaggedMessages{0};
+    
+    // Policies to answer for, and the names of all policies by bit
+    PolicyMask policies = 0;
+    std::vector<std::string> policyNames;
+    
+    // Format the verdicts for one block into a single buffer, against a single dictionary version
+    std::string processBlock(const Block& block) {
+        std::string out;
+        cms.withDictionary([&](const DictionaryVersion& dictionary) { formatBlock(block, dictionary, out); });
+        return out;
+    }
+    
+    void formatBlock(const Block& block, const DictionaryVersion& dictionary, std::string& out) {
+        if (policies != 0) {
+            formatPolicies(block, dictionary, out);
+            return;
+        }
+        if (options.verdictOnly) {
+            formatVerdicts(block, dictionary, out);
+            return;
+        }
+        
+        std::vector<TermMatch> matches;
+        size_t flagged = 0;
+        
+        for (size_t i = 0; i < block.messages.size(); ++i) {
+            matches.clear();
+            cms.findMatches(dictionary, block.messages[i], matches);
+            if (!matches.empty()) ++flagged;
+            cms.recordMatches(matches);
+            
+            StageTimer timer(Stage::Output);
+            std::string id = std::to_string(block.firstId + i);
+            
+            if (options.format == OutputFormat::TSV) {
+                out += id;
+                out += matches.empty() ? "\tAPPROVED\t" : "\tFLAGGED\t";
+                for (size_t m = 0; m < matches.size(); ++m) {
+                    if (m > 0) out.push_back(',');
+                    out += dictionary.term(matches[m].termId);
+                }
+            } else {
+                out += "{\"id\":" + id + ",";
+                appendVerdictFields(out, dictionary, matches);
+                out += "}";
+            }
+            out.push_back('\n');
+        }
+        
+        flaggedMessages.fetch_add(flagged, std::memory_order_relaxed);
+    }
+    
+    // Status and score only: no offsets, term lists or statistics, and each scan stops at the threshold
+    void formatVerdicts(const Block& block, const DictionaryVersion& dictionary, std::string& out) {
+        size_t flagged = 0;
+        
+        for (size_t i = 0; i < block.messages.size(); ++i) {
+            Verdict verdict = cms.scoreText(dictionary, block.messages[i]);
+            if (verdict.flagged) ++flagged;
+            
+            StageTimer timer(Stage::Output);
+            std::string id = std::to_string(block.firstId + i);
+            
+            if (options.format == OutputFormat::TSV) {
+                out += id;
+                out += verdict.flagged ? "\tFLAGGED\t" : "\tAPPROVED\t";
+                out += std::to_string(verdict.score);
+            } else {
+                out += "{\"id\":" + id + ",";
+                appendScoreFields(out, verdict);
+                out += "}";
+            }
+            out.push_back('\n');
+        }
+        
+        flaggedMessages.fetch_add(flagged, std::memory_order_relaxed);
+    }
+    
+    // Every requested policy from one scan per message; a message counts as flagged if any denies it
+    void formatPolicies(const Block& block, const DictionaryVersion& dictionary, std::string& out) {
+        size_t flagged = 0;
+        
+        for (size_t i = 0; i < block.messages.size(); ++i) {
+            PolicyVerdicts verdicts = dictionary.scorePolicies(block.messages[i], cms.getMatchMode(), policies,
+                                                               cms.getVerdictThreshold());
+            if (verdicts.flagged) ++flagged;
+            
+            StageTimer timer(Stage::Output);
+            std::string id = std::to_string(block.firstId + i);
+            
+            if (options.format == OutputFormat::TSV) {
+                out += id;
+                for (PolicyMask rest = policies; rest; rest &= rest - 1) {
+                    int bit = __builtin_ctzll(rest);
+                    out += "\t" + policyNames[bit];
+                    out += (verdicts.flagged >> bit & 1) ? "=FLAGGED:" : "=APPROVED:";
+                    out += std::to_string(verdicts.scores[bit]);
+                }
+            } else {
+                out += "{\"id\":" + id + ",";
+                appendPolicyFields(out, verdicts, policyNames);
+                out += "}";
+            }
+            out.push_back('\n');
+        }
+        
+        flaggedMessages.fetch_add(flagged, std::memory_order_relaxed);
+    }
+
+public:
+    BatchProcessor(ContentModerationSystem& cms, const BatchOptions& options, PolicyMask policies = 0)
+        : cms(cms), options(options), policies(policies), policyNames(cms.policies().all()) {}
+    
+    // Moderate every line of input and write the verdicts to output; returns the message count
+    size_t run(std::istream& input, std::ostream& output) {
+        WorkStealingPool pool(options.threads);
+        const size_t maxInFlight = pool.size() * 4; // Bounds memory when the writer falls behind
+        size_t submitted = 0;
+        size_t written = 0;
+        size_t messageCount = 0;
+        
+        // Write every block that is next in sequence; waits for one when block is true
+        auto flushReady = [&](bool block) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            if (block) doneSignal.wait(lock, [&] { return done.count(written) > 0; });
+            while (true) {
+                auto it = done.find(written);
+                if (it == done.end()) break;
+                std::string text = std::move(it->second);
+                done.erase(it);
+                lock.unlock();
+                output.write(text.data(), static_cast<std::streamsize>(text.size()));
+                lock.lock();
+                ++written;
+            }
+        };
+        
+        auto submitBlock = [&](std::shared_ptr<Block> block) {
+            size_t sequence = submitted++;
+            pool.submit([this, block, sequence] {
+                std::string text = processBlock(*block);
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    done.emplace(sequence, std::move(text));
+                }
+                doneSignal.notify_all();
+            });
+        };
+        
+        auto block = std::make_shared<Block>();
+        block->firstId = 1;
+        std::string line;
+        
+        while (std::getline(input, line)) {
+            block->messages.push_back(std::move(line));
+            ++messageCount;
+            if (block->messages.size() < options.blockSize) continue;
+            
+            submitBlock(block);
+            block = std::make_shared<Block>();
+            block->firstId = messageCount + 1;
+            
+            flushReady(false);
+            while (submitted - written >= maxInFlight) flushReady(true);
+        }
+        
+        if (!block->messages.empty()) submitBlock(block);
+        while (written < submitted) flushReady(true);
+        output.flush();
+        return messageCount;
+    }
+    
+    size_t flaggedCount() const { return flaggedMessages.load(); }
+};
+
+int runCompile(const std::string& bannedWordsFile, std::string outputFile) {
+    if (outputFile.empty()) outputFile = compiledDictionaryPath(bannedWordsFile);
+    
+    std::ifstream file(bannedWordsFile);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << bannedWordsFile << std::endl;
+        return 1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TermInfo> info;
+    PolicyRegistry policies;
+    std::vector<std::string> terms = readTermList(file, &info, &policies);
+    DictionarySnapshot snapshot(terms, {}, info);
+    if (!snapshot.save(outputFile, policies.all())) return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << "Compiled " << snapshot.termCount() << " terms from " << bannedWordsFile << " into " << outputFile
+              << " (" << snapshot.memoryBytes() << " bytes) in " << seconds << "s" << std::endl;
+    return 0;
+}
+
+// Load the dictionary, moderate every input message into output and report a summary
+static int moderateInput(ContentModerationSystem& cms, const BatchOptions& options, std::ostream& output) {
+    std::ios::sync_with_stdio(false);
+    cms.setStatusStream(std::cerr);
+    if (!std::ifstream(options.bannedWordsFile).good()) {
+        createSampleBannedWordsFile(options.bannedWordsFile, std::cerr);
+    }
+    if (!cms.loadBannedWords(options.bannedWordsFile)) return 1;
+    cms.watchBannedWordsFile(options.bannedWordsFile);
+    
+    std::string unknown;
+    PolicyMask policies = cms.policies().parse(options.policies, &unknown);
+    if (!unknown.empty()) {
+        std::cerr << "Unknown policy: " << unknown << " (not named in " << options.bannedWordsFile << ")" << std::endl;
+        return 1;
+    }
+    
+    std::ifstream file;
+    if (!options.inputFile.empty()) {
+        file.open(options.inputFile);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file: " << options.inputFile << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = options.inputFile.empty() ? std::cin : file;
+    
+    auto start = std::chrono::steady_clock::now();
+    BatchProcessor processor(cms, options, policies);
+    size_t messages = processor.run(input, output);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::ostringstream summary;
+    summary << "Processed " << messages << " messages (" << processor.flaggedCount() << " flagged) in "
+            << seconds << "s using " << options.threads << " threads";
+    cms.reportStatus(summary.str());
+    
+    summary.str("");
+    summary << "Top flagged terms:";
+    for (const auto& entry : cms.statistics().topK(5)) {
+        summary << " " << cms.termText(entry.termId) << " (" << entry.count << ")";
+    }
+    cms.reportStatus(summary.str());
+    return 0;
+}
+
+int runBatch(ContentModerationSystem& cms, const BatchOptions& options) {
+    return moderateInput(cms, options, std::cout);
+}
+
+int runStats(ContentModerationSystem& cms, const BatchOptions& options, bool json) {
+    std::ostream discard(nullptr);
+    int status = moderateInput(cms, options, discard);
+    if (status != 0) return status;
+    
+    if (json) {
+        writeMetricsJson(std::cout, cms.collectMetrics());
+    } else {
+        cms.showStatistics();
+    }
+    return 0;
+}
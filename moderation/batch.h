@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "moderation/content_moderation_system.h"
+
+// Create a banned words file with sample content
+void createSampleBannedWordsFile(const std::string& filename, std::ostream& status = std::cout);
+
+// Output formats for batch mode
+enum class OutputFormat {
+    JSONL, // {"id":1,"status":"flagged","terms":[{"term":"scam","offset":5,"length":4}]}
+    TSV    // 1<TAB>FLAGGED<TAB>scam,fraud
+};
+
+// Settings for non-interactive batch moderation
+struct BatchOptions {
+    std::string inputFile;                          // Empty means stdin
+    std::string bannedWordsFile = "banned_words.txt";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t blockSize = 1024;                        // Messages per work item
+    OutputFormat format = OutputFormat::JSONL;
+    bool verdictOnly = false;                       // Status and score only, stopping at the threshold
+    std::string policies;                           // Comma-separated policies to answer for, in one scan
+};
+
+// Append the JSON fields of one verdict, `"status":...,"terms":[...]`, shared by batch and serve
+void appendVerdictFields(std::string& out, const DictionaryVersion& dictionary, const std::vector<TermMatch>& matches);
+
+// Append the fields of a verdict-only answer, `"status":...,"score":N`
+void appendScoreFields(std::string& out, const Verdict& verdict);
+
+// Append the per-policy answers, `"policies":{"eu":{"status":...,"score":N},...}`; names are the
+// registry's policy names in bit order
+void appendPolicyFields(std::string& out, const PolicyVerdicts& verdicts, const std::vector<std::string>& names);
+
+// Entry point for `compile`: freeze a text dictionary into a file the engine can map directly
+int runCompile(const std::string& bannedWordsFile, std::string outputFile);
+
+// Entry point for `batch`: verdicts go to stdout, everything else to stderr
+int runBatch(ContentModerationSystem& cms, const BatchOptions& options);
+
+// Entry point for `stats`: moderate the input like `batch`, discard the verdicts and print the
+// statistics and stage timings, as JSON when json is set
+int runStats(ContentModerationSystem& cms, const BatchOptions& options, bool json);
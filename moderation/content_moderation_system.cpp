@@ -0,0 +1,807 @@
+#include "moderation/content_moderation_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool ContentModerationSystem::searchFlaggedWords(const std::string& text, FlagRecord& record) {
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        findMatches(dictionary, text, record.matches);
+        record.dictionaryVersion = dictionary.number;
+    });
+    
+    recordMatches(record.matches);
+    return !record.matches.empty();
+}
+
+void ContentModerationSystem::recordMatches(const std::vector<TermMatch>& matches) {
+    if (matches.empty()) return;
+    static thread_local std::vector<uint32_t> ids;
+    ids.clear();
+    for (const auto& match : matches) {
+        termStatistics.record(match.termId);
+        termRates.record(match.termId);
+        ids.push_back(match.termId);
+    }
+    termRelationships.observe(ids);
+}
+
+std::shared_ptr<const DictionarySnapshot> ContentModerationSystem::readBannedWords(const std::string& filename) {
+    // A directory opens as an empty stream, which would read as an empty list
+    std::error_code typeError;
+    if (!std::filesystem::is_regular_file(filename, typeError)) {
+        std::cerr << "Banned words file " << filename << " is not a regular file." << std::endl;
+        return nullptr;
+    }
+    
+    std::string compiled = filename;
+    if (!DictionarySnapshot::isCompiledFile(filename)) {
+        compiled = compiledDictionaryPath(filename);
+        std::error_code textError, compiledError;
+        auto textTime = std::filesystem::last_write_time(filename, textError);
+        auto compiledTime = std::filesystem::last_write_time(compiled, compiledError);
+        if (compiledError || (!textError && compiledTime < textTime)) compiled.clear();
+    }
+    
+    if (!compiled.empty()) {
+        auto snapshot = DictionarySnapshot::load(compiled,
+            [this](std::string_view term) { return termDictionary.intern(term); },
+            [this](std::string_view policy) { return policyRegistry.intern(policy); });
+        if (snapshot || compiled == filename) return snapshot;
+    }
+    
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return nullptr;
+    }
+    std::vector<TermInfo> info;
+    std::vector<std::string> terms = readTermList(file, &info, &policyRegistry);
+    return freezeTerms(terms, info);
+}
+
+std::shared_ptr<const DictionarySnapshot> ContentModerationSystem::freezeTerms(const std::vector<std::string>& terms,
+                                                                               const std::vector<TermInfo>& info) {
+    std::vector<uint32_t> ids;
+    ids.reserve(terms.size());
+    for (const auto& term : terms) ids.push_back(termDictionary.intern(term));
+    return std::make_shared<const DictionarySnapshot>(terms, ids, info);
+}
+
+void ContentModerationSystem::publish(std::shared_ptr<const DictionarySnapshot> base, std::shared_ptr<const DictionarySnapshot> delta) {
+    const DictionaryVersion* previous = current.load();
+    std::shared_ptr<const AllowList> allow;
+    if (!allowPhraseIds.empty()) allow = std::make_shared<const AllowList>(allowPhraseIds, termDictionary, *base, *delta);
+    
+    // The base only changes on merges and reloads, so its indexes are usually carried over; they
+    // leave the phrases out, so they are rebuilt when those change
+    bool samePhrases = previous && (previous->allow ? previous->allow->samePhrases(allowPhraseIds) : allowPhraseIds.empty());
+    bool sameBase = previous && previous->base == base && samePhrases;
+    std::shared_ptr<const FuzzyIndex> fuzzyBase, fuzzyDelta;
+    if (matchMode == MatchMode::Fuzzy) {
+        fuzzyBase = sameBase && previous->fuzzyBase ? previous->fuzzyBase : std::make_shared<const FuzzyIndex>(*base, allow.get());
+        if (delta->termCount() > 0) fuzzyDelta = std::make_shared<const FuzzyIndex>(*delta, allow.get());
+    }
+    std::shared_ptr<const TokenPrefilter> prefilterBase, prefilterDelta;
+    if (matchMode == MatchMode::Token || matchMode == MatchMode::Fuzzy) {
+        prefilterBase = sameBase && previous->prefilterBase ? previous->prefilterBase : std::make_shared<const TokenPrefilter>(*base, allow.get());
+        if (delta->termCount() > 0) prefilterDelta = std::make_shared<const TokenPrefilter>(*delta, allow.get());
+    }
+    auto* next = new DictionaryVersion{std::move(base), std::move(delta), previous ? previous->number + 1 : 1, &termDictionary,
+                                       std::move(fuzzyBase), std::move(fuzzyDelta), maxEdits,
+                                       std::move(prefilterBase), std::move(prefilterDelta), std::move(allow)};
+    current.store(next);
+    if (previous) epochs.retire([previous] { delete previous; });
+}
+
+void ContentModerationSystem::setMatchMode(MatchMode mode) {
+    std::lock_guard<std::mutex> lock(updateMutex);
+    matchMode = mode;
+    const DictionaryVersion* latest = current.load();
+    bool perToken = mode == MatchMode::Token || mode == MatchMode::Fuzzy;
+    if ((mode == MatchMode::Fuzzy && !latest->fuzzyBase) || (perToken && !latest->prefilterBase)) {
+        publish(latest->base, latest->delta);
+    }
+}
+
+void ContentModerationSystem::setMaxEdits(unsigned edits) {
+    std::lock_guard<std::mutex> lock(updateMutex);
+    maxEdits = edits;
+    const DictionaryVersion* latest = current.load();
+    publish(latest->base, latest->delta);
+}
+
+void ContentModerationSystem::mergeDelta() {
+    std::shared_ptr<const DictionarySnapshot> base, delta;
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        base = current.load()->base;
+        delta = current.load()->delta;
+    }
+    if (delta->termCount() == 0) return;
+    
+    std::vector<std::string> terms = base->terms();
+    std::vector<std::string> added = delta->terms();
+    std::vector<TermInfo> info = base->info();
+    std::vector<TermInfo> addedInfo = delta->info();
+    terms.insert(terms.end(), added.begin(), added.end());
+    info.insert(info.end(), addedInfo.begin(), addedInfo.end());
+    auto merged = freezeTerms(terms, info);
+    
+    std::lock_guard<std::mutex> lock(updateMutex);
+    const DictionaryVersion* latest = current.load();
+    if (latest->base != base) return; // Reloaded from file in the meantime
+    
+    std::vector<std::string> remaining = latest->delta->terms();
+    info = latest->delta->info();
+    remaining.erase(remaining.begin(), remaining.begin() + static_cast<std::ptrdiff_t>(delta->termCount()));
+    info.erase(info.begin(), info.begin() + static_cast<std::ptrdiff_t>(delta->termCount()));
+    publish(merged, freezeTerms(remaining, info));
+}
+
+void ContentModerationSystem::reloadWatchedFile() {
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex);
+        filename = watchedFile;
+    }
+    if (filename.empty()) return;
+    
+    auto base = readBannedWords(filename);
+    if (!base) return;
+    
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        publish(base, allowDelta(*base));
+    }
+    reportStatus("Reloaded banned words from " + filename + " (" + std::to_string(base->termCount()) + " terms).");
+}
+
+bool ContentModerationSystem::watchedFileChanged() {
+    std::lock_guard<std::mutex> lock(maintenanceMutex);
+    if (watchedFile.empty()) return false;
+    
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(watchedFile, error);
+    if (error || writeTime == watchedWriteTime) return false;
+    watchedWriteTime = writeTime;
+    return true;
+}
+
+void ContentModerationSystem::maintenanceLoop() {
+#ifdef __linux__
+    // Rebuilds are background work: on a busy machine they should yield to the scanning threads
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+    
+    while (true) {
+        bool merge = false;
+        {
+            std::unique_lock<std::mutex> lock(maintenanceMutex);
+            maintenanceSignal.wait_for(lock, std::chrono::milliseconds(500),
+                [this] { return stopMaintenance || mergePending || dictionaryReloadRequested.load() || !feedbackQueue.empty(); });
+            if (stopMaintenance) return;
+        }
+        
+        termRates.advance();
+        drainFeedback();
+        {
+            std::lock_guard<std::mutex> lock(maintenanceMutex);
+            merge = mergePending;
+            mergePending = false;
+        }
+        if (dictionaryReloadRequested.exchange(false) | watchedFileChanged()) {
+            reloadWatchedFile();
+        } else if (merge) {
+            mergeDelta();
+        }
+        epochs.reclaim();
+        
+        std::string metricsPath;
+        {
+            std::lock_guard<std::mutex> lock(maintenanceMutex);
+            metricsPath = metricsFile;
+        }
+        if (!metricsPath.empty()) writeMetricsFile(metricsPath);
+    }
+}
+
+ContentModerationSystem::ContentModerationSystem() {
+    publish(std::make_shared<const DictionarySnapshot>(), std::make_shared<const DictionarySnapshot>());
+    maintenanceThread = std::thread([this] { maintenanceLoop(); });
+}
+
+ContentModerationSystem::~ContentModerationSystem() {
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex);
+        stopMaintenance = true;
+    }
+    maintenanceSignal.notify_all();
+    maintenanceThread.join();
+    drainFeedback();
+    if (!metricsFile.empty()) writeMetricsFile(metricsFile);
+    delete current.load();
+}
+
+void ContentModerationSystem::watchBannedWordsFile(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(maintenanceMutex);
+    watchedFile = filename;
+    std::error_code error;
+    watchedWriteTime = std::filesystem::last_write_time(filename, error);
+}
+
+void ContentModerationSystem::reportStatus(const std::string& line) {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    *statusOut << line << std::endl;
+}
+
+void ContentModerationSystem::findMatches(const std::string& text, std::vector<TermMatch>& matches) const {
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        dictionary.findMatches(text, matchMode, matches);
+    });
+}
+
+void ContentModerationSystem::enableVerdictCache(size_t bytes, bool nearDuplicates) {
+    verdictCache = std::make_unique<VerdictCache>(bytes, nearDuplicates);
+}
+
+void ContentModerationSystem::findMatches(const DictionaryVersion& dictionary, const std::string& text,
+                                          std::vector<TermMatch>& matches) const {
+    if (!verdictCache) {
+        dictionary.findMatches(text, matchMode, matches);
+        return;
+    }
+    
+    VerdictCache::Key key = VerdictCache::key(text, VerdictCache::matchSalt(matchMode));
+    if (verdictCache->findMatches(key, dictionary.number, matches)) return;
+    size_t first = matches.size();
+    dictionary.findMatches(text, matchMode, matches);
+    verdictCache->storeMatches(key, dictionary.number, matches, first);
+}
+
+Verdict ContentModerationSystem::scoreText(const DictionaryVersion& dictionary, const std::string& text) const {
+    if (!verdictCache) return dictionary.scoreText(text, matchMode, verdictThreshold);
+    
+    uint64_t salt = VerdictCache::verdictSalt(matchMode, verdictThreshold);
+    VerdictCache::Key key = VerdictCache::key(text, salt);
+    Verdict verdict;
+    if (verdictCache->findVerdict(key, dictionary.number, verdict)) return verdict;
+    
+    // Exact copies are the common case, so only a miss pays for tokenizing into a SimHash
+    uint64_t simHash = verdictCache->nearDuplicates() ? VerdictCache::simHash(text) : 0;
+    if (verdictCache->findNearVerdict(simHash, salt, dictionary.number, verdict)) return verdict;
+    
+    verdict = dictionary.scoreText(text, matchMode, verdictThreshold);
+    verdictCache->storeVerdict(key, simHash, salt, dictionary.number, verdict);
+    return verdict;
+}
+
+bool ContentModerationSystem::openFlagLog(const std::string& directory, size_t maxSegmentBytes) {
+    return flagLog.open(directory, maxSegmentBytes);
+}
+
+std::string ContentModerationSystem::describeFlag(const FlagRecord& record) const {
+    std::ostringstream out;
+    std::time_t seconds = static_cast<std::time_t>(record.timestamp / 1000000);
+    out << std::put_time(std::localtime(&seconds), "%Y-%m-%d %H:%M:%S") << " #"
+        << std::hex << std::setw(16) << std::setfill('0') << record.contentHash << std::dec << " [";
+    for (size_t i = 0; i < record.matches.size(); ++i) {
+        const TermMatch& match = record.matches[i];
+        if (i > 0) out << ", ";
+        if (match.termId < termDictionary.size()) {
+            out << termDictionary.text(match.termId);
+        } else {
+            out << "term " << match.termId;
+        }
+        out << " @" << match.offset;
+    }
+    out << "]";
+    return out.str();
+}
+
+void ContentModerationSystem::showFlagHistory(size_t skip, size_t limit) {
+    std::cout << "\n====== FLAG HISTORY ======" << std::endl;
+    size_t position = 0;
+    flagLog.forEachNewest([&](const FlagRecord& record) {
+        if (position >= skip + limit) return false;
+        if (position++ >= skip) std::cout << describeFlag(record) << std::endl;
+        return true;
+    });
+    if (position <= skip) std::cout << "No flags logged." << std::endl;
+    std::cout << "==========================" << std::endl;
+}
+
+std::string ContentModerationSystem::termText(uint32_t termId) const {
+    return std::string(termDictionary.text(termId));
+}
+
+bool ContentModerationSystem::loadBannedWords(const std::string& filename) {
+    std::shared_ptr<const DictionarySnapshot> base = readBannedWords(filename);
+    if (!base) return false;
+    
+    // A first load uses the snapshot as is, so a compiled file stays mapped and shared.
+    // Allowlisted phrases are left out here and come back through the delta.
+    std::vector<std::string> terms;
+    std::vector<TermInfo> info;
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        std::vector<std::string> known = dictionary.terms();
+        std::vector<TermInfo> knownInfo = dictionary.info();
+        for (size_t i = 0; i < known.size(); ++i) {
+            if (dictionary.allowed(dictionary.lookup(known[i]).id())) continue;
+            terms.push_back(std::move(known[i]));
+            info.push_back(knownInfo[i]);
+        }
+    });
+    if (!terms.empty()) {
+        std::vector<std::string> added = base->terms();
+        std::vector<TermInfo> addedInfo = base->info();
+        terms.insert(terms.end(), added.begin(), added.end());
+        info.insert(info.end(), addedInfo.begin(), addedInfo.end());
+        base = freezeTerms(terms, info);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        publish(base, allowDelta(*base));
+    }
+    std::ostringstream status;
+    status << "Banned words loaded successfully (" << base->termCount() << " terms, "
+           << base->bytesPerTerm() << " bytes/term" << (base->isMapped() ? ", mapped from compiled file" : "") << ").";
+    reportStatus(status.str());
+    return true;
+}
+
+void ContentModerationSystem::addTermRelationship(const std::string& term1, const std::string& term2) {
+    termRelationships.addEdge(termDictionary.intern(term1), termDictionary.intern(term2));
+}
+
+bool ContentModerationSystem::flagContent(const std::string& content) {
+    FlagRecord record;
+    
+    if (searchFlaggedWords(content, record)) {
+        record.contentHash = hashTerm(content);
+        record.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        flagLog.append(record);
+        recentFlags.push({content, std::move(record)});
+        ++flaggedTotal;
+        return true;
+    }
+    
+    return false;
+}
+
+Verdict ContentModerationSystem::checkContent(const std::string& content) const {
+    Verdict verdict;
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        verdict = scoreText(dictionary, content);
+    });
+    return verdict;
+}
+
+PolicyVerdicts ContentModerationSystem::checkPolicies(const std::string& content, PolicyMask policies) const {
+    PolicyVerdicts verdicts;
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        verdicts = dictionary.scorePolicies(content, matchMode, policies, verdictThreshold);
+    });
+    return verdicts;
+}
+
+void ContentModerationSystem::processContent(const std::string& content) {
+    std::cout << "\n====== CONTENT ANALYSIS ======" << std::endl;
+    std::cout << "Content: \"" << content << "\"" << std::endl;
+    
+    bool isFlagged = flagContent(content);
+    
+    if (isFlagged) {
+        const auto& lastFlagged = recentFlags.newest();
+        
+        // Look up the neighbors of every match before printing, so the two are timed apart
+        std::vector<std::vector<Graph::Neighbor>> related;
+        {
+            StageTimer timer(Stage::Expand);
+            for (const auto& match : lastFlagged.record.matches) {
+                related.push_back(termRelationships.topNeighbors(match.termId));
+            }
+        }
+        
+        StageTimer timer(Stage::Output);
+        std::cout << "STATUS: FLAGGED" << std::endl;
+        std::cout << "Flagged terms:" << std::endl;
+        
+        for (size_t i = 0; i < lastFlagged.record.matches.size(); ++i) {
+            const TermMatch& match = lastFlagged.record.matches[i];
+            std::cout << "- \"" << termDictionary.text(match.termId) << "\"";
+            
+            // Show the frequency of this term
+            std::cout << " (Occurrence frequency: " << termStatistics.estimate(match.termId) << ")" << std::endl;
+            
+            // Show related terms
+            const std::vector<Graph::Neighbor>& relatedTerms = related[i];
+            if (!relatedTerms.empty()) {
+                std::cout << "  Related terms: ";
+                for (size_t r = 0; r < relatedTerms.size(); ++r) {
+                    if (r > 0) std::cout << ", ";
+                    std::cout << termDictionary.text(relatedTerms[r].id);
+                }
+                std::cout << std::endl;
+            }
+        }
+    } else {
+        StageTimer timer(Stage::Output);
+        std::cout << "STATUS: APPROVED (No banned words detected)" << std::endl;
+    }
+    
+    std::cout << "=============================" << std::endl;
+}
+
+void ContentModerationSystem::collectFeedback() {
+    std::cout << "\n====== FEEDBACK REQUEST ======" << std::endl;
+    FeedbackEntry entry;
+    if (!recentFlags.empty()) {
+        entry.content = recentFlags.newest().content;
+        entry.contentHash = recentFlags.newest().record.contentHash;
+        std::cout << "Is the flagging correct for: \"" << entry.content << "\"?" << std::endl;
+    } else {
+        // Nothing flagged this session; fall back to the newest entry in the flag log
+        bool found = false;
+        flagLog.forEachNewest([&](const FlagRecord& record) {
+            std::cout << "Is the flagging correct for logged message " << describeFlag(record) << "?" << std::endl;
+            entry.contentHash = record.contentHash;
+            found = true;
+            return false;
+        });
+        if (!found) {
+            std::cout << "No flagged content to review." << std::endl;
+            return;
+        }
+    }
+    std::cout << "1. Yes, correct flagging" << std::endl;
+    std::cout << "2. No, this is a false positive" << std::endl;
+    
+    int choice;
+    std::cin >> choice;
+    std::cin.ignore(); // Clear newline
+    
+    entry.falsePositive = choice == 2;
+    if (!submitFeedback(std::move(entry))) {
+        std::cerr << "Feedback queue is full; please try again." << std::endl;
+    } else if (choice == 2) {
+        std::cout << "Thank you for your feedback. This context will no longer be flagged." << std::endl;
+    } else {
+        std::cout << "Thank you for confirming." << std::endl;
+    }
+}
+
+bool ContentModerationSystem::submitFeedback(FeedbackEntry entry) {
+    if (entry.contentHash == 0) entry.contentHash = hashTerm(entry.content);
+    entry.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!feedbackQueue.push(std::move(entry))) return false;
+    maintenanceSignal.notify_one();
+    return true;
+}
+
+bool ContentModerationSystem::openFeedbackLog(const std::string& filename) {
+    std::vector<std::string> phrases;
+    bool opened = feedbackLog.open(filename, [&](const FeedbackRecord& record) {
+        if (record.falsePositive) phrases.insert(phrases.end(), record.phrases.begin(), record.phrases.end());
+    });
+    if (!phrases.empty()) addAllowPhrases(phrases);
+    return opened;
+}
+
+void ContentModerationSystem::drainFeedback() {
+    std::vector<FeedbackRecord> records;
+    std::vector<std::string> phrases;
+    FeedbackEntry entry;
+    while (feedbackQueue.pop(entry)) {
+        FeedbackRecord record{entry.timestamp, entry.contentHash, entry.falsePositive, {}};
+        if (entry.falsePositive && !entry.content.empty()) {
+            // Matches already inside an allowlisted phrase are not found again, so repeated
+            // reports of one message add nothing
+            withDictionary([&](const DictionaryVersion& dictionary) {
+                std::vector<TermMatch> matches;
+                dictionary.findMatches(entry.content, matchMode, matches);
+                record.phrases = contextPhrases(dictionary, entry.content, matches);
+            });
+            phrases.insert(phrases.end(), record.phrases.begin(), record.phrases.end());
+        }
+        records.push_back(std::move(record));
+    }
+    if (records.empty()) return;
+    
+    if (feedbackLog.isOpen()) feedbackLog.append(records);
+    if (!phrases.empty()) addAllowPhrases(phrases);
+}
+
+std::vector<std::string> ContentModerationSystem::contextPhrases(const DictionaryVersion& dictionary, const std::string& content,
+                                                                 const std::vector<TermMatch>& matches) const {
+    const unsigned char* classes = TextClass::table();
+    auto isSpace = [&](size_t i) { return classes[static_cast<unsigned char>(content[i])] == TextClass::Space; };
+    auto wordStart = [&](size_t i) {
+        while (i > 0 && !isSpace(i - 1)) --i;
+        return i;
+    };
+    auto wordEnd = [&](size_t i) {
+        while (i < content.size() && !isSpace(i)) ++i;
+        return i;
+    };
+    
+    std::vector<std::string> phrases;
+    for (const auto& match : matches) {
+        std::string_view term = dictionary.term(match.termId);
+        size_t start = wordStart(match.offset);
+        size_t end = wordEnd(match.offset + match.length);
+        std::string phrase = normalizeTerm(content.substr(start, end - start));
+        
+        if (phrase == term) {
+            // A whole word or phrase: take in the words on either side
+            while (start > 0 && isSpace(start - 1)) --start;
+            while (end < content.size() && isSpace(end)) ++end;
+            phrase = normalizeTerm(content.substr(wordStart(start), wordEnd(end) - wordStart(start)));
+        }
+        
+        // A message that is nothing but the term has no context to allow
+        if (phrase == term || phrase.size() > MaxPhraseBytes) continue;
+        if (std::find(phrases.begin(), phrases.end(), phrase) == phrases.end()) phrases.push_back(std::move(phrase));
+    }
+    return phrases;
+}
+
+void ContentModerationSystem::addAllowPhrases(const std::vector<std::string>& phrases) {
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        const DictionaryVersion* latest = current.load();
+        std::vector<std::string> added = latest->delta->terms();
+        std::vector<TermInfo> info = latest->delta->info();
+        size_t before = added.size();
+        for (const auto& raw : phrases) {
+            // Phrases read back from the log may have been edited by hand
+            std::string phrase = normalizeTerm(raw);
+            if (phrase.empty() || latest->find(phrase) != TermDictionary::None) continue;
+            uint32_t id = termDictionary.intern(phrase);
+            if (std::find(allowPhraseIds.begin(), allowPhraseIds.end(), id) != allowPhraseIds.end()) continue;
+            allowPhraseIds.push_back(id);
+            added.push_back(phrase);
+            info.push_back(TermInfo());
+        }
+        if (added.size() == before) return;
+        publish(latest->base, freezeTerms(added, info));
+    }
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex);
+        mergePending = true;
+    }
+    maintenanceSignal.notify_one();
+}
+
+std::shared_ptr<const DictionarySnapshot> ContentModerationSystem::allowDelta(const DictionarySnapshot& base) {
+    // A phrase the new list bans outright is no longer allowed
+    allowPhraseIds.erase(std::remove_if(allowPhraseIds.begin(), allowPhraseIds.end(),
+        [&](uint32_t id) { return base.contains(termDictionary.text(id)); }), allowPhraseIds.end());
+    std::vector<std::string> phrases;
+    for (uint32_t id : allowPhraseIds) phrases.emplace_back(termDictionary.text(id));
+    return freezeTerms(phrases, std::vector<TermInfo>(phrases.size()));
+}
+
+void ContentModerationSystem::visualizeTermGraph() {
+    std::cout << "\n====== TERM RELATIONSHIPS ======" << std::endl;
+    
+    for (const auto& entry : termStatistics.topK(TermStatistics::HeavyHitterCapacity)) {
+        termRelationships.visualizeConnections(entry.termId);
+    }
+    
+    std::cout << "===============================" << std::endl;
+}
+
+void ContentModerationSystem::addBannedWord(const std::string& word, const std::string& filename) {
+    std::string lowerWord = normalizeTerm(word);
+    if (lowerWord.empty()) {
+        std::cerr << "Ignoring empty banned word." << std::endl;
+        return;
+    }
+    if (DictionarySnapshot::isCompiledFile(filename)) {
+        std::cerr << "Cannot append to compiled dictionary " << filename << "; edit the text list and recompile." << std::endl;
+        return;
+    }
+    
+    // Only the small delta is rebuilt here; the maintenance thread merges it into the base
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        const DictionaryVersion* latest = current.load();
+        DictionaryVersion::TermRef known = latest->lookup(lowerWord);
+        if (known && !latest->allowed(known.id())) {
+            std::cout << "\"" << lowerWord << "\" is already banned." << std::endl;
+            return;
+        }
+        if (known) {
+            // An allowlisted phrase is a term already: banning it only takes it off the allowlist
+            allowPhraseIds.erase(std::find(allowPhraseIds.begin(), allowPhraseIds.end(), known.id()));
+            publish(latest->base, latest->delta);
+        } else {
+            std::vector<std::string> added = latest->delta->terms();
+            std::vector<TermInfo> info = latest->delta->info();
+            added.push_back(lowerWord);
+            info.push_back(TermInfo());
+            publish(latest->base, freezeTerms(added, info));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(maintenanceMutex);
+        mergePending = true;
+    }
+    maintenanceSignal.notify_one();
+		
+		std::ofstream file(filename, std::ios::app);  // Open file in append mode
+		if (file.is_open()) {
+    file << lowerWord << "\n";
+    file.close();
+    std::cout << "Added \"" << lowerWord << "\" to banned words list." << std::endl;
+		} else {
+    std::cerr << "Error opening file: " << filename << std::endl;
+		}
+    
+    // Our own append is already live, so don't let the file watcher reload it
+    std::lock_guard<std::mutex> lock(maintenanceMutex);
+    if (filename == watchedFile) {
+        std::error_code error;
+        watchedWriteTime = std::filesystem::last_write_time(filename, error);
+    }
+}
+
+void ContentModerationSystem::showStatistics() {
+    std::cout << "\n====== MODERATION STATISTICS ======" << std::endl;
+    std::cout << "Total flagged content: " << flaggedTotal << " (" << recentFlags.size() << " of "
+              << recentFlags.capacity() << " recent kept in memory)" << std::endl;
+    if (flagLog.isOpen()) {
+        auto [segments, bytes] = flagLog.diskUsage();
+        std::cout << "Flag log: " << segments << " segments, " << bytes << " bytes on disk" << std::endl;
+    }
+    std::cout << "Feedback: " << feedbackQueue.acceptedCount() << " received, " << feedbackQueue.refusedCount()
+              << " refused while the queue was full, " << feedbackLog.recordCount() << " in the feedback log" << std::endl;
+    withDictionary([](const DictionaryVersion& dictionary) {
+        std::cout << "Allowlist: " << (dictionary.allow ? dictionary.allow->phraseCount() : 0) << " context phrases" << std::endl;
+    });
+    withDictionary([](const DictionaryVersion& dictionary) {
+        std::cout << "Dictionary: version " << dictionary.number << ", " << dictionary.termCount() << " terms ("
+                  << dictionary.pendingCount() << " pending merge), " << dictionary.memoryBytes()
+                  << " bytes (" << dictionary.bytesPerTerm() << " bytes/term)" << std::endl;
+    });
+    
+    std::cout << "Term dictionary: " << termDictionary.size() << " terms, " << termDictionary.memoryBytes() << " bytes" << std::endl;
+    std::cout << "Term counters: " << termStatistics.memoryBytes() << " bytes" << std::endl;
+    Graph::Stats graph = termRelationships.stats();
+    std::cout << "Term graph: " << graph.edges / 2 << " edges between " << graph.terms << " terms, learned from "
+              << graph.observations << " messages (" << graph.evictions << " evictions), " << graph.bytes << " bytes" << std::endl;
+    if (verdictCache) {
+        VerdictCache::Stats cache;
+        withDictionary([&](const DictionaryVersion& dictionary) { cache = verdictCache->stats(dictionary.number); });
+        std::cout << "Verdict cache: " << cache.entries << " of " << cache.capacity << " entries live, " << cache.bytes
+                  << " bytes, hit ratio " << 100.0 * cache.hitRatio() << "% (" << cache.hits << " hits, "
+                  << cache.nearHits << " near-duplicate, " << cache.misses - cache.nearHits << " misses, "
+                  << cache.evictions << " evictions)" << std::endl;
+    }
+    
+    // The rates are read as of the last advance; bring them up to the flags recorded so far
+    termRates.advance();
+    std::cout << "Top flagged terms (flags in the last 1m / 5m / 1h):" << std::endl;
+    for (const auto& entry : termStatistics.topK(5)) { // Show top 5
+        std::cout << "- \"" << termDictionary.text(entry.termId) << "\": " << entry.count << " times ("
+                  << termRates.rate(entry.termId, TermRates::OneMinute).flags << " / "
+                  << termRates.rate(entry.termId, TermRates::FiveMinutes).flags << " / "
+                  << termRates.rate(entry.termId, TermRates::OneHour).flags << ")" << std::endl;
+    }
+    
+    std::vector<TermRates::Burst> bursts = termRates.bursts(5);
+    std::cout << "Bursting terms:" << (bursts.empty() ? " none" : "") << std::endl;
+    for (const auto& burst : bursts) {
+        std::cout << "- \"" << termDictionary.text(burst.termId) << "\": " << std::fixed << std::setprecision(1) << burst.ratio
+                  << "x its rate over the rest of the hour (" << burst.flags << " in the last minute)" << std::defaultfloat << std::endl;
+    }
+    
+    writeStageTable(std::cout, processMetrics().snapshot());
+    
+    std::cout << "=================================" << std::endl;
+}
+
+MetricsSnapshot ContentModerationSystem::collectMetrics() {
+    MetricsSnapshot snapshot = processMetrics().snapshot();
+    auto gauge = [&](const char* name, const char* help, double value) {
+        snapshot.gauges.push_back({name, help, value});
+    };
+    
+    withDictionary([&](const DictionaryVersion& dictionary) {
+        gauge("moderation_dictionary_terms", "Banned terms in the live dictionary.", static_cast<double>(dictionary.termCount()));
+        gauge("moderation_dictionary_pending_terms", "Terms added since the last merge.", static_cast<double>(dictionary.pendingCount()));
+        gauge("moderation_dictionary_bytes", "Memory held by the live dictionary.", static_cast<double>(dictionary.memoryBytes()));
+        gauge("moderation_dictionary_version", "Number of the live dictionary version.", static_cast<double>(dictionary.number));
+        gauge("moderation_allowlist_phrases", "Context phrases allowlisted from confirmed false positives.",
+              static_cast<double>(dictionary.allow ? dictionary.allow->phraseCount() : 0));
+    });
+    gauge("moderation_feedback_received", "Feedback entries queued.", static_cast<double>(feedbackQueue.acceptedCount()));
+    gauge("moderation_feedback_refused", "Feedback entries refused because the queue was full.", static_cast<double>(feedbackQueue.refusedCount()));
+    gauge("moderation_term_dictionary_terms", "Terms interned by the process.", static_cast<double>(termDictionary.size()));
+    gauge("moderation_term_dictionary_bytes", "Memory held by the term interner.", static_cast<double>(termDictionary.memoryBytes()));
+    gauge("moderation_term_counter_bytes", "Memory held by the term frequency counters.", static_cast<double>(termStatistics.memoryBytes()));
+    Graph::Stats graph = termRelationships.stats();
+    gauge("moderation_term_graph_edges", "Neighbor slots in use in the term graph, counted from both ends.", static_cast<double>(graph.edges));
+    gauge("moderation_term_graph_observations", "Messages with two or more flagged terms the graph learned from.", static_cast<double>(graph.observations));
+    gauge("moderation_term_graph_evictions", "Decayed neighbors replaced by new ones.", static_cast<double>(graph.evictions));
+    gauge("moderation_term_graph_bytes", "Memory held by the term graph.", static_cast<double>(graph.bytes));
+    if (verdictCache) {
+        VerdictCache::Stats cache;
+        withDictionary([&](const DictionaryVersion& dictionary) { cache = verdictCache->stats(dictionary.number); });
+        gauge("moderation_verdict_cache_bytes", "Memory held by the verdict cache.", static_cast<double>(cache.bytes));
+        gauge("moderation_verdict_cache_entries", "Verdict cache entries valid for the live dictionary.", static_cast<double>(cache.entries));
+        gauge("moderation_verdict_cache_hits", "Messages answered from the verdict cache.", static_cast<double>(cache.hits));
+        gauge("moderation_verdict_cache_near_hits", "Cache misses answered by a near-duplicate denial.", static_cast<double>(cache.nearHits));
+        gauge("moderation_verdict_cache_misses", "Messages not found in the verdict cache.", static_cast<double>(cache.misses));
+        gauge("moderation_verdict_cache_hit_ratio", "Share of lookups answered by the verdict cache.", cache.hitRatio());
+    }
+    if (flagLog.isOpen()) {
+        auto [segments, bytes] = flagLog.diskUsage();
+        gauge("moderation_flag_log_segments", "Segment files in the flag log.", static_cast<double>(segments));
+        gauge("moderation_flag_log_bytes", "Bytes of flag log on disk.", static_cast<double>(bytes));
+    }
+    
+    for (const auto& entry : termStatistics.topK(10)) {
+        snapshot.topTerms.emplace_back(termDictionary.text(entry.termId), entry.count);
+    }
+    
+    // Recent rates of the top terms, then of the bursting terms that are not among them
+    termRates.advance();
+    std::vector<TermRates::Burst> bursts = termRates.bursts(10);
+    gauge("moderation_term_rate_bytes", "Memory held by the sliding-window term rates.", static_cast<double>(termRates.memoryBytes()));
+    gauge("moderation_term_rate_untracked_flags", "Flags the term rates had no room to count.", static_cast<double>(termRates.untracked()));
+    gauge("moderation_bursting_terms", "Terms flagged much faster in the last minute than over the rest of the hour.",
+          static_cast<double>(bursts.size()));
+    std::vector<uint32_t> rated;
+    for (const auto& entry : termStatistics.topK(10)) rated.push_back(entry.termId);
+    for (const auto& burst : bursts) {
+        if (std::find(rated.begin(), rated.end(), burst.termId) == rated.end()) rated.push_back(burst.termId);
+    }
+    for (uint32_t termId : rated) {
+        TermRates::Burst burst;
+        bool bursting = termRates.burst(termId, burst);
+        snapshot.termRates.push_back({std::string(termDictionary.text(termId)),
+            {termRates.rate(termId, TermRates::OneMinute).flags, termRates.rate(termId, TermRates::FiveMinutes).flags,
+             termRates.rate(termId, TermRates::OneHour).flags},
+            burst.ratio, bursting});
+    }
+    return snapshot;
+}
+
+void ContentModerationSystem::setMetricsFile(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(maintenanceMutex);
+    metricsFile = filename;
+}
+
+bool ContentModerationSystem::writeMetricsFile(const std::string& filename) {
+    std::string temporary = filename + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        if (!file.is_open()) {
+            reportStatus("Error opening file for writing: " + temporary);
+            return false;
+        }
+        writePrometheus(file, collectMetrics());
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temporary, filename, error);
+    if (error) {
+        reportStatus("Error replacing metrics file: " + filename);
+        return false;
+    }
+    return true;
+}
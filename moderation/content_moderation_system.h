@@ -0,0 +1,267 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "moderation/dictionary_snapshot.h"
+#include "moderation/dictionary_version.h"
+#include "moderation/epoch.h"
+#include "moderation/feedback.h"
+#include "moderation/flag_log.h"
+#include "moderation/graph.h"
+#include "moderation/match_stream.h"
+#include "moderation/metrics.h"
+#include "moderation/policy.h"
+#include "moderation/term_dictionary.h"
+#include "moderation/term_rates.h"
+#include "moderation/term_statistics.h"
+#include "moderation/text.h"
+#include "moderation/verdict_cache.h"
+
+// Content Moderation System class
+class ContentModerationSystem {
+private:
+    // Every term the system knows about, shared by the dictionary, graph, statistics and log
+    TermDictionary termDictionary;
+    
+    // The live dictionary is published RCU-style: readers load the pointer inside an epoch
+    // guard and never lock; writers serialize on updateMutex and retire the old version
+    mutable EpochDomain epochs;
+    std::atomic<const DictionaryVersion*> current{nullptr};
+    std::mutex updateMutex;
+    
+    // Background thread that merges the delta and reloads the watched file
+    std::thread maintenanceThread;
+    std::mutex maintenanceMutex;
+    std::condition_variable maintenanceSignal;
+    bool stopMaintenance = false;
+    bool mergePending = false;
+    std::string watchedFile;
+    std::filesystem::file_time_type watchedWriteTime;
+    std::string metricsFile;
+    
+    MatchMode matchMode = MatchMode::WordBoundary;
+    unsigned maxEdits = 1;
+    uint32_t verdictThreshold = DefaultSeverity;
+    std::ostream* statusOut = &std::cout;
+    std::mutex statusMutex;
+    PolicyRegistry policyRegistry;
+    Graph termRelationships{termDictionary};
+    TermStatistics termStatistics;
+    TermRates termRates;
+    
+    // Recent flags stay in memory for review; the full history lives in the flag log on disk
+    static constexpr size_t RecentFlagCapacity = 256;
+    RecentFlags recentFlags{RecentFlagCapacity};
+    FlagLog flagLog;
+    size_t flaggedTotal = 0;
+    
+    // Results of repeated messages; null unless enabled
+    std::unique_ptr<VerdictCache> verdictCache;
+    
+    // Feedback arrives from any thread through a lock-free queue; the maintenance thread stores it
+    // in the feedback log and turns confirmed false positives into allowlisted context phrases
+    static constexpr size_t MaxPhraseBytes = 128;
+    FeedbackQueue feedbackQueue;
+    FeedbackLog feedbackLog;
+    std::vector<uint32_t> allowPhraseIds; // Guarded by updateMutex
+    
+    // Search for flagged words and phrases in a given text; matches are reported as term ids
+    bool searchFlaggedWords(const std::string& text, FlagRecord& record);
+    
+    // Read a banned words file into a snapshot. A compiled file, or a compiled copy at least as
+    // new as the text file, is mapped; otherwise, or if the copy is unusable, the text is parsed.
+    std::shared_ptr<const DictionarySnapshot> readBannedWords(const std::string& filename);
+    
+    // Freeze terms into a snapshot whose matches report shared term ids
+    std::shared_ptr<const DictionarySnapshot> freezeTerms(const std::vector<std::string>& terms,
+                                                          const std::vector<TermInfo>& info = {});
+    
+    // Publish a new dictionary version and retire the one it replaces; caller holds updateMutex
+    void publish(std::shared_ptr<const DictionarySnapshot> base, std::shared_ptr<const DictionarySnapshot> delta);
+    
+    // Fold the delta into a new base off the scan path; terms added meanwhile stay in the delta
+    void mergeDelta();
+    
+    // Rebuild the dictionary from the watched file and swap it in
+    void reloadWatchedFile();
+    
+    // Delta holding the allowlisted phrases for a new base, so reloads keep the allowlist; a
+    // phrase the base bans leaves the allowlist. Caller holds updateMutex.
+    std::shared_ptr<const DictionarySnapshot> allowDelta(const DictionarySnapshot& base);
+    
+    // Allowlist phrases through the delta, like added banned words
+    void addAllowPhrases(const std::vector<std::string>& phrases);
+    
+    // Context of each match for the allowlist: the word a match sits inside, or a whole-word
+    // match together with the words on either side of it
+    std::vector<std::string> contextPhrases(const DictionaryVersion& dictionary, const std::string& content,
+                                            const std::vector<TermMatch>& matches) const;
+    
+    // Log queued feedback with one sync and allowlist the phrases of its false positives
+    void drainFeedback();
+    
+    // Has the watched file been rewritten since we last read it?
+    bool watchedFileChanged();
+    
+    // Rewrite the metrics file; it is replaced atomically, so scrapers never see half a file.
+    // Only the maintenance thread and the destructor call this.
+    bool writeMetricsFile(const std::string& filename);
+    
+    void maintenanceLoop();
+    
+public:
+    ContentModerationSystem();
+    
+    ~ContentModerationSystem();
+    
+    // Run f with a consistent view of the current dictionary. Lock-free and safe from any
+    // thread; term text obtained from the view is only valid inside f.
+    template <typename F>
+    void withDictionary(F&& f) const {
+        EpochDomain::ReadGuard guard(epochs);
+        f(*current.load());
+    }
+    
+    // Start a text that arrives in pieces against the current dictionary and match mode; the
+    // stream keeps that dictionary version alive until it is begun again or destroyed
+    void beginStream(MatchStream& stream) const {
+        withDictionary([&](const DictionaryVersion& dictionary) { stream.begin(dictionary, matchMode); });
+    }
+    
+    // Reload the given banned words file whenever it changes on disk or SIGHUP arrives
+    void watchBannedWordsFile(const std::string& filename);
+    
+    // Select how content is matched against the dictionary. Selecting token or fuzzy matching
+    // builds the token prefilters, fuzzy matching the skeleton indexes too, and republishes the
+    // dictionary.
+    void setMatchMode(MatchMode mode);
+    
+    // Typos tolerated by fuzzy matching in long words; words under 9 bytes allow at most one
+    void setMaxEdits(unsigned edits);
+    
+    // Send load and save messages somewhere other than stdout, e.g. in batch mode
+    void setStatusStream(std::ostream& stream) {
+        statusOut = &stream;
+    }
+    
+    // Write one status line; the maintenance thread reports reloads too, so writes are serialized
+    void reportStatus(const std::string& line);
+    
+    MatchMode getMatchMode() const {
+        return matchMode;
+    }
+    
+    // Summed severity at which checkContent denies a message
+    void setVerdictThreshold(uint32_t threshold) {
+        verdictThreshold = threshold;
+    }
+    
+    uint32_t getVerdictThreshold() const {
+        return verdictThreshold;
+    }
+    
+    // Thread-safe term counters shared by the interactive and batch paths
+    TermStatistics& statistics() {
+        return termStatistics;
+    }
+    
+    // Flag rates over the last minute, five minutes and hour, and the terms bursting now
+    const TermRates& rates() const {
+        return termRates;
+    }
+    
+    // Find every dictionary match in the text together with its byte offset.
+    // Safe to call from several threads at once: it only reads the dictionary.
+    void findMatches(const std::string& text, std::vector<TermMatch>& matches) const;
+    
+    // Cache the results of repeated messages in about `bytes` of memory. With nearDuplicates,
+    // verdict-only denials also answer messages whose token SimHash differs in a few bits.
+    // Call before moderating starts.
+    void enableVerdictCache(size_t bytes, bool nearDuplicates);
+    
+    // dictionary.findMatches in the selected mode, answered from the verdict cache if possible
+    void findMatches(const DictionaryVersion& dictionary, const std::string& text, std::vector<TermMatch>& matches) const;
+    
+    // dictionary.scoreText in the selected mode against the verdict threshold, through the cache
+    Verdict scoreText(const DictionaryVersion& dictionary, const std::string& text) const;
+    
+    // Write flags to an append-only segment log in `directory` in addition to the in-memory ring
+    bool openFlagLog(const std::string& directory, size_t maxSegmentBytes = FlagLog::DefaultSegmentBytes);
+    
+    // One-line summary of a logged flag: time, message hash and the matched terms
+    std::string describeFlag(const FlagRecord& record) const;
+    
+    // Page through the flag log, newest first, without loading it into memory
+    void showFlagHistory(size_t skip, size_t limit);
+    
+    std::string termText(uint32_t termId) const;
+    
+    const TermDictionary& terms() const {
+        return termDictionary;
+    }
+    
+    // Policy names of the loaded banned word lists
+    const PolicyRegistry& policies() const {
+        return policyRegistry;
+    }
+    
+    // Load banned words from file, text or compiled, keeping any terms loaded before. False,
+    // with the dictionary unchanged, if the file could not be read.
+    bool loadBannedWords(const std::string& filename);
+    
+    // Add relationships between terms
+    void addTermRelationship(const std::string& term1, const std::string& term2);
+    
+    // Count the matches of one message in the term statistics and teach the term graph which
+    // terms were flagged together; called from scanning threads
+    void recordMatches(const std::vector<TermMatch>& matches);
+    
+    // Flag content if it contains banned words
+    bool flagContent(const std::string& content);
+    
+    // Allow or deny content on the severity of its matches, stopping at the threshold. Nothing
+    // is recorded: no statistics, flag log entry or term graph walk. Safe from any thread.
+    Verdict checkContent(const std::string& content) const;
+    
+    // Allow or deny content under each of the given policies in one scan, like checkContent
+    PolicyVerdicts checkPolicies(const std::string& content, PolicyMask policies) const;
+    
+    // Process and analyze content
+    void processContent(const std::string& content);
+    
+    // Ask whether the newest flag was correct and submit the answer
+    void collectFeedback();
+    
+    // Queue feedback on a flagged message without waiting for it to be stored; the time and,
+    // if missing, the hash of the content are filled in. Safe from any thread and lock-free;
+    // false if the queue is full.
+    bool submitFeedback(FeedbackEntry entry);
+    
+    // Store feedback in `filename` and allowlist the false positives already recorded there
+    bool openFeedbackLog(const std::string& filename);
+    
+    // Visualize the graph of term relationships
+    void visualizeTermGraph();
+    
+    // Add a new banned word to the system
+    void addBannedWord(const std::string& word, const std::string& filename);
+    
+    // Show statistics
+    void showStatistics();
+    
+    // Stage latencies and scan counters, plus dictionary, flag log and top-term figures
+    MetricsSnapshot collectMetrics();
+    
+    // Keep a Prometheus text file at `filename` up to date, for a textfile collector to scrape
+    void setMetricsFile(const std::string& filename);
+};
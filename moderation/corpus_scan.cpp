@@ -0,0 +1,266 @@
+#include "moderation/corpus_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "moderation/mapped_file.h"
+#include "moderation/match_stream.h"
+#include "moderation/work_stealing_pool.h"
+
+// Splits a mapped corpus into line-aligned chunks, matches each chunk's lines where they lie in
+// the mapping and writes the results of the chunks in file order
+class CorpusScanner {
+private:
+    ContentModerationSystem& cms;
+    const ScanOptions& options;
+    const MappedFile& file;
+    size_t chunkBytes;
+    
+    std::mutex doneMutex;
+    std::condition_variable doneSignal;
+    std::map<size_t, std::string> done;
+    std::atomic<size_t> messageCount{0};
+    std::atomic<size_t> flaggedMessages{0};
+    
+    // Format the flagged lines of file[begin, end) against a single dictionary version
+    std::string processChunk(size_t begin, size_t end) {
+        std::string out;
+        cms.withDictionary([&](const DictionaryVersion& dictionary) {
+            const MatchMode mode = cms.getMatchMode();
+            std::vector<TermMatch> matches;
+            size_t messages = 0;
+            size_t flagged = 0;
+            
+            const char* data = file.data();
+            size_t position = begin;
+            while (position < end) {
+                const char* newline = static_cast<const char*>(std::memchr(data + position, '\n', end - position));
+                size_t lineEnd = newline ? static_cast<size_t>(newline - data) : end;
+                size_t length = lineEnd - position;
+                if (length > 0 && data[position + length - 1] == '\r') --length;
+                
+                matches.clear();
+                dictionary.findMatches(std::string_view(data + position, length), mode, matches);
+                ++messages;
+                
+                if (!matches.empty()) {
+                    ++flagged;
+                    cms.recordMatches(matches);
+                    StageTimer timer(Stage::Output);
+                    out += options.format == OutputFormat::TSV ? "" : "{\"offset\":";
+                    out += std::to_string(position);
+                    out += options.format == OutputFormat::TSV ? "\t" : ",\"terms\":[";
+                    for (size_t m = 0; m < matches.size(); ++m) {
+                        if (m > 0) out.push_back(',');
+                        out += std::to_string(matches[m].termId);
+                    }
+                    if (options.format == OutputFormat::JSONL) out += "]}";
+                    out.push_back('\n');
+                }
+                position = lineEnd + 1;
+            }
+            
+            messageCount.fetch_add(messages, std::memory_order_relaxed);
+            flaggedMessages.fetch_add(flagged, std::memory_order_relaxed);
+        });
+        
+        // The scan never comes back to these pages, so don't let them crowd out the rest of the cache
+        file.release(begin, end - begin);
+        return out;
+    }
+    
+    // End of the chunk starting at begin: chunkBytes on, then up to and including the next newline
+    size_t chunkEnd(size_t begin) const {
+        size_t end = begin + chunkBytes;
+        if (end >= file.size()) return file.size();
+        const char* newline = static_cast<const char*>(std::memchr(file.data() + end, '\n', file.size() - end));
+        return newline ? static_cast<size_t>(newline - file.data()) + 1 : file.size();
+    }
+
+public:
+    CorpusScanner(ContentModerationSystem& cms, const ScanOptions& options, const MappedFile& file)
+        : cms(cms), options(options), file(file) {
+        // Small files still get a few chunks per thread; large ones stay at the configured size
+        const size_t minChunk = 64u << 10;
+        chunkBytes = std::max(minChunk, std::min(options.chunkBytes, file.size() / (options.threads * 4)));
+    }
+    
+    // Scan the whole file into output, reporting progress to status about once a second
+    void run(std::ostream& output, std::ostream& status) {
+        WorkStealingPool pool(options.threads);
+        const size_t maxInFlight = pool.size() * 2; // Bounds the output held for the writer
+        size_t submitted = 0;
+        size_t written = 0;
+        size_t scanned = 0;                         // Bytes of the chunks written so far
+        std::vector<size_t> chunkSizes;
+        
+        auto start = std::chrono::steady_clock::now();
+        auto lastReport = start;
+        auto report = [&] {
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastReport < std::chrono::seconds(1)) return;
+            lastReport = now;
+            double seconds = std::chrono::duration<double>(now - start).count();
+            double megabytes = static_cast<double>(scanned) / (1 << 20);
+            status << "Scanned " << std::fixed << std::setprecision(0) << megabytes << " MB ("
+                   << std::setprecision(1) << 100.0 * static_cast<double>(scanned) / static_cast<double>(file.size())
+                   << "%) at " << std::setprecision(0) << megabytes / seconds << " MB/s, "
+                   << flaggedMessages.load() << " flagged" << std::defaultfloat << std::endl;
+        };
+        
+        auto flushReady = [&](bool block) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            if (block) doneSignal.wait(lock, [&] { return done.count(written) > 0; });
+            while (true) {
+                auto it = done.find(written);
+                if (it == done.end()) break;
+                std::string text = std::move(it->second);
+                done.erase(it);
+                lock.unlock();
+                output.write(text.data(), static_cast<std::streamsize>(text.size()));
+                scanned += chunkSizes[written];
+                lock.lock();
+                ++written;
+            }
+            lock.unlock();
+            report();
+        };
+        
+        for (size_t begin = 0; begin < file.size();) {
+            size_t end = chunkEnd(begin);
+            size_t sequence = submitted++;
+            chunkSizes.push_back(end - begin);
+            pool.submit([this, begin, end, sequence] {
+                std::string text = processChunk(begin, end);
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    done.emplace(sequence, std::move(text));
+                }
+                doneSignal.notify_all();
+            });
+            begin = end;
+            
+            flushReady(false);
+            while (submitted - written >= maxInFlight) flushReady(true);
+        }
+        
+        while (written < submitted) flushReady(true);
+        output.flush();
+    }
+    
+    size_t messages() const { return messageCount.load(); }
+    size_t flaggedCount() const { return flaggedMessages.load(); }
+};
+
+int runScan(ContentModerationSystem& cms, const ScanOptions& options) {
+    std::ios::sync_with_stdio(false);
+    cms.setStatusStream(std::cerr);
+    if (options.inputFile.empty()) {
+        std::cerr << "scan needs an input file" << std::endl;
+        return 1;
+    }
+    if (!std::ifstream(options.bannedWordsFile).good()) {
+        createSampleBannedWordsFile(options.bannedWordsFile, std::cerr);
+    }
+    if (!cms.loadBannedWords(options.bannedWordsFile)) return 1;
+    
+    MappedFile file;
+    if (!file.open(options.inputFile)) {
+        std::cerr << "Error opening file: " << options.inputFile << std::endl;
+        return 1;
+    }
+    file.adviseSequential();
+    
+    auto start = std::chrono::steady_clock::now();
+    CorpusScanner scanner(cms, options, file);
+    scanner.run(std::cout, std::cerr);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::ostringstream summary;
+    summary << "Scanned " << scanner.messages() << " messages (" << scanner.flaggedCount() << " flagged, "
+            << file.size() << " bytes) in " << seconds << "s using " << options.threads << " threads, "
+            << static_cast<double>(file.size()) / (1 << 20) / seconds << " MB/s";
+    cms.reportStatus(summary.str());
+    
+    summary.str("");
+    summary << "Top flagged terms:";
+    for (const auto& entry : cms.statistics().topK(5)) {
+        summary << " " << cms.termText(entry.termId) << " (" << entry.count << ")";
+    }
+    cms.reportStatus(summary.str());
+    return 0;
+}
+
+int runStream(ContentModerationSystem& cms, const ScanOptions& options) {
+    std::ios::sync_with_stdio(false);
+    cms.setStatusStream(std::cerr);
+    if (!std::ifstream(options.bannedWordsFile).good()) {
+        createSampleBannedWordsFile(options.bannedWordsFile, std::cerr);
+    }
+    if (!cms.loadBannedWords(options.bannedWordsFile)) return 1;
+    
+    std::ifstream file;
+    bool fromStdin = options.inputFile.empty() || options.inputFile == "-";
+    if (!fromStdin) {
+        file.open(options.inputFile, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error opening file: " << options.inputFile << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = fromStdin ? std::cin : file;
+    
+    MatchStream stream;
+    cms.beginStream(stream);
+    std::vector<char> buffer(std::max<size_t>(1, options.chunkBytes));
+    std::vector<TermMatch> matches;
+    std::string out;
+    
+    auto write = [&] {
+        if (matches.empty()) return;
+        cms.recordMatches(matches);
+        StageTimer timer(Stage::Output);
+        out.clear();
+        for (const auto& match : matches) {
+            if (options.format == OutputFormat::TSV) {
+                out += std::to_string(match.offset) + "\t" + std::to_string(match.length) + "\t"
+                     + std::to_string(match.termId) + "\n";
+            } else {
+                out += "{\"offset\":" + std::to_string(match.offset) + ",\"length\":" + std::to_string(match.length)
+                     + ",\"term\":" + std::to_string(match.termId) + "}\n";
+            }
+        }
+        std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+        matches.clear();
+    };
+    
+    auto start = std::chrono::steady_clock::now();
+    while (input) {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        size_t got = static_cast<size_t>(input.gcount());
+        if (got == 0) break;
+        stream.feed(std::string_view(buffer.data(), got), matches);
+        write();
+    }
+    stream.finish(matches);
+    write();
+    std::cout.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::ostringstream summary;
+    summary << "Streamed " << stream.bytesFed() << " bytes in chunks of " << buffer.size() << " ("
+            << stream.matches() << " matches) in " << seconds << "s, "
+            << static_cast<double>(stream.bytesFed()) / (1 << 20) / seconds << " MB/s";
+    cms.reportStatus(summary.str());
+    return 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "moderation/batch.h"
+#include "moderation/content_moderation_system.h"
+
+// Settings for re-moderating a stored corpus of newline-delimited messages
+struct ScanOptions {
+    std::string inputFile;
+    std::string bannedWordsFile = "banned_words.txt";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkBytes = 16u << 20;                  // Input per work item, extended to the next newline
+    OutputFormat format = OutputFormat::JSONL;
+};
+
+// Entry point for `scan`: map the input file, match every line in place across the pool and
+// write one record per flagged message, its byte offset in the file and the ids of the terms
+// found. Progress and the summary go to stderr.
+int runScan(ContentModerationSystem& cms, const ScanOptions& options);
+
+// Entry point for `stream`: match the input file, or stdin, as one text read chunkBytes at a time
+// through a MatchStream, and write one record per match with its byte offset and length in the
+// whole input. Memory stays constant however large the input is.
+int runStream(ContentModerationSystem& cms, const ScanOptions& options);
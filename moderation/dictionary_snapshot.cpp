@@ -0,0 +1,374 @@
+#include "moderation/dictionary_snapshot.h"
+
+#include <fstream>
+#include <iostream>
+
+DictionarySnapshot::DictionarySnapshot(const std::vector<std::string>& input, const std::vector<uint32_t>& globalIds,
+                                       const std::vector<TermInfo>& info) {
+    // Drop empty and duplicate entries, keeping the first occurrence of each term
+    std::vector<int> sorted;
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (!input[i].empty()) sorted.push_back(static_cast<int>(i));
+    }
+    std::sort(sorted.begin(), sorted.end(), [&](int a, int b) {
+        return input[a] != input[b] ? input[a] < input[b] : a < b;
+    });
+    
+    std::vector<bool> keep(input.size(), false);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        if (i == 0 || input[sorted[i]] != input[sorted[i - 1]]) keep[sorted[i]] = true;
+    }
+    sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [&](int i) { return !keep[i]; }), sorted.end());
+    
+    std::vector<int> ids(input.size(), None);
+    std::vector<uint32_t> offsets(1, 0);
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (!keep[i]) continue;
+        ids[i] = static_cast<int>(offsets.size()) - 1;
+        offsets.push_back(offsets.back() + static_cast<uint32_t>(input[i].size()));
+        longestTerm = std::max(longestTerm, input[i].size());
+    }
+    termTotal = offsets.size() - 1;
+    
+    // Lay out the Trie in BFS order straight from sorted ranges: node i covers the terms
+    // sorted[lo, hi) that share its prefix, and children are the runs of equal next bytes
+    struct Range { int lo, hi, depth; };
+    std::vector<Range> ranges;
+    std::vector<Node> nodeList(1);
+    std::vector<int> terminal;
+    std::vector<unsigned char> labelList;
+    std::vector<int> targetList;
+    std::vector<std::pair<unsigned char, Range>> children;
+    ranges.push_back({0, static_cast<int>(sorted.size()), 0});
+    
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        Range range = ranges[i];
+        terminal.push_back(None);
+        if (range.lo < range.hi && static_cast<int>(input[sorted[range.lo]].size()) == range.depth) {
+            terminal[i] = ids[sorted[range.lo]];
+            ++range.lo;
+        }
+        
+        children.clear();
+        for (int lo = range.lo; lo < range.hi;) {
+            unsigned char c = static_cast<unsigned char>(input[sorted[lo]][range.depth]);
+            int hi = lo + 1;
+            while (hi < range.hi && static_cast<unsigned char>(input[sorted[hi]][range.depth]) == c) ++hi;
+            children.push_back({c, {lo, hi, range.depth + 1}});
+            lo = hi;
+        }
+        
+        // The root always gets a full dense block so the first byte of a word is a single load
+        if (children.empty() && i > 0) continue;
+        Node& node = nodeList[i];
+        node.edgeBegin = static_cast<int>(labelList.size());
+        node.low = (i == 0) ? 0 : children.front().first;
+        node.high = (i == 0) ? 255 : children.back().first;
+        int span = node.high - node.low + 1;
+        bool dense = (i == 0) || span <= 2 * static_cast<int>(children.size());
+        node.edgeCount = static_cast<unsigned short>(dense ? span : static_cast<int>(children.size()));
+        if (dense) {
+            for (int c = node.low; c <= node.high; ++c) labelList.push_back(static_cast<unsigned char>(c));
+            targetList.resize(labelList.size(), None);
+        }
+        
+        for (const auto& [c, childRange] : children) {
+            int index = static_cast<int>(ranges.size());
+            if (dense) {
+                targetList[nodeList[i].edgeBegin + (c - nodeList[i].low)] = index;
+            } else {
+                labelList.push_back(c);
+                targetList.push_back(index);
+            }
+            ranges.push_back(childRange);
+            nodeList.push_back(Node());
+        }
+    }
+    
+    nodeCount = nodeList.size();
+    edgeSlots = labelList.size();
+    allocate(offsets.back());
+    std::copy(nodeList.begin(), nodeList.end(), nodes);
+    std::fill(links, links + nodeCount, Links());
+    std::copy(terminal.begin(), terminal.end(), nodeTerms);
+    std::copy(targetList.begin(), targetList.end(), targets);
+    std::copy(labelList.begin(), labelList.end(), labels);
+    std::copy(offsets.begin(), offsets.end(), termOffsets);
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (!keep[i]) continue;
+        termIds[ids[i]] = globalIds.empty() ? static_cast<uint32_t>(ids[i]) : globalIds[i];
+        termPolicies[ids[i]] = 0;
+        std::copy(input[i].begin(), input[i].end(), termChars + termOffsets[ids[i]]);
+    }
+    
+    // Duplicates were dropped above; their settings are folded into the term they repeat
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (input[i].empty()) continue;
+        int local = keep[i] ? ids[i] : find(input[i]);
+        TermInfo settings = info.empty() ? TermInfo() : info[i];
+        if (keep[i]) termSeverities[local] = settings.severity;
+        termPolicies[local] |= settings.policies;
+    }
+    
+    // Failure and output links, computed in BFS order so they always point backwards
+    for (size_t i = 0; i < nodeCount; ++i) {
+        Node& node = nodes[i];
+        Links& link = links[i];
+        if (i > 0) {
+            link.nextOutput = links[link.fail].output;
+            link.nextWordOutput = (node.wordFail != None) ? nodes[node.wordFail].wordOutput : None;
+        }
+        link.output = (nodeTerms[i] != None) ? static_cast<int>(i) : link.nextOutput;
+        node.wordOutput = (nodeTerms[i] != None) ? static_cast<int>(i) : link.nextWordOutput;
+        
+        for (int e = node.edgeBegin; e < node.edgeBegin + node.edgeCount; ++e) {
+            int target = targets[e];
+            if (target == None) continue;
+            unsigned char c = labels[e];
+            
+            if (i == 0) {
+                links[target].fail = 0;
+                nodes[target].wordFail = (c == TextClass::Space) ? 0 : None;
+                continue;
+            }
+            
+            links[target].fail = step(link.fail, c);
+            
+            // Extend the anchored suffixes of the parent, falling back to the empty one after a space
+            int anchored = None;
+            for (int s = node.wordFail; s != None && anchored == None; s = (s == 0) ? None : nodes[s].wordFail) {
+                anchored = child(s, c);
+            }
+            if (anchored == None && c == TextClass::Space) anchored = 0;
+            nodes[target].wordFail = anchored;
+        }
+    }
+}
+
+int DictionarySnapshot::findWithin(std::string_view word, unsigned maxEdits, size_t anchored, unsigned* distance) const {
+    int exact = find(word);
+    if (distance) *distance = 0;
+    if (exact != None || maxEdits == 0 || word.size() > MaxFuzzyLength) return exact;
+    
+    // rows[d * width + j] holds the edits between the d bytes on the path to the node and
+    // word[0, j), capped at far. Only the band |d - j| <= maxEdits is ever written; the rest
+    // stays far, so each node costs 2 * maxEdits + 1 cells. Branching only happens while edits
+    // remain; after the last one the walk is an exact descent.
+    const size_t n = word.size();
+    const size_t width = n + 1;
+    const size_t maxDepth = n + maxEdits;
+    const unsigned far = std::min(maxEdits + 1, 255u);
+    const unsigned anchoredEdits = maxEdits / 2;
+    auto limit = [&](size_t j, unsigned value) { return (j < anchored && value > anchoredEdits) ? far : value; };
+    static thread_local std::vector<unsigned char> rows;
+    rows.assign((maxDepth + 1) * width, static_cast<unsigned char>(far));
+    for (size_t j = 0; j <= std::min<size_t>(n, maxEdits); ++j) rows[j] = static_cast<unsigned char>(limit(j, static_cast<unsigned>(j)));
+    
+    // Fill in the row of a node at depth d reached over `label`, or over a byte that matches
+    // nothing when label is -1, and return its smallest cell
+    auto fillRow = [&](size_t d, int label) {
+        const unsigned char* above = &rows[(d - 1) * width];
+        unsigned char* row = &rows[d * width];
+        const size_t lo = d > maxEdits ? d - maxEdits : 0;
+        const size_t hi = std::min(n, d + maxEdits);
+        unsigned rowMin = far;
+        if (lo == 0) {
+            row[0] = static_cast<unsigned char>(limit(0, static_cast<unsigned>(std::min<size_t>(d, far))));
+            rowMin = row[0];
+        }
+        for (size_t j = std::max<size_t>(lo, 1); j <= hi; ++j) {
+            unsigned substitute = above[j - 1] + (static_cast<unsigned char>(word[j - 1]) != label ? 1u : 0u);
+            unsigned value = limit(j, std::min({substitute, above[j] + 1u, row[j - 1] + 1u, far}));
+            row[j] = static_cast<unsigned char>(value);
+            rowMin = std::min(rowMin, value);
+        }
+        return rowMin;
+    };
+    
+    // Depth-first, so the row of a node's parent is still in place when the node is visited
+    struct Visit {
+        int node;
+        size_t depth;
+        unsigned char label;
+    };
+    static thread_local std::vector<Visit> pending;
+    pending.clear();
+    int best = None;
+    unsigned bound = far; // Only distances below the best so far are still interesting
+    
+    // Queue the children of a node at depth d. Unless a child over a byte that matches nothing
+    // would still be under the bound, only children over a byte of the band can be, and those
+    // few are looked up directly instead of scanning every edge.
+    auto pushChildren = [&](int state, size_t d) {
+        if (fillRow(d + 1, -1) < bound) {
+            const Node& node = nodes[state];
+            for (int e = node.edgeBegin + node.edgeCount - 1; e >= node.edgeBegin; --e) {
+                if (targets[e] != None) pending.push_back({targets[e], d + 1, labels[e]});
+            }
+            return;
+        }
+        
+        const size_t lo = std::max<size_t>(d + 1 > maxEdits ? d + 1 - maxEdits : 0, 1);
+        const size_t hi = std::min(n, d + 1 + maxEdits);
+        for (size_t j = hi; j >= lo; --j) {
+            unsigned char c = static_cast<unsigned char>(word[j - 1]);
+            if (word.substr(j, hi - j).find(static_cast<char>(c)) != std::string_view::npos) continue;
+            int next = child(state, c);
+            if (next != None) pending.push_back({next, d + 1, c});
+        }
+    };
+    
+    pushChildren(0, 0);
+    while (!pending.empty()) {
+        Visit visit = pending.back();
+        pending.pop_back();
+        const size_t d = visit.depth;
+        unsigned rowMin = fillRow(d, visit.label);
+        const unsigned char* row = &rows[d * width];
+        
+        if (nodeTerms[visit.node] != None && row[n] < bound) {
+            best = nodeTerms[visit.node];
+            bound = row[n];
+        }
+        if (rowMin >= bound || d == maxDepth) continue;
+        
+        if (rowMin + 1 < bound) {
+            pushChildren(visit.node, d);
+            continue;
+        }
+        
+        // No edit left to spend: below this node the path has to spell out the rest of the word
+        // from one of the cheapest cells, so follow those bytes directly instead of branching
+        for (size_t j = d > maxEdits ? d - maxEdits : 0; j < n && rowMin < bound; ++j) {
+            if (row[j] != rowMin) continue;
+            int state = visit.node;
+            for (size_t i = j; i < n && state != None; ++i) state = child(state, static_cast<unsigned char>(word[i]));
+            if (state != None && nodeTerms[state] != None) {
+                best = nodeTerms[state];
+                bound = rowMin;
+            }
+        }
+    }
+    if (distance) *distance = bound;
+    return best;
+}
+
+bool DictionarySnapshot::save(const std::string& filename, const std::vector<std::string>& policyNames) const {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file for writing: " << filename << std::endl;
+        return false;
+    }
+    
+    FileHeader header{};
+    std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+    header.formatVersion = FormatVersion;
+    header.byteOrder = ByteOrderMark;
+    header.nodeBytes = sizeof(Node);
+    header.linkBytes = sizeof(Links);
+    header.nodeCount = nodeCount;
+    header.edgeSlots = edgeSlots;
+    header.termTotal = termTotal;
+    header.termBytes = termOffsets[termTotal];
+    header.arenaWords = arenaWords();
+    
+    // Policy bits only mean something next to their names, so the names travel with the masks
+    std::string names;
+    for (const auto& name : policyNames) names += name + "\n";
+    std::vector<uint64_t> nameWords((names.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    std::memcpy(nameWords.data(), names.data(), names.size());
+    header.policyBytes = names.size();
+    header.checksum = checksum(arenaBegin(), arenaWords()) ^ checksum(nameWords.data(), nameWords.size());
+    
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(arenaBegin()), static_cast<std::streamsize>(arenaWords() * sizeof(uint64_t)));
+    file.write(reinterpret_cast<const char*>(nameWords.data()), static_cast<std::streamsize>(nameWords.size() * sizeof(uint64_t)));
+    if (!file) {
+        std::cerr << "Error writing file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const DictionarySnapshot> DictionarySnapshot::load(const std::string& filename,
+                                                                   const std::function<uint32_t(std::string_view)>& intern,
+                                                                   const std::function<int(std::string_view)>& internPolicy) {
+    auto mapping = std::make_unique<MappedFile>();
+    if (!mapping->open(filename)) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return nullptr;
+    }
+    
+    // A file cut short is damaged, not from another build: recompiling the binary would not help
+    FileHeader header{};
+    if (mapping->size() < sizeof(header)) {
+        std::cerr << "Compiled dictionary " << filename << " is truncated (" << mapping->size()
+                  << " bytes, shorter than its header); recompile it from the text list." << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0) {
+        std::cerr << "Compiled dictionary " << filename << " is damaged (bad magic); recompile it from the text list." << std::endl;
+        return nullptr;
+    }
+    if (header.formatVersion != FormatVersion || header.byteOrder != ByteOrderMark ||
+        header.nodeBytes != sizeof(Node) || header.linkBytes != sizeof(Links)) {
+        std::cerr << "Compiled dictionary " << filename << " is from an incompatible build; recompile it." << std::endl;
+        return nullptr;
+    }
+    
+    std::shared_ptr<DictionarySnapshot> snapshot(new DictionarySnapshot(MappedTag()));
+    size_t limit = mapping->size();
+    bool sane = header.nodeCount > 0 && header.nodeCount <= limit && header.edgeSlots <= limit &&
+                header.termTotal <= limit && header.termBytes <= limit && header.policyBytes <= limit;
+    size_t nameWords = (header.policyBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    if (sane) {
+        snapshot->nodeCount = header.nodeCount;
+        snapshot->edgeSlots = header.edgeSlots;
+        snapshot->termTotal = header.termTotal;
+        size_t words = snapshot->layout(nullptr, header.termBytes);
+        sane = words == header.arenaWords && limit == sizeof(header) + (words + nameWords) * sizeof(uint64_t);
+    }
+    const uint64_t* base = reinterpret_cast<const uint64_t*>(mapping->data() + sizeof(header));
+    if (!sane || (checksum(base, header.arenaWords) ^ checksum(base + header.arenaWords, nameWords)) != header.checksum) {
+        std::cerr << "Compiled dictionary " << filename << " is damaged (size or checksum mismatch)." << std::endl;
+        return nullptr;
+    }
+    
+    // The mapping is never written; only the term id section is replaced by a private copy
+    snapshot->layout(const_cast<uint64_t*>(base), header.termBytes);
+    snapshot->mappedTermIds.resize(snapshot->termTotal);
+    for (size_t i = 0; i < snapshot->termTotal; ++i) {
+        std::string_view term = snapshot->term(static_cast<int>(i));
+        snapshot->mappedTermIds[i] = intern(term);
+        snapshot->longestTerm = std::max(snapshot->longestTerm, term.size());
+    }
+    snapshot->termIds = snapshot->mappedTermIds.data();
+    
+    // Policy masks are used as mapped unless this process gave the file's policies other bits
+    std::string_view names(reinterpret_cast<const char*>(base + header.arenaWords), header.policyBytes);
+    std::vector<int> bits;
+    bool renumbered = false;
+    for (size_t start = 0; start < names.size() && bits.size() < PolicyRegistry::MaxPolicies;) {
+        size_t end = names.find('\n', start);
+        if (end == std::string_view::npos) end = names.size();
+        bits.push_back(internPolicy(names.substr(start, end - start)));
+        renumbered |= bits.back() != static_cast<int>(bits.size() - 1);
+        start = end + 1;
+    }
+    if (renumbered) {
+        snapshot->mappedPolicies.resize(snapshot->termTotal);
+        for (size_t i = 0; i < snapshot->termTotal; ++i) {
+            PolicyMask mask = snapshot->termPolicies[i];
+            PolicyMask translated = 0;
+            for (size_t bit = 0; bit < bits.size(); ++bit) {
+                if ((mask >> bit & 1) && bits[bit] != PolicyRegistry::None) translated |= PolicyMask(1) << bits[bit];
+            }
+            snapshot->mappedPolicies[i] = mask == AllPolicies ? AllPolicies : translated;
+        }
+        snapshot->termPolicies = snapshot->mappedPolicies.data();
+    }
+    snapshot->mappedWords = header.arenaWords;
+    snapshot->mapping = std::move(mapping);
+    return snapshot;
+}
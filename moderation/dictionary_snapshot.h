@@ -0,0 +1,466 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/mapped_file.h"
+#include "moderation/text.h"
+
+// Immutable dictionary snapshot: the Trie, its Aho-Corasick links and the term strings,
+// frozen into flat arrays that all live in one arena
+class DictionarySnapshot {
+public:
+    static constexpr int None = -1;
+
+private:
+    // Packed per-node record; edges live in labels/targets[edgeBegin, edgeBegin + edgeCount).
+    // When edgeCount covers the whole [low, high] label range the block is dense and indexed
+    // directly by (c - low), with None in the holes.
+    struct Node {
+        int edgeBegin = 0;
+        unsigned short edgeCount = 0;
+        unsigned char low = 255;
+        unsigned char high = 0;
+        int wordFail = None;   // Longest proper suffix that starts right after a space
+        int wordOutput = None; // Nearest terminal node on the word-anchored fail chain
+    };
+    
+    // Links only needed for substring matching and for walking output chains
+    struct Links {
+        int fail = 0;
+        int output = None;     // Nearest terminal node on the fail chain, including the node itself
+        int nextOutput = None; // Next terminal node further down the fail chain
+        int nextWordOutput = None;
+    };
+    
+    // Header of a compiled dictionary file; the arena follows it word for word
+    struct FileHeader {
+        char magic[8];
+        uint32_t formatVersion;
+        uint32_t byteOrder; // ByteOrderMark as written, to reject files from other platforms
+        uint32_t nodeBytes; // sizeof(Node) and sizeof(Links) of the writing build
+        uint32_t linkBytes;
+        uint64_t nodeCount;
+        uint64_t edgeSlots;
+        uint64_t termTotal;
+        uint64_t termBytes;
+        uint64_t arenaWords;
+        uint64_t policyBytes; // Policy names, one per line in bit order, after the arena
+        uint64_t checksum;
+    };
+    
+    static constexpr char FileMagic[8] = {'C', 'M', 'S', 'D', 'I', 'C', 'T', '1'};
+    static constexpr uint32_t FormatVersion = 4;   // 2: terms are case folded beyond ASCII; 3: severities; 4: policies
+    static constexpr uint32_t ByteOrderMark = 0x01020304;
+    
+    struct MappedTag {};
+    
+    std::vector<uint64_t> arena;
+    
+    // Used instead of the arena when the snapshot is mapped from a compiled file. The mapped
+    // pages are read-only and shared between processes, so shared term ids live in a private
+    // array, as do the policy masks when the process numbers the file's policies differently.
+    std::unique_ptr<MappedFile> mapping;
+    std::vector<uint32_t> mappedTermIds;
+    std::vector<PolicyMask> mappedPolicies;
+    size_t mappedWords = 0;
+    
+    Node* nodes = nullptr;
+    Links* links = nullptr;
+    int* nodeTerms = nullptr; // Local term index of terminal nodes, None elsewhere
+    int* targets = nullptr;
+    uint32_t* termIds = nullptr; // Shared TermDictionary id of each local term
+    uint16_t* termSeverities = nullptr; // Score each local term adds to a verdict
+    PolicyMask* termPolicies = nullptr; // Policies each local term belongs to
+    uint32_t* termOffsets = nullptr;
+    unsigned char* labels = nullptr;
+    char* termChars = nullptr;
+    size_t nodeCount = 0;
+    size_t edgeSlots = 0;
+    size_t termTotal = 0;
+    size_t longestTerm = 0;
+    
+    int child(int state, unsigned char c) const {
+        const Node& node = nodes[state];
+        if (c < node.low || c > node.high) return None;
+        if (node.edgeCount == node.high - node.low + 1) return targets[node.edgeBegin + (c - node.low)];
+        
+        const unsigned char* first = labels + node.edgeBegin;
+        const unsigned char* last = first + node.edgeCount;
+        const unsigned char* it = std::lower_bound(first, last, c);
+        return (it != last && *it == c) ? targets[it - labels] : None;
+    }
+    
+    int step(int state, unsigned char c) const {
+        while (true) {
+            int next = child(state, c);
+            if (next != None) return next;
+            if (state == 0) return 0;
+            state = links[state].fail;
+        }
+    }
+    
+    // Advance the word-anchored automaton; None means the current word cannot start a match
+    int wordStep(int state, unsigned char c) const {
+        while (true) {
+            int next = child(state, c);
+            if (next != None) return next;
+            state = (state == 0) ? None : nodes[state].wordFail;
+            if (state == None) return (c == TextClass::Space) ? 0 : None;
+        }
+    }
+    
+    // Raw offset of the first byte of a match that ends at raw index end, found by walking
+    // back over the normalized bytes it covers
+    size_t matchStart(const unsigned char* data, size_t end, int local) const {
+        const unsigned char* classes = TextClass::table();
+        size_t remaining = term(local).size();
+        size_t i = end + 1;
+        
+        while (remaining > 0) {
+            unsigned char c = classes[data[--i]];
+            if (c == TextClass::Skip) continue;
+            if (c == TextClass::Space) {
+                // Only the first byte of a whitespace run is fed to the automaton
+                while (i > 0 && (classes[data[i - 1]] == TextClass::Space || classes[data[i - 1]] == TextClass::Skip)) --i;
+            }
+            --remaining;
+        }
+        return i;
+    }
+    
+    // Carve the arena at `base` into its sections and return its size in words; sizes are
+    // rounded so every section stays aligned. With a null base only the size is computed.
+    size_t layout(uint64_t* base, size_t termBytes) {
+        auto words = [](size_t bytes) { return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t); };
+        size_t nodeWords = words(nodeCount * sizeof(Node));
+        size_t linkWords = words(nodeCount * sizeof(Links));
+        size_t nodeTermWords = words(nodeCount * sizeof(int));
+        size_t targetWords = words(edgeSlots * sizeof(int));
+        size_t idWords = words(termTotal * sizeof(uint32_t));
+        size_t policyWords = words(termTotal * sizeof(PolicyMask));
+        size_t severityWords = words(termTotal * sizeof(uint16_t));
+        size_t offsetWords = words((termTotal + 1) * sizeof(uint32_t));
+        size_t labelWords = words(edgeSlots);
+        size_t charWords = words(termBytes);
+        
+        size_t total = nodeWords + linkWords + nodeTermWords + targetWords + idWords + policyWords + severityWords
+                     + offsetWords + labelWords + charWords;
+        if (!base) return total;
+        
+        uint64_t* cursor = base;
+        nodes = reinterpret_cast<Node*>(cursor);
+        cursor += nodeWords;
+        links = reinterpret_cast<Links*>(cursor);
+        cursor += linkWords;
+        nodeTerms = reinterpret_cast<int*>(cursor);
+        cursor += nodeTermWords;
+        targets = reinterpret_cast<int*>(cursor);
+        cursor += targetWords;
+        termIds = reinterpret_cast<uint32_t*>(cursor);
+        cursor += idWords;
+        termPolicies = reinterpret_cast<PolicyMask*>(cursor);
+        cursor += policyWords;
+        termSeverities = reinterpret_cast<uint16_t*>(cursor);
+        cursor += severityWords;
+        termOffsets = reinterpret_cast<uint32_t*>(cursor);
+        cursor += offsetWords;
+        labels = reinterpret_cast<unsigned char*>(cursor);
+        cursor += labelWords;
+        termChars = reinterpret_cast<char*>(cursor);
+        return total;
+    }
+    
+    void allocate(size_t termBytes) {
+        arena.assign(layout(nullptr, termBytes), 0);
+        layout(arena.data(), termBytes);
+    }
+    
+    const uint64_t* arenaBegin() const {
+        return mapping ? reinterpret_cast<const uint64_t*>(mapping->data() + sizeof(FileHeader)) : arena.data();
+    }
+    
+    size_t arenaWords() const {
+        return mapping ? mappedWords : arena.size();
+    }
+    
+    // Word-at-a-time checksum over four independent lanes so it runs at memory speed
+    static uint64_t checksum(const uint64_t* words, size_t count) {
+        const uint64_t prime = 0x100000001b3ull;
+        uint64_t lanes[4] = {0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, count};
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            for (size_t lane = 0; lane < 4; ++lane) lanes[lane] = (lanes[lane] ^ words[i + lane]) * prime;
+        }
+        for (; i < count; ++i) lanes[0] = (lanes[0] ^ words[i]) * prime;
+        
+        uint64_t hash = 0;
+        for (uint64_t lane : lanes) hash = (hash ^ lane ^ (lane >> 29)) * prime;
+        return hash;
+    }
+    
+    explicit DictionarySnapshot(MappedTag) {}
+
+public:
+    DictionarySnapshot() : DictionarySnapshot(std::vector<std::string>()) {}
+    
+    // Freeze a list of normalized terms. Local indexes follow the order of first appearance, and
+    // matches report globalIds[i] for input[i] (the local index itself when globalIds is empty).
+    // Terms get the settings info[i], or the defaults when info is empty; a term listed more
+    // than once keeps the severity of its first listing and belongs to the policies of all of them.
+    explicit DictionarySnapshot(const std::vector<std::string>& input, const std::vector<uint32_t>& globalIds = {},
+                                const std::vector<TermInfo>& info = {});
+    
+    DictionarySnapshot(const DictionarySnapshot&) = delete;
+    DictionarySnapshot& operator=(const DictionarySnapshot&) = delete;
+    DictionarySnapshot(DictionarySnapshot&&) = default;
+    DictionarySnapshot& operator=(DictionarySnapshot&&) = default;
+    
+    size_t termCount() const { return termTotal; }
+    
+    // Normalized length of the longest term: how far back a match can reach
+    size_t maxTermLength() const { return longestTerm; }
+    
+    // Total footprint of the snapshot: the arena, or the mapped file plus the private arrays
+    size_t memoryBytes() const {
+        return arenaWords() * sizeof(uint64_t) + mappedTermIds.size() * sizeof(uint32_t)
+             + mappedPolicies.size() * sizeof(PolicyMask);
+    }
+    
+    // Is the automaton served from a compiled file rather than built in memory?
+    bool isMapped() const { return mapping != nullptr; }
+    
+    double bytesPerTerm() const {
+        return termTotal ? static_cast<double>(memoryBytes()) / static_cast<double>(termTotal) : 0.0;
+    }
+    
+    std::string_view term(int id) const {
+        return std::string_view(termChars + termOffsets[id], termOffsets[id + 1] - termOffsets[id]);
+    }
+    
+    // Shared id reported in matches for a local term index
+    uint32_t termId(int id) const {
+        return termIds[id];
+    }
+    
+    uint16_t severity(int id) const {
+        return termSeverities[id];
+    }
+    
+    PolicyMask policies(int id) const {
+        return termPolicies[id];
+    }
+    
+    // All terms in local index order, e.g. to build the next snapshot
+    std::vector<std::string> terms() const {
+        std::vector<std::string> result;
+        result.reserve(termTotal);
+        for (size_t i = 0; i < termTotal; ++i) result.emplace_back(term(static_cast<int>(i)));
+        return result;
+    }
+    
+    // Settings in the same order as terms()
+    std::vector<TermInfo> info() const {
+        std::vector<TermInfo> result(termTotal);
+        for (size_t i = 0; i < termTotal; ++i) result[i] = {termSeverities[i], termPolicies[i]};
+        return result;
+    }
+    
+    // Write the snapshot as a compiled dictionary file that load() can map back in; policyNames
+    // names the bits of the policy masks, in bit order
+    bool save(const std::string& filename, const std::vector<std::string>& policyNames = {}) const;
+    
+    // Does the file start like a compiled dictionary?
+    static bool isCompiledFile(const std::string& filename) {
+        char magic[sizeof(FileMagic)] = {};
+        std::ifstream file(filename, std::ios::binary);
+        return file.read(magic, sizeof(magic)) && std::memcmp(magic, FileMagic, sizeof(magic)) == 0;
+    }
+    
+    // Map a compiled dictionary file read-only. Term ids and policy bits are per process, so every
+    // term gets its shared id from `intern` and every policy its bit from `internPolicy`. Returns
+    // null, after reporting why, if the file is truncated, was written by an incompatible build or
+    // fails its checksum.
+    static std::shared_ptr<const DictionarySnapshot> load(const std::string& filename,
+                                                         const std::function<uint32_t(std::string_view)>& intern,
+                                                         const std::function<int(std::string_view)>& internPolicy);
+    
+    // Exact lookup of a normalized term; returns its local index or None
+    int find(std::string_view word) const {
+        int state = 0;
+        for (char c : word) {
+            state = child(state, static_cast<unsigned char>(c));
+            if (state == None) return None;
+        }
+        return nodeTerms[state];
+    }
+    
+    bool contains(std::string_view word) const {
+        return find(word) != None;
+    }
+    
+    // Raw offset where a match reported by forEachMatch starts
+    size_t matchStart(std::string_view text, size_t end, int local) const {
+        return matchStart(reinterpret_cast<const unsigned char*>(text.data()), end, local);
+    }
+    
+    // Longest word findWithin() searches for
+    static constexpr size_t MaxFuzzyLength = 64;
+    
+    // Closest term within maxEdits insertions, deletions or substitutions of a normalized word,
+    // or None; its distance goes to *distance. Walks the Trie keeping one banded edit-distance
+    // row per depth, and skips every subtree whose row is already over the bound. Until the walk
+    // has consumed `anchored` bytes of the word it may only spend maxEdits / 2 edits, which keeps
+    // the bushy top of the Trie to a near-exact descent (see FuzzyIndex).
+    int findWithin(std::string_view word, unsigned maxEdits, size_t anchored = 0, unsigned* distance = nullptr) const;
+    
+    // Scan state carried from one piece of a stream to the next. Bytes are numbered by their
+    // place in the normalized text, whatever the automaton skips, so the numbers of base and
+    // delta agree.
+    struct StreamState {
+        int state = 0;
+        bool lastWasSpace = true;
+        int pendingOutput = None;   // Word mode: a match on the last byte fed, until the next byte shows a word ends there
+        uint64_t pendingEnd = 0;
+        uint64_t fed = 0;           // Normalized bytes fed to the automaton so far
+    };
+
+private:
+    // The scan loop behind forEachMatch and feedStream. A streaming scan counts the normalized
+    // bytes it feeds, reporting each with onFed(i, index), and leaves a word-mode match that
+    // ends on the last byte of the piece pending until the next piece starts.
+    template <bool Streaming, typename OnFed, typename OnMatch>
+    void scanText(std::string_view text, MatchMode mode, StreamState& stream, OnFed&& onFed, OnMatch&& onMatch) const {
+        const unsigned char* classes = TextClass::table();
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        const size_t size = text.size();
+        int state = stream.state;
+        bool lastWasSpace = stream.lastWasSpace;
+        uint64_t fed = stream.fed;
+        auto save = [&] {
+            stream.state = state;
+            stream.lastWasSpace = lastWasSpace;
+            stream.fed = fed;
+        };
+        
+        if (mode == MatchMode::Substring) {
+            for (size_t i = 0; i < size; ++i) {
+                unsigned char c = classes[data[i]];
+                if (c == TextClass::Skip) continue;
+                if (c == TextClass::Space && lastWasSpace) continue;
+                lastWasSpace = (c == TextClass::Space);
+                if constexpr (Streaming) onFed(i, fed++);
+                
+                state = step(state, c);
+                for (int out = links[state].output; out != None; out = links[out].nextOutput) {
+                    if (!onMatch(nodeTerms[out], i, fed - 1)) return save();
+                }
+            }
+            return save();
+        }
+        
+        for (size_t i = 0; i < size; ++i) {
+            unsigned char c = classes[data[i]];
+            
+            // Inside a word that cannot start a match: jump straight to the next whitespace
+            if (state == None) {
+                if constexpr (Streaming) {
+                    // Still count what is skipped, so base and delta number the bytes of a stream alike
+                    while (i < size && classes[data[i]] != TextClass::Space) fed += classes[data[i++]] != TextClass::Skip;
+                    if (i == size) break;
+                    ++fed;
+                } else {
+                    while (i < size && classes[data[i]] != TextClass::Space) ++i;
+                    if (i == size) break;
+                }
+                state = 0;
+                lastWasSpace = true;
+                continue;
+            }
+            
+            if (c == TextClass::Skip) continue;
+            if constexpr (Streaming) {
+                // The first byte of this piece decides a match left pending by the last one
+                if (stream.pendingOutput != None) {
+                    int out = stream.pendingOutput;
+                    stream.pendingOutput = None;
+                    for (; c == TextClass::Space && out != None; out = links[out].nextWordOutput) {
+                        if (!onMatch(nodeTerms[out], std::string_view::npos, stream.pendingEnd)) return save();
+                    }
+                }
+            }
+            if (c == TextClass::Space && lastWasSpace) continue;
+            lastWasSpace = (c == TextClass::Space);
+            if constexpr (Streaming) onFed(i, fed++);
+            
+            state = wordStep(state, c);
+            if (state == None) continue;
+            
+            int out = nodes[state].wordOutput;
+            if (out == None) continue;
+            
+            // Terms must also end on a word boundary: the next normalized byte is whitespace or the end
+            size_t j = i + 1;
+            while (j < size && classes[data[j]] == TextClass::Skip) ++j;
+            if constexpr (Streaming) {
+                if (j == size) {
+                    stream.pendingOutput = out;
+                    stream.pendingEnd = fed - 1;
+                    continue;
+                }
+            }
+            if (j < size && classes[data[j]] != TextClass::Space) continue;
+            
+            for (; out != None; out = links[out].nextWordOutput) {
+                if (!onMatch(nodeTerms[out], i, fed - 1)) return save();
+            }
+        }
+        save();
+    }
+
+public:
+    // Scan raw text once, lowercasing, collapsing whitespace and skipping punctuation on the fly.
+    // Calls onMatch(term, end) with the local index of each matched term and the raw index of
+    // its last byte, in order of where the matches end; the scan stops when onMatch returns false.
+    template <typename OnMatch>
+    void forEachMatch(std::string_view text, MatchMode mode, OnMatch&& onMatch) const {
+        StreamState whole;
+        scanText<false>(text, mode, whole, [](size_t, uint64_t) {},
+                        [&](int local, size_t end, uint64_t) { return onMatch(local, end); });
+    }
+    
+    // Scan the next piece of a text that arrives in pieces, carrying the automaton across them.
+    // Bytes are counted as they are fed: onFed(i, index) gives the piece index of the raw byte
+    // behind normalized byte `index`, and onMatch(term, i, endIndex) reports a match by the index
+    // of its last normalized byte (i is npos for a match the previous piece left pending).
+    template <typename OnFed, typename OnMatch>
+    void feedStream(std::string_view piece, MatchMode mode, StreamState& stream, OnFed&& onFed, OnMatch&& onMatch) const {
+        scanText<true>(piece, mode, stream, onFed, onMatch);
+    }
+    
+    // End a stream: a word-mode match on its last byte ends a word after all
+    template <typename OnMatch>
+    void finishStream(StreamState& stream, OnMatch&& onMatch) const {
+        for (int out = stream.pendingOutput; out != None; out = links[out].nextWordOutput) {
+            onMatch(nodeTerms[out], std::string_view::npos, stream.pendingEnd);
+        }
+        stream.pendingOutput = None;
+    }
+    
+    // Collect every match with its raw offset and length
+    void scan(std::string_view text, MatchMode mode, std::vector<TermMatch>& matches) const {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        forEachMatch(text, mode, [&](int local, size_t end) {
+            size_t start = matchStart(data, end, local);
+            matches.push_back({start, end + 1 - start, termIds[local]});
+            return true;
+        });
+    }
+};
@@ -0,0 +1,11 @@
+#include "moderation/dictionary_version.h"
+
+std::string compiledDictionaryPath(const std::string& filename) {
+    return filename + ".bin";
+}
+
+std::atomic<bool> dictionaryReloadRequested{false};
+
+void requestDictionaryReload(int) {
+    dictionaryReloadRequested = true;
+}
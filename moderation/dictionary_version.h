@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/allowlist.h"
+#include "moderation/dictionary_snapshot.h"
+#include "moderation/fuzzy.h"
+#include "moderation/metrics.h"
+#include "moderation/prefilter.h"
+#include "moderation/term_dictionary.h"
+#include "moderation/tokenizer.h"
+#include "moderation/unicode.h"
+
+// Allow or deny decision for a message, as returned by DictionaryVersion::scoreText
+struct Verdict {
+    bool flagged = false;
+    uint32_t score = 0;     // Summed severity of the matches seen before the scan stopped
+    size_t matches = 0;
+    
+    // Count one match; true once the score has reached the threshold
+    bool add(uint16_t severity, uint32_t threshold) {
+        ++matches;
+        score += severity;
+        flagged = score >= threshold;
+        return flagged;
+    }
+};
+
+// Allow or deny decisions for several policies at once, as returned by DictionaryVersion::scorePolicies
+struct PolicyVerdicts {
+    PolicyMask requested = 0;
+    PolicyMask flagged = 0;                         // Requested policies whose score reached the threshold
+    uint32_t scores[PolicyRegistry::MaxPolicies] = {};
+    size_t matches = 0;
+    
+    // Count one match under the policies of its term; true once every requested policy is denied
+    bool add(PolicyMask policies, uint16_t severity, uint32_t threshold) {
+        ++matches;
+        for (PolicyMask rest = policies & requested; rest; rest &= rest - 1) {
+            int bit = __builtin_ctzll(rest);
+            scores[bit] += severity;
+            if (scores[bit] >= threshold) flagged |= PolicyMask(1) << bit;
+        }
+        return flagged == requested;
+    }
+};
+
+// One published state of the dictionary: a large frozen base plus a small delta holding the
+// terms added since the last merge. Both snapshots report shared term dictionary ids, so
+// term ids survive the merge.
+struct DictionaryVersion {
+    std::shared_ptr<const DictionarySnapshot> base;
+    std::shared_ptr<const DictionarySnapshot> delta;
+    uint64_t number = 0;
+    const TermDictionary* termNames = nullptr; // Resolves the ids both snapshots report
+    
+    // Skeleton indexes of base and delta for MatchMode::Fuzzy; only built while that mode is selected
+    std::shared_ptr<const FuzzyIndex> fuzzyBase;
+    std::shared_ptr<const FuzzyIndex> fuzzyDelta;
+    unsigned maxEdits = 1;
+    
+    // Prefilters of base and delta for the per-token lookups of the token and fuzzy modes; only
+    // built while one of those is selected, and the delta's only while it holds terms
+    std::shared_ptr<const TokenPrefilter> prefilterBase;
+    std::shared_ptr<const TokenPrefilter> prefilterDelta;
+    
+    // Phrases whose matches, and the banned matches inside them, are not reported; null while
+    // no false positive has been confirmed
+    std::shared_ptr<const AllowList> allow;
+    
+    // A term of base or delta, as found by a per-token lookup; empty if nothing matched
+    struct TermRef {
+        const DictionarySnapshot* snapshot = nullptr;
+        int local = DictionarySnapshot::None;
+        
+        explicit operator bool() const { return snapshot != nullptr; }
+        uint32_t id() const { return snapshot->termId(local); }
+        uint16_t severity() const { return snapshot->severity(local); }
+        PolicyMask policies() const { return snapshot->policies(local); }
+    };
+    
+    // Banned terms, and those of them added since the last merge; allowlisted phrases are left out
+    size_t termCount() const { return base->termCount() + delta->termCount() - (allow ? allow->phraseCount() : 0); }
+    size_t pendingCount() const { return delta->termCount() - (allow ? allow->pendingCount() : 0); }
+    
+    size_t memoryBytes() const {
+        size_t bytes = base->memoryBytes() + delta->memoryBytes();
+        if (fuzzyBase) bytes += fuzzyBase->memoryBytes();
+        if (fuzzyDelta) bytes += fuzzyDelta->memoryBytes();
+        if (prefilterBase) bytes += prefilterBase->memoryBytes();
+        if (prefilterDelta) bytes += prefilterDelta->memoryBytes();
+        if (allow) bytes += allow->memoryBytes();
+        return bytes;
+    }
+    
+    double bytesPerTerm() const {
+        return termCount() ? static_cast<double>(memoryBytes()) / static_cast<double>(termCount()) : 0.0;
+    }
+    
+    std::string_view term(uint32_t id) const {
+        return termNames->text(id);
+    }
+    
+    std::vector<std::string> terms() const {
+        std::vector<std::string> result = base->terms();
+        std::vector<std::string> added = delta->terms();
+        result.insert(result.end(), added.begin(), added.end());
+        return result;
+    }
+    
+    // Settings in the same order as terms()
+    std::vector<TermInfo> info() const {
+        std::vector<TermInfo> result = base->info();
+        std::vector<TermInfo> added = delta->info();
+        result.insert(result.end(), added.begin(), added.end());
+        return result;
+    }
+    
+    TermRef lookup(std::string_view word) const {
+        int local = base->find(word);
+        if (local != DictionarySnapshot::None) return {base.get(), local};
+        local = delta->find(word);
+        return local != DictionarySnapshot::None ? TermRef{delta.get(), local} : TermRef{};
+    }
+    
+    // lookup() for a token of a scanned message: each snapshot's prefilter gets the first word,
+    // and most tokens never reach a Trie
+    TermRef lookupToken(std::string_view token, PrefilterCounts& counts) const {
+        if (!prefilterBase) return lookup(token);
+        ++counts.tokens;
+        bool passed = false;
+        if (prefilterBase->mayContain(token)) {
+            passed = true;
+            int local = base->find(token);
+            if (local != DictionarySnapshot::None) return {base.get(), local};
+        }
+        if (prefilterDelta && prefilterDelta->mayContain(token)) {
+            passed = true;
+            int local = delta->find(token);
+            if (local != DictionarySnapshot::None) return {delta.get(), local};
+        }
+        ++(passed ? counts.falsePositives : counts.rejected);
+        return {};
+    }
+    
+    // The term a token imitates once its obfuscation is undone
+    TermRef lookupFuzzy(std::string_view token) const {
+        if (!fuzzyBase) return {};
+        static thread_local std::string skeleton;
+        skeleton.clear();
+        Confusables::appendSkeleton(skeleton, token);
+        if (skeleton.empty()) return {};
+        
+        int local = fuzzyBase->find(skeleton, maxEdits);
+        if (local != DictionarySnapshot::None) return {base.get(), local};
+        local = fuzzyDelta ? fuzzyDelta->find(skeleton, maxEdits) : DictionarySnapshot::None;
+        return local != DictionarySnapshot::None ? TermRef{delta.get(), local} : TermRef{};
+    }
+    
+    // Is the term an allowlisted phrase rather than a banned one?
+    bool allowed(uint32_t id) const {
+        return allow && allow->kind(id) == AllowList::Phrase;
+    }
+    
+    // Shared id of a banned term, or TermDictionary::None; an allowlisted phrase is none
+    uint32_t find(std::string_view word) const {
+        TermRef term = lookup(word);
+        return term && !allowed(term.id()) ? term.id() : TermDictionary::None;
+    }
+    
+    // For a verdict scan in a token mode: hold back a token whose term occurs inside some phrase,
+    // until the phrases of the text are known. False if the token should be counted right away.
+    bool holdToken(std::string_view input, const TokenSpan& span, const TermRef& term, AllowScan& held) const {
+        if (!allow || allow->kind(term.id()) != AllowList::Covered) return false;
+        held.held.push_back({AllowList::tokenSpan(input, span.offset, span.length), term.severity(), term.policies()});
+        return true;
+    }
+    
+    // Text the matchers scan: the message itself if it is pure ASCII, otherwise its case folded
+    // copy in normalizer. Sets folded when the copy was made.
+    static std::string_view foldText(std::string_view text, Utf8Normalizer& normalizer, bool& folded) {
+        folded = !Utf8::isAscii(text);
+        if (!folded) return text;
+        StageTimer timer(Stage::Normalize);
+        normalizer.normalize(text);
+        return normalizer.text();
+    }
+    
+    // Split text into tokens: lowercasing, splitting and punctuation removal happen in one vectorized pass
+    static Tokenizer& tokenize(std::string_view text) {
+        static thread_local Tokenizer tokenizer;
+        StageTimer timer(Stage::Normalize);
+        tokenizer.tokenize(text);
+        return tokenizer;
+    }
+    
+    // Find every match in the text, in order of where the matches end
+    void findMatches(std::string_view text, MatchMode mode, std::vector<TermMatch>& matches) const {
+        size_t first = matches.size();
+        collectMatches(text, mode, matches);
+        processMetrics().recordMessage(text.size(), matches.size() - first);
+    }
+    
+    // findMatches without counting the text as a message, for pieces of a longer one
+    void collectMatches(std::string_view text, MatchMode mode, std::vector<TermMatch>& matches) const {
+        size_t first = matches.size();
+        
+        // Text with non-ASCII characters is case folded into a copy the matchers scan instead;
+        // pure ASCII, checked a vector at a time, goes straight to them
+        static thread_local Utf8Normalizer normalizer;
+        bool folded;
+        std::string_view input = foldText(text, normalizer, folded);
+        
+        if (mode == MatchMode::Token || mode == MatchMode::Fuzzy) {
+            Tokenizer& tokenizer = tokenize(input);
+            StageTimer timer(Stage::Match);
+            PrefilterCounts counts;
+            for (const auto& span : tokenizer.tokens()) {
+                TermRef term = lookupToken(tokenizer.normalized(span), counts);
+                if (!term && mode == MatchMode::Fuzzy) {
+                    // Only tokens that miss exactly pay for the skeleton and the edit-distance walk
+                    term = lookupFuzzy(input.substr(span.offset, span.length));
+                }
+                if (term && !allowed(term.id())) {
+                    matches.push_back({span.offset, span.length, term.id()});
+                }
+            }
+            processMetrics().recordPrefilter(counts);
+            if (allow) allow->filterTokens(*base, *delta, input, matches, first);
+        } else {
+            StageTimer timer(Stage::Match);
+            base->scan(input, mode, matches);
+            if (delta->termCount() > 0) {
+                size_t split = matches.size();
+                delta->scan(input, mode, matches);
+                std::inplace_merge(matches.begin() + first, matches.begin() + split, matches.end(),
+                    [](const TermMatch& a, const TermMatch& b) { return a.offset + a.length < b.offset + b.length; });
+            }
+            if (allow) allow->filter(matches, first);
+        }
+        
+        if (folded) {
+            for (size_t i = first; i < matches.size(); ++i) normalizer.remap(matches[i]);
+        }
+    }
+    
+    // Allow or deny a message without collecting its matches: the scan stops as soon as the
+    // severities of the terms found add up to the threshold, and no offsets or match list are
+    // built. Clean text costs one scan; heavily toxic text stops within its first few terms.
+    Verdict scoreText(std::string_view text, MatchMode mode, uint32_t threshold) const {
+        static thread_local Utf8Normalizer normalizer;
+        bool folded;
+        std::string_view input = foldText(text, normalizer, folded);
+        Verdict verdict;
+        static thread_local AllowScan held;
+        held.clear();
+        
+        if (mode == MatchMode::Token || mode == MatchMode::Fuzzy) {
+            Tokenizer& tokenizer = tokenize(input);
+            StageTimer timer(Stage::Match);
+            PrefilterCounts counts;
+            for (const auto& span : tokenizer.tokens()) {
+                TermRef term = lookupToken(tokenizer.normalized(span), counts);
+                if (!term && mode == MatchMode::Fuzzy) {
+                    term = lookupFuzzy(input.substr(span.offset, span.length));
+                }
+                if (!term || allowed(term.id()) || holdToken(input, span, term, held)) continue;
+                if (verdict.add(term.severity(), threshold)) break;
+            }
+            processMetrics().recordPrefilter(counts);
+            if (!verdict.flagged && !held.held.empty()) {
+                allow->findPhrases(*base, *delta, input, held);
+                held.release([&](const AllowScan::Held& match) { return !verdict.add(match.severity, threshold); });
+            }
+        } else {
+            StageTimer timer(Stage::Match);
+            auto score = [&](const DictionarySnapshot& snapshot) {
+                snapshot.forEachMatch(input, mode, [&](int local, size_t end) {
+                    if (allow && allow->hold(snapshot, input, local, end, held)) return true;
+                    return !verdict.add(snapshot.severity(local), threshold);
+                });
+            };
+            score(*base);
+            if (!verdict.flagged && delta->termCount() > 0) score(*delta);
+            if (!verdict.flagged) {
+                held.release([&](const AllowScan::Held& match) { return !verdict.add(match.severity, threshold); });
+            }
+        }
+        
+        processMetrics().recordMessage(text.size(), verdict.matches);
+        return verdict;
+    }
+    
+    // Allow or deny a message under each of the requested policies in one scan. Each match
+    // counts toward the policies its term belongs to, and the scan stops once every requested
+    // policy is denied, so the cost follows the terms found rather than the number of policies.
+    PolicyVerdicts scorePolicies(std::string_view text, MatchMode mode, PolicyMask requested, uint32_t threshold) const {
+        static thread_local Utf8Normalizer normalizer;
+        bool folded;
+        std::string_view input = foldText(text, normalizer, folded);
+        PolicyVerdicts verdicts;
+        verdicts.requested = requested;
+        if (requested == 0) return verdicts;
+        static thread_local AllowScan held;
+        held.clear();
+        
+        if (mode == MatchMode::Token || mode == MatchMode::Fuzzy) {
+            Tokenizer& tokenizer = tokenize(input);
+            StageTimer timer(Stage::Match);
+            PrefilterCounts counts;
+            bool done = false;
+            for (const auto& span : tokenizer.tokens()) {
+                TermRef term = lookupToken(tokenizer.normalized(span), counts);
+                if (!term && mode == MatchMode::Fuzzy) {
+                    term = lookupFuzzy(input.substr(span.offset, span.length));
+                }
+                if (!term || allowed(term.id()) || holdToken(input, span, term, held)) continue;
+                done = verdicts.add(term.policies(), term.severity(), threshold);
+                if (done) break;
+            }
+            processMetrics().recordPrefilter(counts);
+            if (!done && !held.held.empty()) {
+                allow->findPhrases(*base, *delta, input, held);
+                held.release([&](const AllowScan::Held& match) {
+                    return !verdicts.add(match.policies, match.severity, threshold);
+                });
+            }
+        } else {
+            StageTimer timer(Stage::Match);
+            bool done = false;
+            auto score = [&](const DictionarySnapshot& snapshot) {
+                snapshot.forEachMatch(input, mode, [&](int local, size_t end) {
+                    if (allow && allow->hold(snapshot, input, local, end, held)) return true;
+                    done = verdicts.add(snapshot.policies(local), snapshot.severity(local), threshold);
+                    return !done;
+                });
+            };
+            score(*base);
+            if (!done && delta->termCount() > 0) score(*delta);
+            if (!done) {
+                held.release([&](const AllowScan::Held& match) {
+                    return !verdicts.add(match.policies, match.severity, threshold);
+                });
+            }
+        }
+        
+        processMetrics().recordMessage(text.size(), verdicts.matches);
+        return verdicts;
+    }
+};
+
+// Where `compile` writes the compiled form of a text dictionary, and where loading looks for it
+std::string compiledDictionaryPath(const std::string& filename);
+
+// Set from the SIGHUP handler; the dictionary maintenance thread reloads the file when it sees it
+extern std::atomic<bool> dictionaryReloadRequested;
+
+void requestDictionaryReload(int);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+// Dense per-thread index for per-thread slots (epoch announcements, counter shards).
+// Indices are recycled when a thread exits.
+namespace ThreadSlots {
+    constexpr size_t Max = 256;
+    
+    class Registry {
+    private:
+        std::mutex mutex;
+        std::vector<size_t> freeSlots;
+        size_t nextSlot = 0;
+    
+    public:
+        size_t acquire() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!freeSlots.empty()) {
+                size_t slot = freeSlots.back();
+                freeSlots.pop_back();
+                return slot;
+            }
+            if (nextSlot == Max) {
+                std::cerr << "Too many threads: at most " << Max << " can use the moderation engine" << std::endl;
+                std::abort();
+            }
+            return nextSlot++;
+        }
+        
+        void release(size_t slot) {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+        }
+    };
+    
+    inline Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+    
+    // Slot of the calling thread, assigned on first use
+    inline size_t current() {
+        struct Owner {
+            size_t slot = registry().acquire();
+            ~Owner() { registry().release(slot); }
+        };
+        static thread_local Owner owner;
+        return owner.slot;
+    }
+}
+
+// Epoch-based reclamation for read-mostly data. Readers announce the epoch they entered in
+// their own slot and never block; writers publish a new object, retire the old one, and it is
+// freed once no reader that could still see it is active.
+class EpochDomain {
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0}; // 0 means the thread is not reading
+    };
+    
+    Slot slots[ThreadSlots::Max];
+    std::atomic<uint64_t> globalEpoch{1};
+    std::mutex retiredMutex;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+public:
+    // Read-side critical section; nested guards on the same thread are free
+    class ReadGuard {
+    private:
+        Slot* slot;
+        bool outermost;
+    
+    public:
+        explicit ReadGuard(EpochDomain& domain) : slot(&domain.slots[ThreadSlots::current()]) {
+            outermost = slot->epoch.load(std::memory_order_relaxed) == 0;
+            if (outermost) slot->epoch.store(domain.globalEpoch.load());
+        }
+        
+        ~ReadGuard() {
+            if (outermost) slot->epoch.store(0, std::memory_order_release);
+        }
+        
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+    
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+    
+    // Frees everything still retired; only safe once no reader can be active
+    ~EpochDomain() {
+        for (auto& [epoch, deleter] : retired) deleter();
+    }
+    
+    // Schedule deleter to run once every reader that might hold the old object has left.
+    // Call it after the replacement has been published.
+    void retire(std::function<void()> deleter) {
+        uint64_t epoch = globalEpoch.fetch_add(1);
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        retired.push_back({epoch, std::move(deleter)});
+    }
+    
+    // Run the deleters whose epoch no active reader can still be in
+    void reclaim() {
+        uint64_t oldestActive = UINT64_MAX;
+        for (const Slot& slot : slots) {
+            uint64_t epoch = slot.epoch.load();
+            if (epoch != 0) oldestActive = std::min(oldestActive, epoch);
+        }
+        
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(retiredMutex);
+            auto safe = std::partition(retired.begin(), retired.end(),
+                [&](const auto& entry) { return entry.first >= oldestActive; });
+            for (auto it = safe; it != retired.end(); ++it) ready.push_back(std::move(it->second));
+            retired.erase(safe, retired.end());
+        }
+        for (auto& deleter : ready) deleter();
+    }
+    
+    size_t pendingCount() {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        return retired.size();
+    }
+};
@@ -0,0 +1,121 @@
+#include "moderation/feedback.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+FeedbackQueue::FeedbackQueue(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    slots.reset(new Slot[size]);
+    mask = size - 1;
+    for (size_t i = 0; i < size; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+std::string FeedbackLog::encode(const FeedbackRecord& record) {
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(record.contentHash));
+    std::string line = std::to_string(record.timestamp);
+    line += record.falsePositive ? "\tfalse_positive\t" : "\tcorrect\t";
+    line += hash;
+    for (const auto& phrase : record.phrases) {
+        line += '\t';
+        line += phrase;
+    }
+    line += '\n';
+    return line;
+}
+
+bool FeedbackLog::decode(const std::string& line, FeedbackRecord& record) {
+    std::vector<std::string> fields;
+    std::istringstream in(line);
+    std::string field;
+    while (std::getline(in, field, '\t')) fields.push_back(field);
+    if (fields.size() < 3 || (fields[1] != "false_positive" && fields[1] != "correct")) return false;
+    
+    record.timestamp = std::strtoll(fields[0].c_str(), nullptr, 10);
+    record.falsePositive = fields[1] == "false_positive";
+    record.contentHash = std::strtoull(fields[2].c_str(), nullptr, 16);
+    record.phrases.assign(fields.begin() + 3, fields.end());
+    return true;
+}
+
+FeedbackLog::~FeedbackLog() {
+#ifdef __linux__
+    if (fd >= 0) ::close(fd);
+#endif
+}
+
+bool FeedbackLog::open(const std::string& filename, const std::function<void(const FeedbackRecord&)>& onRecord) {
+    size_t intact = 0;
+    {
+        std::ifstream in(filename, std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof()) break; // No newline: the append was cut short
+            intact += line.size() + 1;
+            FeedbackRecord record;
+            if (decode(line, record)) {
+                ++records;
+                onRecord(record);
+            }
+        }
+    }
+    
+    std::error_code error;
+    if (std::filesystem::exists(filename, error) && std::filesystem::file_size(filename, error) > intact) {
+        std::filesystem::resize_file(filename, intact, error);
+    }
+
+#ifdef __linux__
+    fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+#else
+    file.open(filename, std::ios::binary | std::ios::app);
+    if (!file.is_open()) {
+#endif
+        std::cerr << "Error opening feedback log: " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+    return true;
+}
+
+bool FeedbackLog::append(const std::vector<FeedbackRecord>& batch) {
+    if (!isOpen() || batch.empty()) return isOpen();
+    
+    std::string lines;
+    for (const auto& record : batch) lines += encode(record);
+
+#ifdef __linux__
+    size_t written = 0;
+    while (written < lines.size()) {
+        ssize_t result = ::write(fd, lines.data() + written, lines.size() - written);
+        if (result < 0) {
+            std::cerr << "Error writing feedback log: " << path << std::endl;
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (::fdatasync(fd) != 0) {
+        std::cerr << "Error syncing feedback log: " << path << std::endl;
+        return false;
+    }
+#else
+    file << lines << std::flush;
+    if (!file) {
+        std::cerr << "Error writing feedback log: " << path << std::endl;
+        return false;
+    }
+#endif
+    records += batch.size();
+    return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef __linux__
+#include <fstream>
+#endif
+
+// A moderator's answer on one flagged message
+struct FeedbackEntry {
+    std::string content;        // Empty when only the hash is known, e.g. for a flag from the flag log
+    uint64_t contentHash = 0;
+    int64_t timestamp = 0;      // Microseconds since the Unix epoch
+    bool falsePositive = false;
+};
+
+// A feedback entry as kept in the feedback log: the message itself is not stored, only its
+// hash and the context phrases the false positive was allowlisted with
+struct FeedbackRecord {
+    int64_t timestamp = 0;
+    uint64_t contentHash = 0;
+    bool falsePositive = false;
+    std::vector<std::string> phrases;
+};
+
+// Bounded lock-free queue from any number of submitting threads to the one thread that drains
+// it. Every slot carries a sequence number saying whose turn it is, so a producer claims a slot
+// with one compare-and-swap and never waits for the consumer; a full queue refuses the entry.
+class FeedbackQueue {
+public:
+    static constexpr size_t DefaultCapacity = 4096;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        FeedbackEntry entry;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail{0};    // Next slot to fill
+    alignas(64) std::atomic<size_t> head{0};    // Next slot to drain; only the consumer moves it
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> refused{0};
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit FeedbackQueue(size_t capacity = DefaultCapacity);
+    
+    FeedbackQueue(const FeedbackQueue&) = delete;
+    FeedbackQueue& operator=(const FeedbackQueue&) = delete;
+    
+    // Safe from any thread; false if the queue is full
+    bool push(FeedbackEntry&& entry) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.entry = std::move(entry);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    accepted.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            } else if (lag < 0) {
+                // The slot still holds an entry from one lap ago
+                refused.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Consumer only; false if nothing is ready
+    bool pop(FeedbackEntry& entry) {
+        size_t position = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[position & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) return false;
+        entry = std::move(slot.entry);
+        slot.sequence.store(position + mask + 1, std::memory_order_release);
+        head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    bool empty() const {
+        size_t position = head.load(std::memory_order_relaxed);
+        return slots[position & mask].sequence.load(std::memory_order_acquire) != position + 1;
+    }
+    
+    uint64_t acceptedCount() const { return accepted.load(std::memory_order_relaxed); }
+    uint64_t refusedCount() const { return refused.load(std::memory_order_relaxed); }
+};
+
+// Append-only feedback history in a text file, one tab-separated record per line:
+// timestamp, "false_positive" or "correct", message hash, then the allowlisted phrases.
+// Appends are synced to disk before they count as stored. Written by one thread at a time.
+class FeedbackLog {
+private:
+    std::string path;
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::ofstream file;
+#endif
+    size_t records = 0;
+    
+    static std::string encode(const FeedbackRecord& record);
+    static bool decode(const std::string& line, FeedbackRecord& record);
+
+public:
+    FeedbackLog() = default;
+    FeedbackLog(const FeedbackLog&) = delete;
+    FeedbackLog& operator=(const FeedbackLog&) = delete;
+    
+    ~FeedbackLog();
+    
+    // Read every record of the file back, oldest first, then append to it from now on. A missing
+    // file is created; a line torn by a crash is cut off.
+    bool open(const std::string& filename, const std::function<void(const FeedbackRecord&)>& onRecord);
+    
+    // Append records and wait until they are on disk
+    bool append(const std::vector<FeedbackRecord>& batch);
+    
+    bool isOpen() const { return !path.empty(); }
+    
+    size_t recordCount() const { return records; }
+};
@@ -0,0 +1,103 @@
+#include "moderation/flag_log.h"
+
+#include <cstdio>
+#include <iostream>
+
+bool FlagLog::open(const std::string& path, size_t segmentLimit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    segment.close();
+    directory = path;
+    maxSegmentBytes = segmentLimit;
+    
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Error creating flag log directory: " << directory << std::endl;
+        return false;
+    }
+    
+    uint32_t newest = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        unsigned index = 0;
+        if (std::sscanf(entry.path().filename().string().c_str(), "flags-%6u.seg", &index) == 1) {
+            newest = std::max<uint32_t>(newest, index);
+        }
+    }
+    
+    size_t intact = 0;
+    if (newest > 0) {
+        MappedFile file(segmentPath(newest));
+        intact = intactBytes(file);
+    }
+    
+    if (intact == 0) {
+        startSegment(std::max<uint32_t>(newest, 1));
+    } else {
+        // Drop a torn tail before appending after it
+        std::filesystem::resize_file(segmentPath(newest), intact, error);
+        segmentIndex = newest;
+        segmentBytes = intact;
+        segment.open(segmentPath(newest), std::ios::binary | std::ios::app);
+    }
+    
+    if (!segment.is_open()) {
+        std::cerr << "Error opening flag log segment: " << segmentPath(segmentIndex) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FlagLog::append(const FlagRecord& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!segment.is_open()) return;
+    
+    size_t bytes = recordBytes(record.matches.size());
+    if (segmentBytes + bytes > maxSegmentBytes && segmentBytes > sizeof(SegmentHeader)) {
+        startSegment(segmentIndex + 1);
+    }
+    
+    RecordHeader header{static_cast<uint32_t>(bytes), static_cast<uint32_t>(record.matches.size()),
+                        record.contentHash, record.timestamp, record.dictionaryVersion};
+    encoded.assign(bytes, '\0');
+    std::memcpy(&encoded[0], &header, sizeof(header));
+    for (size_t i = 0; i < record.matches.size(); ++i) {
+        const TermMatch& match = record.matches[i];
+        RecordMatch stored{match.termId, static_cast<uint32_t>(match.offset), static_cast<uint32_t>(match.length)};
+        std::memcpy(&encoded[sizeof(header) + i * sizeof(stored)], &stored, sizeof(stored));
+    }
+    uint32_t trailer = static_cast<uint32_t>(bytes);
+    std::memcpy(&encoded[bytes - sizeof(trailer)], &trailer, sizeof(trailer));
+    
+    segment.write(encoded.data(), static_cast<std::streamsize>(bytes));
+    segmentBytes += bytes;
+}
+
+void FlagLog::forEachNewest(const std::function<bool(const FlagRecord&)>& visit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!segment.is_open()) return;
+    segment.flush();
+    
+    for (uint32_t index = segmentIndex; index > 0; --index) {
+        MappedFile file;
+        if (!file.open(segmentPath(index))) break;
+        
+        size_t end = (index == segmentIndex) ? std::min(segmentBytes, file.size()) : file.size();
+        while (size_t start = recordStart(file, end)) {
+            if (!visit(decode(file.data() + start))) return;
+            end = start;
+        }
+    }
+}
+
+std::pair<size_t, uint64_t> FlagLog::diskUsage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<size_t, uint64_t> usage{0, 0};
+    for (uint32_t index = segmentIndex; index > 0; --index) {
+        std::error_code error;
+        uint64_t bytes = std::filesystem::file_size(segmentPath(index), error);
+        if (error) break;
+        usage.first++;
+        usage.second += (index == segmentIndex) ? segmentBytes : bytes;
+    }
+    return usage;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "moderation/mapped_file.h"
+#include "moderation/text.h"
+
+// A flagged message as kept in the flag log. Only a hash of the message is stored.
+struct FlagRecord {
+    uint64_t contentHash = 0;
+    int64_t timestamp = 0;          // Microseconds since the Unix epoch
+    uint64_t dictionaryVersion = 0; // Dictionary the term ids refer to
+    std::vector<TermMatch> matches;
+};
+
+// Append-only flag history on disk. Records go to numbered segment files in one directory, and
+// a new segment is started once the current one would grow past maxSegmentBytes. Each record
+// repeats its size at the end, so a reader can map a segment and walk it newest first.
+class FlagLog {
+public:
+    static constexpr size_t DefaultSegmentBytes = 8 << 20;
+
+private:
+    static constexpr char Magic[8] = {'C', 'M', 'S', 'F', 'L', 'A', 'G', '1'};
+    
+    struct SegmentHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerBytes;
+    };
+    
+    // Record layout: RecordHeader, matchCount RecordMatch entries, padding, then the size again
+    struct RecordHeader {
+        uint32_t bytes;
+        uint32_t matchCount;
+        uint64_t contentHash;
+        int64_t timestamp;
+        uint64_t dictionaryVersion;
+    };
+    
+    struct RecordMatch {
+        uint32_t termId;
+        uint32_t offset;
+        uint32_t length;
+    };
+    
+    std::mutex mutex;
+    std::string directory;
+    size_t maxSegmentBytes = DefaultSegmentBytes;
+    uint32_t segmentIndex = 0;
+    size_t segmentBytes = 0;
+    std::ofstream segment;
+    std::string encoded;
+    
+    std::string segmentPath(uint32_t index) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "flags-%06u.seg", index);
+        return (std::filesystem::path(directory) / name).string();
+    }
+    
+    static size_t recordBytes(size_t matchCount) {
+        size_t bytes = sizeof(RecordHeader) + matchCount * sizeof(RecordMatch) + sizeof(uint32_t);
+        return (bytes + 7) & ~size_t(7);
+    }
+    
+    // Check the record that ends at `end` and return where it starts, or 0 if it is damaged
+    static size_t recordStart(const MappedFile& file, size_t end) {
+        uint32_t bytes;
+        if (end < sizeof(SegmentHeader) + sizeof(RecordHeader) + sizeof(bytes)) return 0;
+        std::memcpy(&bytes, file.data() + end - sizeof(bytes), sizeof(bytes));
+        if (bytes < sizeof(RecordHeader) + sizeof(bytes) || bytes > end - sizeof(SegmentHeader)) return 0;
+        
+        RecordHeader header;
+        std::memcpy(&header, file.data() + end - bytes, sizeof(header));
+        return (header.bytes == bytes && recordBytes(header.matchCount) == bytes) ? end - bytes : 0;
+    }
+    
+    // Length of the intact prefix of a segment; a crash can leave a torn record at the tail
+    static size_t intactBytes(const MappedFile& file) {
+        if (file.size() < sizeof(SegmentHeader) || std::memcmp(file.data(), Magic, sizeof(Magic)) != 0) return 0;
+        
+        size_t position = sizeof(SegmentHeader);
+        while (position + sizeof(RecordHeader) <= file.size()) {
+            RecordHeader header;
+            std::memcpy(&header, file.data() + position, sizeof(header));
+            if (header.bytes != recordBytes(header.matchCount) || header.bytes > file.size() - position) break;
+            if (recordStart(file, position + header.bytes) != position) break;
+            position += header.bytes;
+        }
+        return position;
+    }
+    
+    static FlagRecord decode(const char* data) {
+        RecordHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        
+        FlagRecord record;
+        record.contentHash = header.contentHash;
+        record.timestamp = header.timestamp;
+        record.dictionaryVersion = header.dictionaryVersion;
+        record.matches.reserve(header.matchCount);
+        for (uint32_t i = 0; i < header.matchCount; ++i) {
+            RecordMatch match;
+            std::memcpy(&match, data + sizeof(header) + i * sizeof(match), sizeof(match));
+            record.matches.push_back({match.offset, match.length, match.termId});
+        }
+        return record;
+    }
+    
+    // Start a fresh segment file; caller holds mutex
+    void startSegment(uint32_t index) {
+        segment.close();
+        segmentIndex = index;
+        segment.open(segmentPath(index), std::ios::binary | std::ios::trunc);
+        
+        SegmentHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = 1;
+        header.headerBytes = sizeof(SegmentHeader);
+        segment.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        segmentBytes = sizeof(header);
+    }
+
+public:
+    // Open (or create) the log in a directory and continue after its newest segment
+    bool open(const std::string& path, size_t segmentLimit = DefaultSegmentBytes);
+    
+    bool isOpen() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return segment.is_open();
+    }
+    
+    // Append one record, rotating to a new segment when the current one is full
+    void append(const FlagRecord& record);
+    
+    // Visit records newest first, one mapped segment at a time; the visitor returns false to stop
+    void forEachNewest(const std::function<bool(const FlagRecord&)>& visit);
+    
+    // Number of segment files and their total size
+    std::pair<size_t, uint64_t> diskUsage();
+};
+
+// Fixed-capacity ring of the most recently flagged messages; the oldest entry is overwritten
+class RecentFlags {
+public:
+    struct Entry {
+        std::string content;
+        FlagRecord record;
+    };
+
+private:
+    std::vector<Entry> slots;
+    size_t next = 0;
+    size_t count = 0;
+
+public:
+    explicit RecentFlags(size_t capacity) : slots(std::max<size_t>(1, capacity)) {}
+    
+    void push(Entry entry) {
+        slots[next] = std::move(entry);
+        next = (next + 1) % slots.size();
+        count = std::min(count + 1, slots.size());
+    }
+    
+    // Entry `age` steps back from the newest one; age must be below size()
+    const Entry& newest(size_t age = 0) const {
+        return slots[(next + slots.size() - 1 - age) % slots.size()];
+    }
+    
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    size_t capacity() const { return slots.size(); }
+};
@@ -0,0 +1,94 @@
+#include "moderation/fuzzy.h"
+
+#include <vector>
+
+FuzzyIndex::FuzzyIndex(const DictionarySnapshot& terms, const AllowList* allow) {
+    std::vector<std::string> forward;
+    std::vector<std::string> backward;
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < terms.termCount(); ++i) {
+        int local = static_cast<int>(i);
+        if (allow && allow->kind(terms.termId(local)) == AllowList::Phrase) continue;
+        forward.emplace_back();
+        Confusables::appendSkeleton(forward.back(), terms.term(local));
+        backward.emplace_back(forward.back().rbegin(), forward.back().rend());
+        ids.push_back(static_cast<uint32_t>(i));
+    }
+    
+    // At least 20 bits and three probes per key: a word brings about ten keys, and false
+    // positives cost a walk each
+    size_t keys = 0;
+    for (const std::string& skeleton : forward) keys += skeleton.size() + 1;
+    size_t words = 1;
+    while (words * 64 < keys * 20) words *= 2;
+    neighborBits.assign(words, 0);
+    std::vector<uint64_t> hashes;
+    for (const std::string& skeleton : forward) {
+        neighborHashes(skeleton, hashes);
+        for (uint64_t hash : hashes) neighborBlock(hash) |= neighborBitsFor(hash);
+    }
+    
+    skeletons = DictionarySnapshot(forward, ids);
+    reversedSkeletons = DictionarySnapshot(backward, ids);
+}
+
+void FuzzyIndex::neighborHashes(std::string_view skeleton, std::vector<uint64_t>& hashes) {
+    // Polynomial hashes, so that of the skeleton without byte i is the hash of the bytes before i
+    // shifted past the bytes after it, plus the hash of those: every key in linear time
+    const uint64_t base = 0x100000001b3ull;
+    const size_t n = skeleton.size();
+    static thread_local std::vector<uint64_t> suffix, power;
+    suffix.assign(n + 1, 0);
+    power.assign(n + 1, 1);
+    for (size_t i = n; i-- > 0;) {
+        suffix[i] = static_cast<unsigned char>(skeleton[i]) * power[n - 1 - i] + suffix[i + 1];
+        power[n - i] = power[n - 1 - i] * base;
+    }
+    
+    hashes.clear();
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < n; ++i) {
+        hashes.push_back(mix(prefix * power[n - 1 - i] + suffix[i + 1], n - 1));
+        prefix = prefix * base + static_cast<unsigned char>(skeleton[i]);
+    }
+    hashes.push_back(mix(prefix, n));
+}
+
+bool FuzzyIndex::mayHaveNeighbor(std::string_view skeleton) const {
+    static thread_local std::vector<uint64_t> hashes;
+    neighborHashes(skeleton, hashes);
+    for (uint64_t hash : hashes) {
+        uint64_t bits = neighborBitsFor(hash);
+        if ((neighborBlock(hash) & bits) == bits) return true;
+    }
+    return false;
+}
+
+int FuzzyIndex::find(std::string_view skeleton, unsigned maxEdits) const {
+    unsigned edits = editsFor(skeleton.size(), maxEdits);
+    if (edits == 0) {
+        int exact = skeletons.find(skeleton);
+        return exact != DictionarySnapshot::None ? static_cast<int>(skeletons.termId(exact)) : DictionarySnapshot::None;
+    }
+    
+    // The filter holds every skeleton whole as well, so it also answers for an exact match
+    if (edits == 1 && !mayHaveNeighbor(skeleton)) return DictionarySnapshot::None;
+    
+    // Forward, the walk is anchored until it has consumed half the word; backward, until it has
+    // consumed all but one byte of the other half. A term the forward walk rejects spent more
+    // than edits / 2 on the first half, which leaves too few for the rest to fail backward.
+    const size_t n = skeleton.size();
+    const size_t half = n / 2;
+    unsigned distance = 0;
+    int id = skeletons.findWithin(skeleton, edits, half + 1, &distance);
+    
+    // Only a strictly closer term from the second walk can replace the first one
+    unsigned budget = (id != DictionarySnapshot::None) ? distance - 1 : edits;
+    if (budget > 0) {
+        static thread_local std::string reversed;
+        reversed.assign(skeleton.rbegin(), skeleton.rend());
+        int other = reversedSkeletons.findWithin(reversed, budget, n - half);
+        if (other != DictionarySnapshot::None) return static_cast<int>(reversedSkeletons.termId(other));
+    }
+    return id != DictionarySnapshot::None ? static_cast<int>(skeletons.termId(id)) : DictionarySnapshot::None;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/allowlist.h"
+#include "moderation/dictionary_snapshot.h"
+#include "moderation/text.h"
+
+// Byte classes for the skeleton of a word: what is left once obfuscation is undone
+namespace Confusables {
+    // Lowercase letters, with digits and symbols read as the letters they imitate ("h4te",
+    // "$c@m"); other punctuation becomes TextClass::Skip, as in normal matching
+    inline const unsigned char* table() {
+        static const auto classes = [] {
+            std::array<unsigned char, 256> t{};
+            const unsigned char* text = TextClass::table();
+            for (int c = 0; c < 256; ++c) t[c] = text[c];
+            
+            const char* pairs[] = {"0o", "1i", "3e", "4a", "5s", "6g", "7t", "8b", "9g",
+                                   "@a", "$s", "!i", "|l", "+t", "(c", "<c", "&e"};
+            for (const char* pair : pairs) t[static_cast<unsigned char>(pair[0])] = static_cast<unsigned char>(pair[1]);
+            return t;
+        }();
+        return classes.data();
+    }
+    
+    // Append the skeleton of a word: confusables folded, punctuation dropped and runs of the
+    // same letter collapsed to one ("scaaam" and "s.c.a.m" both become "scam"). Multi-byte
+    // UTF-8 characters are compared whole, so runs of Cyrillic or Greek letters collapse too.
+    inline void appendSkeleton(std::string& out, std::string_view word) {
+        const unsigned char* classes = table();
+        size_t last = std::string::npos;   // Where the last character appended starts
+        for (size_t i = 0; i < word.size();) {
+            unsigned char lead = static_cast<unsigned char>(word[i]);
+            size_t length = lead < 0xC0 ? 1 : std::min<size_t>(lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2, word.size() - i);
+            std::string_view character = word.substr(i, length);
+            i += length;
+            
+            char c = character[0];
+            if (length == 1) {
+                if (classes[lead] == TextClass::Skip) continue;
+                c = static_cast<char>(classes[lead]);
+                character = std::string_view(&c, 1);
+            }
+            if (last != std::string::npos && std::string_view(out).substr(last) == character) continue;
+            last = out.size();
+            out.append(character);
+        }
+    }
+}
+
+// Dictionary terms reduced to their skeletons, searched within an edit distance. A word within
+// k edits of a term has at most k / 2 of them in its first half or in its second half, so one
+// Trie of the skeletons and one of the reversed skeletons each take one case, starting with an
+// exact descent over half the word. Terms whose skeletons coincide ("kill", "kil") share one
+// entry; a match reports the first of them, by its local index in the snapshot indexed.
+class FuzzyIndex {
+private:
+    DictionarySnapshot skeletons;
+    DictionarySnapshot reversedSkeletons;
+    
+    // Blocked Bloom filter over every skeleton and every skeleton with one byte deleted. A word
+    // within one edit of a term shares one of those keys with it (the term itself, the word with
+    // a byte deleted, or both with the same byte deleted), so a one-edit search that finds none
+    // of the word's keys here is settled without reading either Trie.
+    std::vector<uint64_t> neighborBits;
+    
+    // Spread a key hash, salted with the key length, over the filter
+    static uint64_t mix(uint64_t hash, size_t length) {
+        hash ^= length * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 31;
+        return hash * 0xff51afd7ed558ccdull;
+    }
+    
+    static uint64_t neighborBitsFor(uint64_t hash) {
+        return (1ull << (hash & 63)) | (1ull << ((hash >> 6) & 63)) | (1ull << ((hash >> 12) & 63));
+    }
+    
+    uint64_t& neighborBlock(uint64_t hash) {
+        return neighborBits[(hash >> 40) & (neighborBits.size() - 1)];
+    }
+    
+    const uint64_t& neighborBlock(uint64_t hash) const {
+        return neighborBits[(hash >> 40) & (neighborBits.size() - 1)];
+    }
+    
+    // Hashes of a skeleton and of each of its one-byte deletions
+    static void neighborHashes(std::string_view skeleton, std::vector<uint64_t>& hashes);
+    
+    // Might some term be within one edit of the skeleton?
+    bool mayHaveNeighbor(std::string_view skeleton) const;
+
+public:
+    // Words shorter than this must match a skeleton exactly; shorter than LongWord, with one edit
+    static constexpr size_t ShortWord = 5;
+    static constexpr size_t LongWord = 9;
+    
+    // Index the terms, leaving out the allowlisted phrases among them
+    explicit FuzzyIndex(const DictionarySnapshot& terms, const AllowList* allow = nullptr);
+    
+    size_t memoryBytes() const {
+        return skeletons.memoryBytes() + reversedSkeletons.memoryBytes() + neighborBits.size() * sizeof(uint64_t);
+    }
+    
+    // Edits allowed for a skeleton of the given length: short words are too easy to confuse
+    static unsigned editsFor(size_t length, unsigned maxEdits) {
+        if (length < ShortWord) return 0;
+        if (length < LongWord) return maxEdits < 1 ? maxEdits : 1;
+        return maxEdits;
+    }
+    
+    // Local index of the closest term within the edits allowed for the skeleton, or DictionarySnapshot::None
+    int find(std::string_view skeleton, unsigned maxEdits) const;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "moderation/term_dictionary.h"
+
+// Weighted graph of relationships between flagged terms, learned from terms flagged together
+// in the same message. Every term keeps at most MaxDegree neighbors, each with a weight that
+// halves every HalfLife observed messages, so the graph stays bounded and follows the traffic:
+// a full neighbor list only takes in a new term by evicting one whose weight has decayed below
+// what the new term brings. Updates lock one stripe per endpoint and may come from any thread.
+class Graph {
+public:
+    static constexpr size_t MaxDegree = 16;
+    static constexpr size_t MaxTermsPerMessage = 8;    // Later distinct terms of a message are not paired
+    static constexpr size_t DefaultTopN = 5;
+    static constexpr double HalfLife = 100000;         // In observed messages
+    
+    struct Neighbor {
+        uint32_t id;
+        double weight;
+    };
+    
+    struct Stats {
+        size_t terms = 0;       // Terms with at least one neighbor
+        size_t edges = 0;       // Neighbor slots in use, counted from both ends
+        uint64_t observations = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+    };
+
+private:
+    struct Slot {
+        uint32_t neighbor = TermDictionary::None;
+        float weight = 0;
+        uint64_t stamp = 0;     // Observation count when the weight was last brought up to date
+    };
+    
+    struct Node {
+        Slot slots[MaxDegree];
+    };
+    
+    // Nodes live in chunks allocated on first use, indexed like the term dictionary's chunks
+    static constexpr size_t ChunkBits = 10;
+    static constexpr size_t ChunkSize = size_t(1) << ChunkBits;
+    static constexpr size_t MaxChunks = size_t(1) << 16;
+    static constexpr size_t LockStripes = 256;
+    
+    const TermDictionary& dictionary;
+    std::unique_ptr<std::atomic<Node*>[]> chunks{new std::atomic<Node*>[MaxChunks]()};
+    std::unique_ptr<std::mutex[]> stripes{new std::mutex[LockStripes]};
+    std::atomic<uint64_t> clock{0};
+    std::atomic<uint64_t> evictions{0};
+    
+    // Node of a term, allocating its chunk if create is set; null if it has none yet
+    Node* node(uint32_t id, bool create) {
+        std::atomic<Node*>& slot = chunks[id >> ChunkBits];
+        Node* chunk = slot.load(std::memory_order_acquire);
+        if (!chunk && create) {
+            Node* fresh = new Node[ChunkSize];
+            if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+                chunk = fresh;
+            } else {
+                delete[] fresh; // Another thread got there first
+            }
+        }
+        return chunk ? &chunk[id & (ChunkSize - 1)] : nullptr;
+    }
+    
+    const Node* node(uint32_t id) const {
+        Node* chunk = chunks[id >> ChunkBits].load(std::memory_order_acquire);
+        return chunk ? &chunk[id & (ChunkSize - 1)] : nullptr;
+    }
+    
+    std::mutex& stripe(uint32_t id) const {
+        return stripes[id % LockStripes];
+    }
+    
+    double decayed(const Slot& slot, uint64_t now) const {
+        if (now <= slot.stamp) return slot.weight;
+        return slot.weight * std::exp2(-static_cast<double>(now - slot.stamp) / HalfLife);
+    }
+    
+    // Add weight to the edge from one term to another, within from's own neighbor list
+    void strengthen(uint32_t from, uint32_t to, double weight, uint64_t now) {
+        Node& entry = *node(from, true);
+        std::lock_guard<std::mutex> lock(stripe(from));
+        Slot* weakest = nullptr;
+        double weakestWeight = 0;
+        for (Slot& slot : entry.slots) {
+            if (slot.neighbor == to) {
+                slot.weight = static_cast<float>(decayed(slot, now) + weight);
+                slot.stamp = now;
+                return;
+            }
+            double current = slot.neighbor == TermDictionary::None ? -1.0 : decayed(slot, now);
+            if (!weakest || current < weakestWeight) {
+                weakest = &slot;
+                weakestWeight = current;
+            }
+        }
+        
+        // An established neighbor keeps its place against a single new sighting
+        if (weakestWeight >= weight) return;
+        if (weakest->neighbor != TermDictionary::None) evictions.fetch_add(1, std::memory_order_relaxed);
+        *weakest = {to, static_cast<float>(weight), now};
+    }
+
+public:
+    explicit Graph(const TermDictionary& dictionary) : dictionary(dictionary) {}
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+    
+    ~Graph() {
+        for (size_t i = 0; i < MaxChunks; ++i) delete[] chunks[i].load();
+    }
+    
+    // Strengthen the connection between two terms in both directions
+    void addEdge(uint32_t term1, uint32_t term2, double weight = 1.0) {
+        if (term1 == term2) return;
+        uint64_t now = clock.load(std::memory_order_relaxed);
+        strengthen(term1, term2, weight, now);
+        strengthen(term2, term1, weight, now);
+    }
+    
+    // Learn from the terms flagged in one message: every pair of its distinct terms, up to
+    // MaxTermsPerMessage of them, gains one unit of weight. ids is sorted and deduplicated.
+    void observe(std::vector<uint32_t>& ids) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        if (ids.size() < 2) return;
+        
+        size_t count = std::min(ids.size(), MaxTermsPerMessage);
+        uint64_t now = clock.fetch_add(1, std::memory_order_relaxed) + 1;
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t j = i + 1; j < count; ++j) {
+                strengthen(ids[i], ids[j], 1.0, now);
+                strengthen(ids[j], ids[i], 1.0, now);
+            }
+        }
+    }
+    
+    // The n heaviest neighbors of a term, heaviest first, with their weights decayed to now
+    std::vector<Neighbor> topNeighbors(uint32_t id, size_t n = DefaultTopN) const {
+        std::vector<Neighbor> result;
+        const Node* entry = node(id);
+        if (!entry) return result;
+        
+        uint64_t now = clock.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(stripe(id));
+            for (const Slot& slot : entry->slots) {
+                if (slot.neighbor != TermDictionary::None) result.push_back({slot.neighbor, decayed(slot, now)});
+            }
+        }
+        size_t keep = std::min(result.size(), n);
+        std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(keep), result.end(),
+            [](const Neighbor& a, const Neighbor& b) { return a.weight > b.weight; });
+        result.resize(keep);
+        return result;
+    }
+    
+    // Get the n most strongly related words, strongest first
+    std::vector<std::string> getRelatedWords(const std::string& startWord, size_t n = DefaultTopN) const {
+        std::vector<std::string> relatedWords;
+        uint32_t start = dictionary.find(startWord);
+        if (start == TermDictionary::None) return relatedWords;
+        for (const Neighbor& neighbor : topNeighbors(start, n)) relatedWords.emplace_back(dictionary.text(neighbor.id));
+        return relatedWords;
+    }
+    
+    Stats stats() const {
+        Stats result;
+        for (size_t c = 0; c < MaxChunks; ++c) {
+            Node* chunk = chunks[c].load(std::memory_order_acquire);
+            if (!chunk) continue;
+            result.bytes += ChunkSize * sizeof(Node);
+            for (size_t i = 0; i < ChunkSize; ++i) {
+                uint32_t id = static_cast<uint32_t>((c << ChunkBits) + i);
+                std::lock_guard<std::mutex> lock(stripe(id));
+                size_t used = 0;
+                for (const Slot& slot : chunk[i].slots) used += slot.neighbor != TermDictionary::None;
+                result.edges += used;
+                result.terms += used > 0;
+            }
+        }
+        result.bytes += MaxChunks * sizeof(std::atomic<Node*>) + LockStripes * sizeof(std::mutex);
+        result.observations = clock.load(std::memory_order_relaxed);
+        result.evictions = evictions.load(std::memory_order_relaxed);
+        return result;
+    }
+    
+    // Visualize graph connections for a specific term
+    void visualizeConnections(uint32_t id) const {
+        std::string_view word = dictionary.text(id);
+        std::vector<Neighbor> connections = topNeighbors(id, MaxDegree);
+        if (connections.empty()) {
+            std::cout << "No connections found for word: " << word << std::endl;
+            return;
+        }
+        
+        std::cout << "Connections for '" << word << "':" << std::endl;
+        std::cout << word << " -> ";
+        
+        bool first = true;
+        for (const Neighbor& neighbor : connections) {
+            if (!first) std::cout << ", ";
+            std::cout << dictionary.text(neighbor.id) << " (" << std::round(neighbor.weight * 100) / 100 << ")";
+            first = false;
+        }
+        std::cout << std::endl;
+    }
+};
@@ -0,0 +1,879 @@
+#include "moderation/http_server.h"
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "moderation/batch.h"
+#include "moderation/work_stealing_pool.h"
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // Minimal JSON reader for request bodies: strings, and arrays or objects of them. Values
+    // of unknown keys are skipped whatever their type.
+    class JsonReader {
+    private:
+        std::string_view text;
+        size_t pos = 0;
+        
+        static constexpr int MaxDepth = 32;
+        
+        void skipSpace() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) ++pos;
+        }
+        
+        bool consume(char c) {
+            skipSpace();
+            if (pos < text.size() && text[pos] == c) {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+        
+        bool peek(char c) {
+            skipSpace();
+            return pos < text.size() && text[pos] == c;
+        }
+        
+        bool parseHex(uint32_t& value) {
+            if (pos + 4 > text.size()) return false;
+            value = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = text[pos++];
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+                else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+                else return false;
+            }
+            return true;
+        }
+        
+        static void appendUtf8(std::string& out, uint32_t code) {
+            if (code < 0x80) {
+                out.push_back(static_cast<char>(code));
+            } else if (code < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            } else if (code < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+        }
+        
+        bool skipValue(int depth) {
+            if (depth > MaxDepth) return false;
+            skipSpace();
+            if (pos >= text.size()) return false;
+            std::string ignored;
+            if (text[pos] == '"') return parseString(ignored);
+            
+            if (text[pos] == '[' || text[pos] == '{') {
+                bool object = text[pos] == '{';
+                char close = object ? '}' : ']';
+                ++pos;
+                if (consume(close)) return true;
+                do {
+                    if (object && (!parseString(ignored) || !consume(':'))) return false;
+                    if (!skipValue(depth + 1)) return false;
+                } while (consume(','));
+                return consume(close);
+            }
+            
+            // Numbers, true, false and null
+            size_t start = pos;
+            while (pos < text.size() && std::strchr("+-.0123456789eEtrufalsn", text[pos])) ++pos;
+            return pos > start;
+        }
+    
+    public:
+        explicit JsonReader(std::string_view text) : text(text) {}
+        
+        bool parseString(std::string& out) {
+            if (!consume('"')) return false;
+            out.clear();
+            while (pos < text.size()) {
+                char c = text[pos++];
+                if (c == '"') return true;
+                if (static_cast<unsigned char>(c) < 0x20) return false;
+                if (c != '\\') {
+                    out.push_back(c);
+                    continue;
+                }
+                if (pos >= text.size()) return false;
+                char escape = text[pos++];
+                switch (escape) {
+                    case '"': case '\\': case '/': out.push_back(escape); break;
+                    case 'b': out.push_back('\b'); break;
+                    case 'f': out.push_back('\f'); break;
+                    case 'n': out.push_back('\n'); break;
+                    case 'r': out.push_back('\r'); break;
+                    case 't': out.push_back('\t'); break;
+                    case 'u': {
+                        uint32_t code;
+                        if (!parseHex(code)) return false;
+                        // A high surrogate must be followed by an escaped low surrogate
+                        if (code >= 0xD800 && code <= 0xDBFF) {
+                            uint32_t low;
+                            if (pos + 2 > text.size() || text[pos] != '\\' || text[pos + 1] != 'u') return false;
+                            pos += 2;
+                            if (!parseHex(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                            return false;
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default: return false;
+                }
+            }
+            return false;
+        }
+        
+        // A JSON string, or an object whose "text" member is one
+        bool parseMessage(std::string& out) {
+            if (peek('"')) return parseString(out) && atEnd();
+            if (!consume('{')) return false;
+            bool found = false;
+            std::string key;
+            if (!consume('}')) {
+                do {
+                    if (!parseString(key) || !consume(':')) return false;
+                    if (key == "text" && peek('"')) {
+                        if (!parseString(out)) return false;
+                        found = true;
+                    } else if (!skipValue(1)) {
+                        return false;
+                    }
+                } while (consume(','));
+                if (!consume('}')) return false;
+            }
+            return found && atEnd();
+        }
+        
+        // An array of strings, or an object whose "messages" member is one
+        bool parseMessages(std::vector<std::string>& out) {
+            auto parseArray = [&] {
+                if (!consume('[')) return false;
+                if (consume(']')) return true;
+                do {
+                    out.emplace_back();
+                    if (!parseString(out.back())) return false;
+                } while (consume(','));
+                return consume(']');
+            };
+            
+            if (peek('[')) return parseArray() && atEnd();
+            if (!consume('{')) return false;
+            bool found = false;
+            std::string key;
+            if (!consume('}')) {
+                do {
+                    if (!parseString(key) || !consume(':')) return false;
+                    if (key == "messages" && peek('[')) {
+                        out.clear();
+                        if (!parseArray()) return false;
+                        found = true;
+                    } else if (!skipValue(1)) {
+                        return false;
+                    }
+                } while (consume(','));
+                if (!consume('}')) return false;
+            }
+            return found && atEnd();
+        }
+        
+        bool atEnd() {
+            skipSpace();
+            return pos == text.size();
+        }
+    };
+    
+    const char* reasonPhrase(int status) {
+        switch (status) {
+            case 100: return "Continue";
+            case 200: return "OK";
+            case 202: return "Accepted";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            case 501: return "Not Implemented";
+            case 503: return "Service Unavailable";
+            default: return "Internal Server Error";
+        }
+    }
+    
+    std::string httpResponse(int status, std::string_view contentType, const std::string& body, bool keepAlive,
+                             std::string_view extraHeaders = {}) {
+        std::string response = "HTTP/1.1 " + std::to_string(status) + " " + reasonPhrase(status) + "\r\n";
+        response += "Content-Type: ";
+        response += contentType;
+        response += "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+        response += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        response += extraHeaders;
+        response += "\r\n";
+        response += body;
+        return response;
+    }
+    
+    std::string jsonError(const std::string& message) {
+        std::string body = "{\"error\":";
+        appendJsonString(body, message);
+        body += "}\n";
+        return body;
+    }
+    
+    bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+        }
+        return true;
+    }
+    
+    std::string_view trim(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+        return value;
+    }
+    
+    std::atomic<bool> serverStopRequested{false};
+    
+    void requestServerStop(int) {
+        serverStopRequested = true;
+    }
+}
+
+// Single-threaded epoll loop that owns every socket. Moderation requests are queued and handed
+// to the workers in micro-batches: whatever arrived while all workers were busy, up to
+// maxBatchMessages, goes out as one work item that reads one dictionary version. An idle
+// server dispatches each request at once; a loaded one builds larger batches on its own.
+class HttpServer {
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;                             // Bytes received and not yet parsed
+        std::string out;                            // Bytes waiting to be sent
+        size_t outOffset = 0;
+        uint32_t events = 0;                        // Current epoll interest set
+        bool busy = false;                          // A request is with the workers; later ones wait
+        bool continueSent = false;                  // Sent "100 Continue" for the request being read
+        bool closeWhenSent = false;
+    };
+    
+    // One HTTP request waiting for, or being processed by, the workers
+    struct Job {
+        uint64_t connection;
+        bool batch;
+        bool keepAlive;
+        bool verdictOnly;                           // /verdict: status and score, no term list
+        PolicyMask policies;                        // /verdict?policies=...: one answer per policy
+        std::vector<std::string> messages;
+    };
+    
+    struct Completion {
+        uint64_t connection;
+        bool keepAlive;
+        std::string response;
+    };
+    
+    // Epoll tags for the two descriptors that are not connections
+    static constexpr uint64_t ListenTag = 0;
+    static constexpr uint64_t WakeTag = 1;
+    static constexpr size_t MaxHeaderBytes = 64 * 1024;
+    
+    ContentModerationSystem& cms;
+    ServerOptions options;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnection = WakeTag + 1;
+    
+    std::vector<Job> pending;
+    size_t batchesInFlight = 0;
+    uint64_t requestsDispatched = 0;
+    uint64_t batchesDispatched = 0;
+    
+    // Filled by the workers, drained by the loop after an eventfd wakeup
+    std::mutex completedMutex;
+    std::vector<Completion> completed;
+    size_t completedBatches = 0;
+    
+    // Declared last so it is destroyed first, while the members its tasks use still exist
+    std::unique_ptr<WorkStealingPool> pool;
+    
+    void updateEvents(uint64_t id, Connection& connection) {
+        uint32_t events = 0;
+        // Stop reading from a client that keeps sending while its request is being processed
+        if (!connection.busy || connection.in.size() < options.maxBodyBytes + MaxHeaderBytes) events |= EPOLLIN;
+        if (connection.outOffset < connection.out.size()) events |= EPOLLOUT;
+        if (events == connection.events) return;
+        
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+    
+    void closeConnection(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        ::close(it->second.fd);
+        connections.erase(it);
+    }
+    
+    // Send as much buffered output as the socket takes; returns false if the connection closed
+    bool flush(uint64_t id, Connection& connection) {
+        while (connection.outOffset < connection.out.size()) {
+            ssize_t sent = ::send(connection.fd, connection.out.data() + connection.outOffset,
+                                  connection.out.size() - connection.outOffset, MSG_NOSIGNAL);
+            if (sent > 0) {
+                connection.outOffset += static_cast<size_t>(sent);
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            closeConnection(id);
+            return false;
+        }
+        
+        if (connection.outOffset == connection.out.size()) {
+            connection.out.clear();
+            connection.outOffset = 0;
+            if (connection.closeWhenSent) {
+                closeConnection(id);
+                return false;
+            }
+        }
+        updateEvents(id, connection);
+        return true;
+    }
+    
+    void respond(Connection& connection, int status, std::string_view contentType, const std::string& body, bool keepAlive,
+                 std::string_view extraHeaders = {}) {
+        connection.out += httpResponse(status, contentType, body, keepAlive, extraHeaders);
+        if (!keepAlive) connection.closeWhenSent = true;
+    }
+    
+    // Parse and handle every complete request in the input buffer, stopping at one that has to
+    // wait for the workers so responses leave in request order
+    void handleInput(uint64_t id, Connection& connection) {
+        while (!connection.busy && !connection.closeWhenSent) {
+            size_t headerEnd = connection.in.find("\r\n\r\n");
+            if (headerEnd == std::string::npos) {
+                if (connection.in.size() > MaxHeaderBytes) {
+                    respond(connection, 431, "application/json", jsonError("request headers too large"), false);
+                }
+                break;
+            }
+            
+            std::string_view head(connection.in.data(), headerEnd);
+            size_t lineEnd = head.find("\r\n");
+            std::string_view requestLine = head.substr(0, lineEnd);
+            size_t firstSpace = requestLine.find(' ');
+            size_t secondSpace = requestLine.find(' ', firstSpace + 1);
+            if (firstSpace == std::string_view::npos || secondSpace == std::string_view::npos) {
+                respond(connection, 400, "application/json", jsonError("malformed request line"), false);
+                break;
+            }
+            std::string method(requestLine.substr(0, firstSpace));
+            std::string path(requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1));
+            std::string_view version = requestLine.substr(secondSpace + 1);
+            std::string query;
+            if (path.find('?') != std::string::npos) {
+                query = path.substr(path.find('?') + 1);
+                path.resize(path.find('?'));
+            }
+            
+            size_t contentLength = 0;
+            bool keepAlive = version == "HTTP/1.1";
+            bool expectContinue = false;
+            bool chunked = false;
+            bool plainText = false;
+            size_t lineStart = lineEnd == std::string_view::npos ? head.size() : lineEnd + 2;
+            while (lineStart < head.size()) {
+                size_t next = head.find("\r\n", lineStart);
+                if (next == std::string_view::npos) next = head.size();
+                std::string_view line = head.substr(lineStart, next - lineStart);
+                lineStart = next + 2;
+                
+                size_t colon = line.find(':');
+                if (colon == std::string_view::npos) continue;
+                std::string_view name = trim(line.substr(0, colon));
+                std::string_view value = trim(line.substr(colon + 1));
+                if (equalsIgnoreCase(name, "Content-Length")) {
+                    contentLength = static_cast<size_t>(std::strtoull(std::string(value).c_str(), nullptr, 10));
+                } else if (equalsIgnoreCase(name, "Connection")) {
+                    if (equalsIgnoreCase(value, "close")) keepAlive = false;
+                    if (equalsIgnoreCase(value, "keep-alive")) keepAlive = true;
+                } else if (equalsIgnoreCase(name, "Expect")) {
+                    expectContinue = equalsIgnoreCase(value, "100-continue");
+                } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+                    chunked = !equalsIgnoreCase(value, "identity");
+                } else if (equalsIgnoreCase(name, "Content-Type")) {
+                    plainText = value.substr(0, 10) == "text/plain";
+                }
+            }
+            
+            if (chunked) {
+                respond(connection, 501, "application/json", jsonError("chunked request bodies are not supported"), false);
+                break;
+            }
+            if (contentLength > options.maxBodyBytes) {
+                respond(connection, 413, "application/json", jsonError("request body too large"), false);
+                break;
+            }
+            
+            size_t bodyStart = headerEnd + 4;
+            if (connection.in.size() - bodyStart < contentLength) {
+                if (expectContinue && !connection.continueSent) {
+                    connection.out += "HTTP/1.1 100 Continue\r\n\r\n";
+                    connection.continueSent = true;
+                }
+                break;
+            }
+            
+            std::string body = connection.in.substr(bodyStart, contentLength);
+            connection.in.erase(0, bodyStart + contentLength);
+            connection.continueSent = false;
+            route(id, connection, method, path, query, body, plainText, keepAlive);
+        }
+    }
+    
+    // Value of one parameter of a query string, with only %2C (a comma) decoded; empty if absent
+    static std::string queryParameter(const std::string& query, const std::string& name) {
+        for (size_t start = 0; start < query.size();) {
+            size_t end = std::min(query.find('&', start), query.size());
+            std::string_view pair = std::string_view(query).substr(start, end - start);
+            if (pair.substr(0, name.size() + 1) == name + "=") {
+                std::string value(pair.substr(name.size() + 1));
+                for (size_t at; (at = value.find("%2C")) != std::string::npos || (at = value.find("%2c")) != std::string::npos;) {
+                    value.replace(at, 3, ",");
+                }
+                return value;
+            }
+            start = end + 1;
+        }
+        return "";
+    }
+    
+    void route(uint64_t id, Connection& connection, const std::string& method, const std::string& path,
+               const std::string& query, const std::string& body, bool plainText, bool keepAlive) {
+        bool verdictOnly = path == "/verdict" || path == "/verdict/batch";
+        if (path == "/moderate" || path == "/moderate/batch" || verdictOnly) {
+            if (method != "POST") {
+                respond(connection, 405, "application/json", jsonError("use POST"), keepAlive, "Allow: POST\r\n");
+                return;
+            }
+            
+            Job job{id, path == "/moderate/batch" || path == "/verdict/batch", keepAlive, verdictOnly, 0, {}};
+            if (verdictOnly) {
+                std::string unknown;
+                job.policies = cms.policies().parse(queryParameter(query, "policies"), &unknown);
+                if (!unknown.empty()) {
+                    respond(connection, 400, "application/json", jsonError("unknown policy: " + unknown), keepAlive);
+                    return;
+                }
+            }
+            bool valid = true;
+            if (!job.batch) {
+                job.messages.emplace_back();
+                size_t first = body.find_first_not_of(" \t\r\n");
+                bool json = !plainText && first != std::string::npos && (body[first] == '{' || body[first] == '"');
+                if (json) {
+                    valid = JsonReader(body).parseMessage(job.messages.back());
+                } else {
+                    job.messages.back() = body;
+                }
+            } else if (plainText) {
+                std::istringstream lines(body);
+                std::string line;
+                while (std::getline(lines, line)) {
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    job.messages.push_back(std::move(line));
+                }
+            } else {
+                valid = JsonReader(body).parseMessages(job.messages);
+            }
+            
+            if (!valid) {
+                respond(connection, 400, "application/json",
+                        jsonError(job.batch ? "expected a JSON array of strings or {\"messages\":[...]}"
+                                            : "expected {\"text\":\"...\"}, a JSON string or a text/plain body"), keepAlive);
+                return;
+            }
+            
+            connection.busy = true;
+            pending.push_back(std::move(job));
+            return;
+        }
+        
+        if (path == "/feedback") {
+            if (method != "POST") {
+                respond(connection, 405, "application/json", jsonError("use POST"), keepAlive, "Allow: POST\r\n");
+                return;
+            }
+            std::string verdict = queryParameter(query, "verdict");
+            if (verdict != "false_positive" && verdict != "correct") {
+                respond(connection, 400, "application/json", jsonError("verdict must be false_positive or correct"), keepAlive);
+                return;
+            }
+            
+            FeedbackEntry entry;
+            entry.falsePositive = verdict == "false_positive";
+            size_t first = body.find_first_not_of(" \t\r\n");
+            bool json = !plainText && first != std::string::npos && (body[first] == '{' || body[first] == '"');
+            if (!json) {
+                entry.content = body;
+            } else if (!JsonReader(body).parseMessage(entry.content)) {
+                respond(connection, 400, "application/json", jsonError("expected {\"text\":\"...\"}, a JSON string or a text/plain body"), keepAlive);
+                return;
+            }
+            
+            // The event loop only queues it; the maintenance thread logs it and updates the allowlist
+            if (!cms.submitFeedback(std::move(entry))) {
+                respond(connection, 503, "application/json", jsonError("feedback queue full"), keepAlive);
+                return;
+            }
+            respond(connection, 202, "application/json", "{\"queued\":true}\n", keepAlive);
+            return;
+        }
+        
+        if (path == "/stats" || path == "/metrics" || path == "/health") {
+            if (method != "GET" && method != "HEAD") {
+                respond(connection, 405, "application/json", jsonError("use GET"), keepAlive, "Allow: GET, HEAD\r\n");
+                return;
+            }
+            
+            std::ostringstream out;
+            std::string contentType = "application/json";
+            if (path == "/stats") {
+                writeMetricsJson(out, cms.collectMetrics());
+            } else if (path == "/metrics") {
+                writePrometheus(out, cms.collectMetrics());
+                contentType = "text/plain; version=0.0.4";
+            } else {
+                out << "{\"status\":\"ok\"}\n";
+            }
+            std::string response = httpResponse(200, contentType, out.str(), keepAlive);
+            // HEAD gets the headers of the GET response without its body
+            if (method == "HEAD") response.resize(response.size() - out.str().size());
+            connection.out += response;
+            if (!keepAlive) connection.closeWhenSent = true;
+            return;
+        }
+        
+        respond(connection, 404, "application/json", jsonError("no such endpoint: " + path), keepAlive);
+    }
+    
+    // Hand queued requests to idle workers, as many as fit in one batch each
+    void dispatch() {
+        size_t next = 0;
+        while (next < pending.size() && batchesInFlight < pool->size()) {
+            auto batch = std::make_shared<std::vector<Job>>();
+            size_t messages = 0;
+            while (next < pending.size() && (batch->empty() || messages + pending[next].messages.size() <= options.maxBatchMessages)) {
+                messages += pending[next].messages.size();
+                batch->push_back(std::move(pending[next++]));
+            }
+            requestsDispatched += batch->size();
+            ++batchesDispatched;
+            ++batchesInFlight;
+            pool->submit([this, batch] { processBatch(*batch); });
+        }
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(next));
+    }
+    
+    // Runs on a worker: moderate every message of the batch against one dictionary version
+    void processBatch(const std::vector<Job>& batch) {
+        std::vector<Completion> results;
+        results.reserve(batch.size());
+        
+        std::vector<std::string> policyNames;
+        for (const Job& job : batch) {
+            if (!job.policies) continue;
+            policyNames = cms.policies().all();
+            break;
+        }
+        
+        cms.withDictionary([&](const DictionaryVersion& dictionary) {
+            std::vector<TermMatch> matches;
+            for (const Job& job : batch) {
+                std::string body = job.batch ? "{\"results\":[" : "";
+                for (size_t i = 0; i < job.messages.size(); ++i) {
+                    if (job.policies) {
+                        PolicyVerdicts verdicts = dictionary.scorePolicies(job.messages[i], cms.getMatchMode(), job.policies,
+                                                                           cms.getVerdictThreshold());
+                        StageTimer timer(Stage::Output);
+                        if (i > 0) body.push_back(',');
+                        body.push_back('{');
+                        appendPolicyFields(body, verdicts, policyNames);
+                        body.push_back('}');
+                        continue;
+                    }
+                    if (job.verdictOnly) {
+                        Verdict verdict = cms.scoreText(dictionary, job.messages[i]);
+                        StageTimer timer(Stage::Output);
+                        if (i > 0) body.push_back(',');
+                        body.push_back('{');
+                        appendScoreFields(body, verdict);
+                        body.push_back('}');
+                        continue;
+                    }
+                    
+                    matches.clear();
+                    cms.findMatches(dictionary, job.messages[i], matches);
+                    cms.recordMatches(matches);
+                    
+                    StageTimer timer(Stage::Output);
+                    if (i > 0) body.push_back(',');
+                    body.push_back('{');
+                    appendVerdictFields(body, dictionary, matches);
+                    body.push_back('}');
+                }
+                body += job.batch ? "]}\n" : "\n";
+                results.push_back({job.connection, job.keepAlive, httpResponse(200, "application/json", body, job.keepAlive)});
+            }
+        });
+        
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            for (auto& result : results) completed.push_back(std::move(result));
+            ++completedBatches;
+        }
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeFd, &one, sizeof(one));
+        (void)written; // The counter only fails to grow if it is already huge, which still wakes the loop
+    }
+    
+    // Deliver finished responses; runs on the loop thread after a wakeup
+    void collectCompleted() {
+        uint64_t counter;
+        ssize_t drained = ::read(wakeFd, &counter, sizeof(counter));
+        (void)drained;
+        
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            ready.swap(completed);
+            batchesInFlight -= completedBatches;
+            completedBatches = 0;
+        }
+        
+        for (auto& completion : ready) {
+            auto it = connections.find(completion.connection);
+            if (it == connections.end()) continue; // The client went away meanwhile
+            Connection& connection = it->second;
+            connection.out += completion.response;
+            connection.busy = false;
+            if (!completion.keepAlive) connection.closeWhenSent = true;
+            
+            // Requests pipelined behind this one can go now
+            handleInput(completion.connection, connection);
+            flush(completion.connection, connection);
+        }
+    }
+    
+    void acceptConnections() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    cms.reportStatus(std::string("Error accepting connection: ") + std::strerror(errno));
+                }
+                return;
+            }
+            
+            // Responses are written whole, so there is nothing to gain from Nagle's delay
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            
+            uint64_t id = nextConnection++;
+            Connection& connection = connections[id];
+            connection.fd = fd;
+            connection.events = EPOLLIN;
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+    
+    void readConnection(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        Connection& connection = it->second;
+        
+        char buffer[64 * 1024];
+        while (true) {
+            ssize_t received = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                connection.in.append(buffer, static_cast<size_t>(received));
+                if (static_cast<size_t>(received) < sizeof(buffer)) break;
+                continue;
+            }
+            if (received < 0 && errno == EINTR) continue;
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            // Orderly shutdown or error; a request still with the workers is dropped on completion
+            closeConnection(id);
+            return;
+        }
+        
+        handleInput(id, connection);
+        flush(id, connection);
+    }
+
+public:
+    HttpServer(ContentModerationSystem& cms, const ServerOptions& options) : cms(cms), options(options) {}
+    
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+    
+    ~HttpServer() {
+        pool.reset();
+        for (auto& [id, connection] : connections) ::close(connection.fd);
+        if (listenFd >= 0) ::close(listenFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+        if (epollFd >= 0) ::close(epollFd);
+    }
+    
+    bool start() {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(options.port);
+        std::string host = options.host == "localhost" ? "127.0.0.1" : options.host;
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            std::cerr << "Invalid listen address: " << options.host << std::endl;
+            return false;
+        }
+        
+        listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+            std::cerr << "Error listening on " << options.host << ":" << options.port << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) {
+            std::cerr << "Error creating event loop: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = ListenTag;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+        event.data.u64 = WakeTag;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+        
+        pool = std::make_unique<WorkStealingPool>(options.threads);
+        return true;
+    }
+    
+    // How well requests were coalesced, for the shutdown summary
+    std::string summary() const {
+        std::ostringstream out;
+        out << requestsDispatched << " moderation requests in " << batchesDispatched << " batches";
+        if (batchesDispatched > 0) {
+            out << " (" << static_cast<double>(requestsDispatched) / static_cast<double>(batchesDispatched) << " per batch)";
+        }
+        return out.str();
+    }
+    
+    void run() {
+        std::vector<epoll_event> events(256);
+        while (!serverStopRequested.load()) {
+            // The timeout only bounds how long a stop request can go unnoticed
+            int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 500);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Error waiting for events: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            
+            for (int i = 0; i < count; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == ListenTag) {
+                    acceptConnections();
+                } else if (tag == WakeTag) {
+                    collectCompleted();
+                } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readConnection(tag);
+                } else if (events[i].events & EPOLLOUT) {
+                    auto it = connections.find(tag);
+                    if (it != connections.end()) flush(tag, it->second);
+                }
+            }
+            
+            // Everything that arrived during this wakeup is batched together
+            dispatch();
+        }
+    }
+};
+
+int runServer(ContentModerationSystem& cms, const ServerOptions& options) {
+    std::ios::sync_with_stdio(false);
+    cms.setStatusStream(std::cerr);
+    if (!std::ifstream(options.bannedWordsFile).good()) {
+        createSampleBannedWordsFile(options.bannedWordsFile, std::cerr);
+    }
+    if (!cms.loadBannedWords(options.bannedWordsFile)) return 1;
+    cms.watchBannedWordsFile(options.bannedWordsFile);
+    
+    HttpServer server(cms, options);
+    if (!server.start()) return 1;
+    
+    std::signal(SIGINT, requestServerStop);
+    std::signal(SIGTERM, requestServerStop);
+    cms.reportStatus("Listening on http://" + options.host + ":" + std::to_string(options.port) + " with "
+                     + std::to_string(options.threads) + " workers");
+    server.run();
+    cms.reportStatus("Server stopped after " + server.summary());
+    return 0;
+}
+
+#else
+
+int runServer(ContentModerationSystem&, const ServerOptions&) {
+    std::cerr << "serve needs epoll and is only available on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "moderation/content_moderation_system.h"
+
+// Options for `serve`
+struct ServerOptions {
+    std::string host = "127.0.0.1";                 // 0.0.0.0 to accept connections from other hosts
+    uint16_t port = 8080;
+    std::string bannedWordsFile = "banned_words.txt";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxBatchMessages = 512;                  // Messages coalesced into one work item at most
+    size_t maxBodyBytes = 1 << 20;
+};
+
+// Entry point for `serve`: an HTTP/1.1 moderation service on an epoll event loop.
+//   POST /moderate        {"text":"..."}, a JSON string, or a raw text/plain body
+//   POST /moderate/batch  ["...", ...], {"messages":[...]}, or text/plain with one message per line
+//   POST /verdict[/batch] as /moderate, answering only status and score (see --threshold)
+//   POST /verdict[/batch]?policies=a,b  as /verdict, answering for each policy from one scan
+//   GET  /stats           statistics as JSON, the same object as `stats --json`
+//   GET  /metrics         Prometheus text format
+//   GET  /health          liveness check
+// Runs until SIGINT or SIGTERM.
+int runServer(ContentModerationSystem& cms, const ServerOptions& options);
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+// Read-only view of a whole file. It is mapped with mmap where available so large files are
+// paged in on demand; elsewhere the contents are read into memory.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef __linux__
+    void* mapping = nullptr;
+#else
+    std::vector<char> buffer;
+#endif
+
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename) { open(filename); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const std::string& filename) {
+        close();
+#ifdef __linux__
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        if (ok && info.st_size > 0) {
+            void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ok = false;
+            } else {
+                mapping = address;
+                bytes = static_cast<const char*>(address);
+                length = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+        return ok;
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) return false;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#endif
+    }
+    
+    void close() {
+#ifdef __linux__
+        if (mapping) munmap(mapping, length);
+        mapping = nullptr;
+#else
+        buffer.clear();
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+    
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    
+    // Tell the kernel the file will be read front to back, so it reads ahead aggressively
+    void adviseSequential() const {
+#ifdef __linux__
+        if (mapping) madvise(mapping, length, MADV_SEQUENTIAL);
+#endif
+    }
+    
+    // Drop the pages of [offset, offset + size) that are no longer needed; the whole pages
+    // inside the range only, since its ends may share pages with data still being read
+    void release(size_t offset, size_t size) const {
+#ifdef __linux__
+        if (!mapping) return;
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin = (offset + page - 1) / page * page;
+        size_t end = (offset + size) / page * page;
+        if (end > begin) madvise(static_cast<char*>(mapping) + begin, end - begin, MADV_DONTNEED);
+#else
+        (void)offset;
+        (void)size;
+#endif
+    }
+};
@@ -0,0 +1,273 @@
+#include "moderation/match_stream.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+    // Bytes of the UTF-8 character a lead byte starts; 1 for ASCII and for bytes that start none
+    size_t sequenceLength(unsigned char lead) {
+        if (lead >= 0xF0 && lead <= 0xF7) return 4;
+        if (lead >= 0xE0 && lead < 0xF0) return 3;
+        if (lead >= 0xC0 && lead < 0xE0) return 2;
+        return 1;
+    }
+    
+    bool isTokenMode(MatchMode mode) {
+        return mode == MatchMode::Token || mode == MatchMode::Fuzzy;
+    }
+}
+
+void MatchStream::begin(const DictionaryVersion& version, MatchMode matchMode) {
+    dictionary = version;
+    mode = matchMode;
+    offset = 0;
+    matchCount = 0;
+    carry.clear();
+    carryOffset = 0;
+    overlong = false;
+    partial.clear();
+    partialOffset = 0;
+    found.clear();
+    queue.clear();
+    phrases.clear();
+    unplaced = 0;
+    phraseReach = dictionary.allow ? dictionary.allow->maxPhraseLength() : 0;
+    
+    const DictionarySnapshot* snapshots[2] = {dictionary.base.get(), dictionary.delta.get()};
+    for (size_t i = 0; i < 2; ++i) {
+        Lane& lane = lanes[i];
+        lane.snapshot = snapshots[i]->termCount() > 0 ? snapshots[i] : nullptr;
+        lane.state = DictionarySnapshot::StreamState();
+        
+        // The ring reaches back over the longest term, so every match still finds its first byte
+        size_t size = 1;
+        while (size <= snapshots[i]->maxTermLength()) size <<= 1;
+        lane.recent.assign(lane.snapshot ? size : 0, RawSpan());
+        lane.mask = size - 1;
+    }
+}
+
+void MatchStream::feed(std::string_view chunk, std::vector<TermMatch>& matches) {
+    if (isTokenMode(mode)) {
+        feedTokenizer(chunk, matches);
+    } else {
+        feedAutomaton(chunk, offset, matches);
+    }
+    offset += chunk.size();
+}
+
+void MatchStream::finish(std::vector<TermMatch>& matches) {
+    bool tokens = isTokenMode(mode);
+    if (tokens && !overlong && !carry.empty()) feedTokens(carry, carryOffset, matches);
+    if (!tokens || phraseReach > 0) {
+        // A character cut short by the end of the text is fed as it is
+        if (!partial.empty()) feedPiece(partial, partialOffset, matches);
+        
+        found.clear();
+        for (Lane& lane : lanes) {
+            if (!lane.snapshot) continue;
+            size_t split = found.size();
+            lane.snapshot->finishStream(lane.state, [&](int local, size_t, uint64_t last) {
+                record(lane, local, last);
+                return true;
+            });
+            mergeFound(split);
+        }
+        settle(matches, true);
+    }
+    carry.clear();
+    partial.clear();
+    overlong = false;
+    processMetrics().recordMessage(offset, matchCount);
+}
+
+void MatchStream::feedAutomaton(std::string_view chunk, uint64_t chunkOffset, std::vector<TermMatch>& matches) {
+    // Complete the character the last chunk ended in the middle of
+    if (!partial.empty()) {
+        size_t missing = sequenceLength(static_cast<unsigned char>(partial[0])) - partial.size();
+        size_t take = std::min(missing, chunk.size());
+        partial.append(chunk.substr(0, take));
+        chunk.remove_prefix(take);
+        chunkOffset += take;
+        if (take < missing) return;
+        feedPiece(partial, partialOffset, matches);
+        partial.clear();
+    }
+    
+    // Hold back a character this chunk ends in the middle of: its lead byte is among the last three
+    size_t cut = chunk.size();
+    for (size_t back = 1; back <= 3 && back <= chunk.size(); ++back) {
+        auto byte = static_cast<unsigned char>(chunk[chunk.size() - back]);
+        if (byte < 0x80) break;
+        if (byte >= 0xC0) {
+            if (sequenceLength(byte) > back) cut = chunk.size() - back;
+            break;
+        }
+    }
+    feedPiece(chunk.substr(0, cut), chunkOffset, matches);
+    partial.assign(chunk.substr(cut));
+    partialOffset = chunkOffset + cut;
+}
+
+void MatchStream::feedPiece(std::string_view piece, uint64_t pieceOffset, std::vector<TermMatch>& matches) {
+    if (piece.empty()) return;
+    bool folded = false;
+    if (!Utf8::isAscii(piece)) {
+        StageTimer timer(Stage::Normalize);
+        folded = normalizer.normalize(piece);
+    }
+    std::string_view input = folded ? std::string_view(normalizer.text()) : piece;
+    
+    StageTimer timer(Stage::Match);
+    found.clear();
+    bool tokens = isTokenMode(mode);
+    for (Lane& lane : lanes) {
+        if (!lane.snapshot) continue;
+        size_t split = found.size();
+        auto onFed = [&](size_t i, uint64_t index) {
+            RawSpan& span = lane.recent[index & lane.mask];
+            span.start = pieceOffset + (folded ? normalizer.rawStart(i) : i);
+            span.end = pieceOffset + (folded ? normalizer.rawEnd(i) : i + 1);
+            
+            // A queued token is placed at the first normalized byte of its word
+            while (tokens && unplaced < queue.size() && queue[unplaced].wordStart < span.end) queue[unplaced++].first = index;
+        };
+        lane.snapshot->feedStream(input, mode, lane.state, onFed, [&](int local, size_t, uint64_t last) {
+            record(lane, local, last);
+            return true;
+        });
+        mergeFound(split);
+    }
+    settle(matches, false);
+}
+
+void MatchStream::record(const Lane& lane, int local, uint64_t last) {
+    uint64_t first = last + 1 - lane.snapshot->term(local).size();
+    uint64_t start = lane.recent[first & lane.mask].start;
+    uint64_t end = lane.recent[last & lane.mask].end;
+    Queued item;
+    item.match = {start, end - start, lane.snapshot->termId(local)};
+    item.first = first;
+    item.last = last;
+    found.push_back(item);
+}
+
+void MatchStream::mergeFound(size_t split) {
+    if (split == 0 || split == found.size()) return;
+    std::inplace_merge(found.begin(), found.begin() + static_cast<std::ptrdiff_t>(split), found.end(),
+        [](const Queued& a, const Queued& b) { return a.last < b.last; });
+}
+
+void MatchStream::settle(std::vector<TermMatch>& matches, bool end) {
+    const AllowList* allow = dictionary.allow.get();
+    if (!allow) {
+        for (const Queued& item : found) matches.push_back(item.match);
+        matchCount += found.size();
+        found.clear();
+        return;
+    }
+    
+    // In the token modes the automaton only looks for phrases; the tokens are queued already
+    bool tokens = isTokenMode(mode);
+    for (Queued& item : found) {
+        AllowList::Kind kind = allow->kind(item.match.termId);
+        if (kind == AllowList::Phrase) {
+            phrases.push_back({item.match.offset, item.match.offset + item.match.length, item.last});
+        } else if (!tokens) {
+            item.held = kind == AllowList::Covered;
+            queue.push_back(item);
+        }
+    }
+    found.clear();
+    
+    auto covered = [&](const Queued& item) {
+        uint64_t start = item.token ? item.wordStart : item.match.offset;
+        uint64_t end = item.token ? item.wordEnd : item.match.offset + item.match.length;
+        for (const Phrase& phrase : phrases) {
+            if (phrase.start <= start && end <= phrase.end) return true;
+        }
+        return false;
+    };
+    
+    // Pass matches on in order up to the first one a phrase not yet complete could still cover
+    uint64_t fed = 0;
+    for (const Lane& lane : lanes) fed = std::max(fed, lane.state.fed);
+    size_t settled = 0;
+    for (; settled < queue.size(); ++settled) {
+        const Queued& item = queue[settled];
+        if (!end && item.held && (item.first == Unplaced || item.first + phraseReach >= fed)) break;
+        if (!covered(item)) {
+            matches.push_back(item.match);
+            ++matchCount;
+        }
+    }
+    queue.erase(queue.begin(), queue.begin() + static_cast<std::ptrdiff_t>(settled));
+    unplaced -= std::min(unplaced, settled);
+    
+    // A phrase that ends before every queued match starts can cover none of them, nor any match found later
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const Queued& item : queue) oldest = std::min(oldest, item.first);
+    phrases.erase(std::remove_if(phrases.begin(), phrases.end(),
+        [&](const Phrase& phrase) { return phrase.last < oldest; }), phrases.end());
+}
+
+void MatchStream::feedTokenizer(std::string_view chunk, std::vector<TermMatch>& matches) {
+    const unsigned char* classes = TextClass::table();
+    auto isSpace = [&](char c) { return classes[static_cast<unsigned char>(c)] == TextClass::Space; };
+    size_t firstSpace = 0;
+    while (firstSpace < chunk.size() && !isSpace(chunk[firstSpace])) ++firstSpace;
+    
+    // The token the last chunk ended in goes on up to the first whitespace of this one. The
+    // bytes of a run too long for a token still go to the automaton, which looks for phrases.
+    if (!overlong) {
+        if (carry.size() + firstSpace > MaxCarryBytes) {
+            if (phraseReach > 0) feedAutomaton(carry, carryOffset, matches);
+            carry.clear();
+            overlong = true;
+        } else {
+            if (carry.empty()) carryOffset = offset;
+            carry.append(chunk.substr(0, firstSpace));
+        }
+    }
+    if (overlong && phraseReach > 0) feedAutomaton(chunk.substr(0, firstSpace), offset, matches);
+    if (firstSpace == chunk.size()) return;
+    if (!overlong && !carry.empty()) feedTokens(carry, carryOffset, matches);
+    carry.clear();
+    overlong = false;
+    
+    // Everything up to the last whitespace is whole tokens; the rest is carried to the next chunk
+    size_t lastSpace = chunk.size();
+    while (!isSpace(chunk[lastSpace - 1])) --lastSpace;
+    feedTokens(chunk.substr(firstSpace, lastSpace - firstSpace), offset + firstSpace, matches);
+    carry.assign(chunk.substr(lastSpace));
+    carryOffset = offset + lastSpace;
+}
+
+void MatchStream::feedTokens(std::string_view piece, uint64_t pieceOffset, std::vector<TermMatch>& matches) {
+    size_t first = matches.size();
+    dictionary.collectMatches(piece, mode, matches);
+    if (phraseReach == 0) {
+        for (size_t i = first; i < matches.size(); ++i) matches[i].offset += pieceOffset;
+        matchCount += matches.size() - first;
+        return;
+    }
+    
+    // The phrases inside the piece are applied already; one may still reach past either end of it
+    for (size_t i = first; i < matches.size(); ++i) {
+        Queued item;
+        item.match = matches[i];
+        item.match.offset += pieceOffset;
+        item.first = Unplaced;
+        item.last = Unplaced;
+        item.held = dictionary.allow->kind(item.match.termId) == AllowList::Covered;
+        item.token = true;
+        AllowScan::Span word = AllowList::tokenSpan(piece, matches[i].offset, matches[i].length);
+        item.wordStart = pieceOffset + word.start;
+        item.wordEnd = pieceOffset + word.end + 1;
+        queue.push_back(item);
+    }
+    matches.resize(first);
+    
+    // The automaton gets the same pieces right after, so it reaches every token after it is queued
+    feedAutomaton(piece, pieceOffset, matches);
+}
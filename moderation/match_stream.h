@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/dictionary_version.h"
+
+// Matches one text that arrives in pieces, such as an upload or a transcript too large to hold
+// in memory, against one dictionary version: begin(), feed() each chunk as it comes, finish().
+// Matches come out with offsets into the whole text, in order of where they end, as soon as
+// the chunks that complete them have been fed. Memory stays constant whatever the text's size:
+// the word and substring modes carry their automaton state across chunks and remember the raw
+// offsets of only as many normalized bytes as the longest term has, and the token modes carry
+// only the token a chunk ends in the middle of. With an allowlist, the token modes also run the
+// word automaton over the pieces they look up, for the phrases that may lie around their tokens.
+class MatchStream {
+public:
+    static constexpr size_t MaxCarryBytes = 64 << 10;   // A longer run without whitespace is no term
+
+private:
+    // Raw bytes behind one normalized byte, [start, end) in the whole text
+    struct RawSpan {
+        uint64_t start = 0;
+        uint64_t end = 0;
+    };
+    
+    // Automaton state of base or delta, and a ring of the raw spans of the last bytes it was fed
+    struct Lane {
+        const DictionarySnapshot* snapshot = nullptr;
+        DictionarySnapshot::StreamState state;
+        std::vector<RawSpan> recent;
+        uint64_t mask = 0;
+    };
+    
+    // A match found in a piece, or waiting for the scan to get past every allowlisted phrase
+    // that could cover it
+    struct Queued {
+        TermMatch match;
+        uint64_t first;             // Indexes of its first and last normalized bytes
+        uint64_t last;
+        bool held = false;          // Its term occurs inside some phrase
+        bool token = false;         // Found by a token lookup: first is Unplaced until fed to the automaton
+        uint64_t wordStart = 0;     // Token: raw span of the word without its punctuation, [start, end)
+        uint64_t wordEnd = 0;
+    };
+    
+    static constexpr uint64_t Unplaced = UINT64_MAX;
+    
+    struct Phrase {
+        uint64_t start;
+        uint64_t end;               // One past its last raw byte
+        uint64_t last;              // Index of its last normalized byte
+    };
+    
+    DictionaryVersion dictionary;   // A copy: it keeps the snapshots alive for as long as the stream runs
+    MatchMode mode = MatchMode::WordBoundary;
+    uint64_t offset = 0;            // Raw bytes fed so far
+    size_t matchCount = 0;
+    
+    // Bytes held back from the last chunk: an unfinished token in the token modes, and an
+    // unfinished UTF-8 character for the automaton
+    std::string carry;
+    uint64_t carryOffset = 0;
+    bool overlong = false;          // Token modes: dropping the rest of a run longer than MaxCarryBytes
+    std::string partial;
+    uint64_t partialOffset = 0;
+    
+    Lane lanes[2];
+    Utf8Normalizer normalizer;
+    std::vector<Queued> found;
+    std::vector<Queued> queue;
+    std::vector<Phrase> phrases;
+    size_t phraseReach = 0;         // Normalized length of the longest allowlisted phrase
+    size_t unplaced = 0;            // Token modes: first queued token the automaton has not reached
+    
+    // Feed a piece that ends on a character boundary to both automatons
+    void feedPiece(std::string_view piece, uint64_t pieceOffset, std::vector<TermMatch>& matches);
+    
+    // Add a match of a lane to found, by the index of its last normalized byte
+    void record(const Lane& lane, int local, uint64_t last);
+    
+    // Merge the matches a lane added to found from `split` on with those before, by where they end
+    void mergeFound(size_t split);
+    
+    // Feed a piece that ends on whitespace to the per-token lookups; with an allowlist, their
+    // matches are queued until the automaton has found the phrases around them
+    void feedTokens(std::string_view piece, uint64_t pieceOffset, std::vector<TermMatch>& matches);
+    
+    // Queue the matches of a piece, apply the allowlist and pass on every match that is settled;
+    // at the end of the text everything is
+    void settle(std::vector<TermMatch>& matches, bool end);
+    
+    void feedAutomaton(std::string_view chunk, uint64_t chunkOffset, std::vector<TermMatch>& matches);
+    void feedTokenizer(std::string_view chunk, std::vector<TermMatch>& matches);
+
+public:
+    // Start a new text against a dictionary version, which is copied, in the given mode
+    void begin(const DictionaryVersion& version, MatchMode matchMode);
+    
+    // Feed the next chunk; the matches it settles are appended to matches
+    void feed(std::string_view chunk, std::vector<TermMatch>& matches);
+    
+    // End the text; the matches still open are appended to matches
+    void finish(std::vector<TermMatch>& matches);
+    
+    uint64_t bytesFed() const {
+        return offset;
+    }
+    
+    // Matches reported since begin()
+    size_t matches() const {
+        return matchCount;
+    }
+};
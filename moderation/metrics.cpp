@@ -0,0 +1,280 @@
+#include "moderation/metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "moderation/text.h"
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Normalize: return "normalize";
+        case Stage::Match: return "match";
+        case Stage::Expand: return "expand";
+        case Stage::Output: return "output";
+        default: return "unknown";
+    }
+}
+
+uint64_t LatencySummary::quantile(double q) const {
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::max(1.0, q * static_cast<double>(total) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(HistogramBuckets::highest(i), maxNanos);
+    }
+    return maxNanos;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+    MetricsSnapshot result;
+    for (const auto& slot : shards) {
+        const Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) continue;
+        
+        for (size_t s = 0; s < StageCount; ++s) {
+            LatencySummary& summary = result.stages[s];
+            for (size_t i = 0; i < HistogramBuckets::Count; ++i) {
+                uint64_t count = shard->buckets[s][i].load(std::memory_order_relaxed);
+                summary.counts[i] += count;
+                summary.total += count;
+            }
+            summary.sumNanos += shard->sumNanos[s].load(std::memory_order_relaxed);
+            summary.maxNanos = std::max(summary.maxNanos, shard->maxNanos[s].load(std::memory_order_relaxed));
+        }
+        result.messages += shard->messages.load(std::memory_order_relaxed);
+        result.bytes += shard->bytes.load(std::memory_order_relaxed);
+        result.matches += shard->matches.load(std::memory_order_relaxed);
+        result.flaggedMessages += shard->flaggedMessages.load(std::memory_order_relaxed);
+        result.prefilter.tokens += shard->prefilterTokens.load(std::memory_order_relaxed);
+        result.prefilter.rejected += shard->prefilterRejected.load(std::memory_order_relaxed);
+        result.prefilter.falsePositives += shard->prefilterFalsePositives.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+Metrics& processMetrics() {
+    static Metrics instance;
+    return instance;
+}
+
+namespace {
+    // Bucket bounds exported to Prometheus, in seconds; the HDR buckets are far too many to export
+    const double PrometheusBounds[] = {
+        1e-7, 2.5e-7, 5e-7, 1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+        1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0
+    };
+    
+    const double ExportedQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    
+    double seconds(uint64_t nanos) {
+        return static_cast<double>(nanos) / 1e9;
+    }
+    
+    // Share of tokens the prefilter settled on its own
+    double rejectionRate(const PrefilterCounts& counts) {
+        return counts.tokens ? static_cast<double>(counts.rejected) / static_cast<double>(counts.tokens) : 0.0;
+    }
+    
+    // Share of the tokens not in the dictionary that the prefilter let through
+    double falsePositiveRate(const PrefilterCounts& counts) {
+        uint64_t absent = counts.rejected + counts.falsePositives;
+        return absent ? static_cast<double>(counts.falsePositives) / static_cast<double>(absent) : 0.0;
+    }
+    
+    void writeCounter(std::ostream& out, const char* name, const char* help, uint64_t value) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " counter\n";
+        out << name << " " << value << "\n";
+    }
+    
+    // A term as a Prometheus label value
+    std::string labelValue(const std::string& term) {
+        std::string label;
+        for (char c : term) {
+            if (c == '\\' || c == '"') label.push_back('\\');
+            if (c == '\n') {
+                label += "\\n";
+                continue;
+            }
+            label.push_back(c);
+        }
+        return label;
+    }
+    
+    const char* const RateWindows[] = {"1m", "5m", "1h"};
+}
+
+void writePrometheus(std::ostream& out, const MetricsSnapshot& snapshot) {
+    out << std::setprecision(9);
+    for (const auto& gauge : snapshot.gauges) {
+        out << "# HELP " << gauge.name << " " << gauge.help << "\n";
+        out << "# TYPE " << gauge.name << " gauge\n";
+        out << gauge.name << " " << gauge.value << "\n";
+    }
+    
+    if (!snapshot.topTerms.empty()) {
+        out << "# HELP moderation_term_flags_total Occurrences of the most frequently flagged terms.\n";
+        out << "# TYPE moderation_term_flags_total counter\n";
+        for (const auto& [term, count] : snapshot.topTerms) {
+            out << "moderation_term_flags_total{term=\"" << labelValue(term) << "\"} " << count << "\n";
+        }
+    }
+    
+    if (!snapshot.termRates.empty()) {
+        out << "# HELP moderation_term_recent_flags Flags within a sliding window, of the top and bursting terms.\n";
+        out << "# TYPE moderation_term_recent_flags gauge\n";
+        for (const auto& rate : snapshot.termRates) {
+            for (size_t w = 0; w < 3; ++w) {
+                out << "moderation_term_recent_flags{term=\"" << labelValue(rate.term) << "\",window=\"" << RateWindows[w] << "\"} "
+                    << rate.flags[w] << "\n";
+            }
+        }
+        out << "# HELP moderation_term_burst_ratio Flag rate of the last minute over that of the rest of the hour.\n";
+        out << "# TYPE moderation_term_burst_ratio gauge\n";
+        for (const auto& rate : snapshot.termRates) {
+            out << "moderation_term_burst_ratio{term=\"" << labelValue(rate.term) << "\"} " << rate.burstRatio << "\n";
+        }
+    }
+    
+    // Scan counters and stage latencies only exist when the instrumentation is compiled in
+    if constexpr (!MetricsEnabled) return;
+    
+    writeCounter(out, "moderation_messages_total", "Messages scanned.", snapshot.messages);
+    writeCounter(out, "moderation_bytes_total", "Bytes of message text scanned.", snapshot.bytes);
+    writeCounter(out, "moderation_matches_total", "Dictionary matches found.", snapshot.matches);
+    writeCounter(out, "moderation_flagged_messages_total", "Messages with at least one match.", snapshot.flaggedMessages);
+    writeCounter(out, "moderation_prefilter_tokens_total", "Tokens checked against the token prefilter.", snapshot.prefilter.tokens);
+    writeCounter(out, "moderation_prefilter_rejected_total", "Tokens the prefilter rejected without a Trie lookup.",
+                 snapshot.prefilter.rejected);
+    writeCounter(out, "moderation_prefilter_false_positives_total", "Tokens the prefilter passed that were not banned.",
+                 snapshot.prefilter.falsePositives);
+    
+    out << "# HELP moderation_stage_latency_seconds Time spent per message in each pipeline stage.\n";
+    out << "# TYPE moderation_stage_latency_seconds histogram\n";
+    for (size_t s = 0; s < StageCount; ++s) {
+        const LatencySummary& summary = snapshot.stages[s];
+        const char* stage = stageName(static_cast<Stage>(s));
+        
+        // A bucket is counted under a bound once every value it can hold is within the bound
+        size_t bucket = 0;
+        uint64_t cumulative = 0;
+        for (double bound : PrometheusBounds) {
+            while (bucket < HistogramBuckets::Count && seconds(HistogramBuckets::highest(bucket)) <= bound) {
+                cumulative += summary.counts[bucket++];
+            }
+            out << "moderation_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"" << bound << "\"} "
+                << cumulative << "\n";
+        }
+        out << "moderation_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"+Inf\"} " << summary.total << "\n";
+        out << "moderation_stage_latency_seconds_sum{stage=\"" << stage << "\"} " << seconds(summary.sumNanos) << "\n";
+        out << "moderation_stage_latency_seconds_count{stage=\"" << stage << "\"} " << summary.total << "\n";
+    }
+    
+    out << "# HELP moderation_stage_latency_quantile_seconds Stage latency quantiles, accurate to about 6%.\n";
+    out << "# TYPE moderation_stage_latency_quantile_seconds gauge\n";
+    for (size_t s = 0; s < StageCount; ++s) {
+        for (double q : ExportedQuantiles) {
+            out << "moderation_stage_latency_quantile_seconds{stage=\"" << stageName(static_cast<Stage>(s))
+                << "\",quantile=\"" << q << "\"} " << seconds(snapshot.stages[s].quantile(q)) << "\n";
+        }
+    }
+}
+
+void writeMetricsJson(std::ostream& out, const MetricsSnapshot& snapshot) {
+    std::string json = "{\"gauges\":{";
+    for (size_t i = 0; i < snapshot.gauges.size(); ++i) {
+        if (i > 0) json.push_back(',');
+        appendJsonString(json, snapshot.gauges[i].name);
+        std::ostringstream value;
+        value << std::setprecision(12) << snapshot.gauges[i].value;
+        json += ":" + value.str();
+    }
+    
+    json += "},\"top_terms\":[";
+    for (size_t i = 0; i < snapshot.topTerms.size(); ++i) {
+        if (i > 0) json.push_back(',');
+        json += "{\"term\":";
+        appendJsonString(json, snapshot.topTerms[i].first);
+        json += ",\"count\":" + std::to_string(snapshot.topTerms[i].second) + "}";
+    }
+    json += "]";
+    
+    json += ",\"term_rates\":[";
+    for (size_t i = 0; i < snapshot.termRates.size(); ++i) {
+        const auto& rate = snapshot.termRates[i];
+        if (i > 0) json.push_back(',');
+        json += "{\"term\":";
+        appendJsonString(json, rate.term);
+        std::ostringstream values;
+        values << std::setprecision(6) << ",\"flags\":{";
+        for (size_t w = 0; w < 3; ++w) values << (w ? ",\"" : "\"") << RateWindows[w] << "\":" << rate.flags[w];
+        values << "},\"burst_ratio\":" << rate.burstRatio << ",\"bursting\":" << (rate.bursting ? "true" : "false") << "}";
+        json += values.str();
+    }
+    json += "]";
+    
+    if constexpr (MetricsEnabled) {
+        json += ",\"messages\":" + std::to_string(snapshot.messages);
+        json += ",\"bytes\":" + std::to_string(snapshot.bytes);
+        json += ",\"matches\":" + std::to_string(snapshot.matches);
+        json += ",\"flagged_messages\":" + std::to_string(snapshot.flaggedMessages);
+        std::ostringstream rates;
+        rates << std::setprecision(6) << ",\"rejection_rate\":" << rejectionRate(snapshot.prefilter)
+              << ",\"false_positive_rate\":" << falsePositiveRate(snapshot.prefilter);
+        json += ",\"prefilter\":{\"tokens\":" + std::to_string(snapshot.prefilter.tokens);
+        json += ",\"rejected\":" + std::to_string(snapshot.prefilter.rejected);
+        json += ",\"false_positives\":" + std::to_string(snapshot.prefilter.falsePositives) + rates.str() + "}";
+        json += ",\"stages\":{";
+        for (size_t s = 0; s < StageCount; ++s) {
+            const LatencySummary& summary = snapshot.stages[s];
+            if (s > 0) json.push_back(',');
+            json += "\"" + std::string(stageName(static_cast<Stage>(s))) + "\":{\"count\":" + std::to_string(summary.total);
+            json += ",\"mean_ns\":" + std::to_string(static_cast<uint64_t>(summary.meanNanos()));
+            json += ",\"p50_ns\":" + std::to_string(summary.quantile(0.5));
+            json += ",\"p90_ns\":" + std::to_string(summary.quantile(0.9));
+            json += ",\"p99_ns\":" + std::to_string(summary.quantile(0.99));
+            json += ",\"p999_ns\":" + std::to_string(summary.quantile(0.999));
+            json += ",\"max_ns\":" + std::to_string(summary.maxNanos) + "}";
+        }
+        json += "}";
+    }
+    
+    json += "}";
+    out << json << std::endl;
+}
+
+void writeStageTable(std::ostream& out, const MetricsSnapshot& snapshot) {
+    if constexpr (!MetricsEnabled) {
+        out << "Stage timings: not compiled in" << std::endl;
+        return;
+    }
+    
+    out << "Scanned: " << snapshot.messages << " messages, " << snapshot.bytes << " bytes, "
+        << snapshot.matches << " matches (" << snapshot.flaggedMessages << " messages flagged)" << std::endl;
+    if (snapshot.prefilter.tokens > 0) {
+        std::ios::fmtflags flags = out.flags();
+        out << "Token prefilter: " << snapshot.prefilter.tokens << " tokens, " << std::fixed << std::setprecision(1)
+            << 100.0 * rejectionRate(snapshot.prefilter) << "% rejected without a Trie lookup, "
+            << std::setprecision(2) << 100.0 * falsePositiveRate(snapshot.prefilter) << "% false positives" << std::endl;
+        out.flags(flags);
+    }
+    
+    out << "Stage timings (microseconds):" << std::endl;
+    out << std::left << std::setw(12) << "  stage" << std::right << std::setw(10) << "count" << std::setw(10) << "mean"
+        << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    for (size_t s = 0; s < StageCount; ++s) {
+        const LatencySummary& summary = snapshot.stages[s];
+        if (summary.total == 0) continue;
+        out << "  " << std::left << std::setw(10) << stageName(static_cast<Stage>(s)) << std::right
+            << std::setw(10) << summary.total << std::setw(10) << summary.meanNanos() / 1000.0
+            << std::setw(10) << static_cast<double>(summary.quantile(0.5)) / 1000.0
+            << std::setw(10) << static_cast<double>(summary.quantile(0.99)) / 1000.0
+            << std::setw(10) << static_cast<double>(summary.quantile(0.999)) / 1000.0
+            << std::setw(10) << static_cast<double>(summary.maxNanos) / 1000.0 << std::endl;
+    }
+    out.flags(flags);
+}
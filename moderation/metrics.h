@@ -0,0 +1,235 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "moderation/epoch.h"
+
+// Build with -DMODERATION_METRICS=0 to compile the instrumentation out: timers and counters
+// become empty inline functions and no clock is read on the scan path
+#ifndef MODERATION_METRICS
+#define MODERATION_METRICS 1
+#endif
+
+constexpr bool MetricsEnabled = MODERATION_METRICS != 0;
+
+// Pipeline stages timed per message. Word and substring matching fold ASCII case while
+// scanning, so only the token mode and messages with non-ASCII text have a separate
+// normalization stage.
+enum class Stage : size_t {
+    Normalize,  // Unicode case folding, tokenizing and normalizing text before lookup
+    Match,      // Dictionary lookup or automaton scan
+    Expand,     // Related-term expansion over the term graph
+    Output,     // Formatting the verdict
+    Count
+};
+
+constexpr size_t StageCount = static_cast<size_t>(Stage::Count);
+
+const char* stageName(Stage stage);
+
+// Log-linear bucketing in the style of HdrHistogram: values below 16 get their own bucket,
+// above that each power of two is split into 16 buckets, so any recorded value is known to
+// within 1/16 (about 6%). Values are nanoseconds and saturate at 2^40 ns (about 18 minutes).
+namespace HistogramBuckets {
+    constexpr unsigned SubBits = 4;
+    constexpr unsigned MaxExponent = 40;
+    constexpr size_t Count = (MaxExponent - SubBits + 2) << SubBits;
+    
+    inline size_t index(uint64_t value) {
+        if (value < (1ull << SubBits)) return static_cast<size_t>(value);
+        unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        if (exponent > MaxExponent) return Count - 1;
+        size_t sub = static_cast<size_t>(value >> (exponent - SubBits)) & ((1u << SubBits) - 1);
+        return ((exponent - SubBits + 1) << SubBits) + sub;
+    }
+    
+    // Smallest value that lands in the bucket
+    inline uint64_t lowest(size_t index) {
+        if (index < (1u << SubBits)) return index;
+        unsigned exponent = static_cast<unsigned>(index >> SubBits) + SubBits - 1;
+        uint64_t sub = index & ((1u << SubBits) - 1);
+        return ((1ull << SubBits) + sub) << (exponent - SubBits);
+    }
+    
+    // Largest value that lands in the bucket
+    inline uint64_t highest(size_t index) {
+        return index + 1 < Count ? lowest(index + 1) - 1 : UINT64_MAX;
+    }
+}
+
+// Token prefilter outcomes for one message, recorded together once it is scanned
+struct PrefilterCounts {
+    uint64_t tokens = 0;          // Tokens checked against the prefilter
+    uint64_t rejected = 0;        // Settled by the prefilter without reading the Trie
+    uint64_t falsePositives = 0;  // Let through, but not in the dictionary after all
+};
+
+// A merged, read-only histogram of one stage
+struct LatencySummary {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(HistogramBuckets::Count, 0);
+    uint64_t total = 0;
+    uint64_t sumNanos = 0;
+    uint64_t maxNanos = 0;
+    
+    // Upper bound of the bucket holding the given quantile, in nanoseconds
+    uint64_t quantile(double q) const;
+    
+    double meanNanos() const {
+        return total ? static_cast<double>(sumNanos) / static_cast<double>(total) : 0.0;
+    }
+};
+
+// Everything the exporters print: merged histograms, counters and point-in-time gauges
+struct MetricsSnapshot {
+    std::array<LatencySummary, StageCount> stages;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t matches = 0;
+    uint64_t flaggedMessages = 0;
+    PrefilterCounts prefilter;
+    
+    // Filled in by the caller: name, help text, value
+    struct Gauge {
+        std::string name;
+        std::string help;
+        double value;
+    };
+    std::vector<Gauge> gauges;
+    
+    // Most frequently flagged terms with their counts
+    std::vector<std::pair<std::string, uint64_t>> topTerms;
+    
+    // Recent flags of the most frequently flagged terms and of the bursting ones
+    struct TermRate {
+        std::string term;
+        uint64_t flags[3];      // In the last minute, five minutes and hour
+        double burstRatio;      // Last minute against the rest of the hour; 0 until there is enough of either
+        bool bursting;
+    };
+    std::vector<TermRate> termRates;
+};
+
+// Process-wide stage latencies and message counters. Each thread writes only its own shard,
+// with plain relaxed stores, and readers merge the shards; so recording costs two clock reads
+// and a few uncontended increments.
+class Metrics {
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[StageCount][HistogramBuckets::Count] = {};
+        std::atomic<uint64_t> sumNanos[StageCount] = {};
+        std::atomic<uint64_t> maxNanos[StageCount] = {};
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> matches{0};
+        std::atomic<uint64_t> flaggedMessages{0};
+        std::atomic<uint64_t> prefilterTokens{0};
+        std::atomic<uint64_t> prefilterRejected{0};
+        std::atomic<uint64_t> prefilterFalsePositives{0};
+    };
+    
+    std::atomic<Shard*> shards[ThreadSlots::Max] = {};
+    
+    Shard& localShard() {
+        std::atomic<Shard*>& slot = shards[ThreadSlots::current()];
+        Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            // Slots are recycled when threads exit, so an existing shard simply keeps counting
+            shard = new Shard();
+            slot.store(shard, std::memory_order_release);
+        }
+        return *shard;
+    }
+    
+    // Only the owning thread writes a shard, so a load and a store replace a locked add
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+public:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+    
+    ~Metrics() {
+        for (auto& shard : shards) delete shard.load();
+    }
+    
+    void recordLatency(Stage stage, uint64_t nanos) {
+        if constexpr (MetricsEnabled) {
+            Shard& shard = localShard();
+            size_t s = static_cast<size_t>(stage);
+            bump(shard.buckets[s][HistogramBuckets::index(nanos)], 1);
+            bump(shard.sumNanos[s], nanos);
+            if (nanos > shard.maxNanos[s].load(std::memory_order_relaxed)) {
+                shard.maxNanos[s].store(nanos, std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Count one scanned message and the matches found in it
+    void recordMessage(size_t bytes, size_t matches) {
+        if constexpr (MetricsEnabled) {
+            Shard& shard = localShard();
+            bump(shard.messages, 1);
+            bump(shard.bytes, bytes);
+            bump(shard.matches, matches);
+            if (matches > 0) bump(shard.flaggedMessages, 1);
+        }
+    }
+    
+    void recordPrefilter(const PrefilterCounts& counts) {
+        if constexpr (MetricsEnabled) {
+            if (counts.tokens == 0) return;
+            Shard& shard = localShard();
+            bump(shard.prefilterTokens, counts.tokens);
+            bump(shard.prefilterRejected, counts.rejected);
+            bump(shard.prefilterFalsePositives, counts.falsePositives);
+        }
+    }
+    
+    // Merge every shard; safe while other threads keep recording
+    MetricsSnapshot snapshot() const;
+};
+
+// The metrics instance shared by every moderation system in the process
+Metrics& processMetrics();
+
+// Times the enclosing scope as one stage
+class StageTimer {
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StageTimer(Stage stage) : stage(stage) {
+        if constexpr (MetricsEnabled) start = std::chrono::steady_clock::now();
+    }
+    
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+    
+    ~StageTimer() {
+        if constexpr (MetricsEnabled) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            processMetrics().recordLatency(stage, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+};
+
+// Prometheus text exposition format, version 0.0.4
+void writePrometheus(std::ostream& out, const MetricsSnapshot& snapshot);
+
+// The same data as one JSON object, for `stats --json`
+void writeMetricsJson(std::ostream& out, const MetricsSnapshot& snapshot);
+
+// Human-readable stage latency table for the statistics screen
+void writeStageTable(std::ostream& out, const MetricsSnapshot& snapshot);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Set of policies (per community, region or surface rule sets) as one bit per policy
+using PolicyMask = uint64_t;
+
+// Policies of a term the banned list does not tag: it applies under every policy
+constexpr PolicyMask AllPolicies = ~PolicyMask(0);
+
+// Process-wide policy names. Every name gets the next free bit the first time it is seen, and
+// bits are never reused, so policy masks in every snapshot of the process mean the same thing.
+class PolicyRegistry {
+public:
+    static constexpr size_t MaxPolicies = 64;
+    static constexpr int None = -1;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::string> names; // Indexed by bit
+
+public:
+    PolicyRegistry() = default;
+    PolicyRegistry(const PolicyRegistry&) = delete;
+    PolicyRegistry& operator=(const PolicyRegistry&) = delete;
+    
+    // Bit of a policy, assigning the next free one if the name is new; None once all are taken
+    int intern(std::string_view name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t bit = 0; bit < names.size(); ++bit) {
+            if (names[bit] == name) return static_cast<int>(bit);
+        }
+        if (names.size() == MaxPolicies) return None;
+        names.emplace_back(name);
+        return static_cast<int>(names.size() - 1);
+    }
+    
+    // Bit of a policy, or None if no list names it
+    int find(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t bit = 0; bit < names.size(); ++bit) {
+            if (names[bit] == name) return static_cast<int>(bit);
+        }
+        return None;
+    }
+    
+    // Mask of a comma-separated list of policy names; the first unknown name goes to *unknown
+    // and yields 0
+    PolicyMask parse(std::string_view list, std::string* unknown = nullptr) const {
+        PolicyMask mask = 0;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view name = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            if (name.empty()) continue;
+            int bit = find(name);
+            if (bit == None) {
+                if (unknown) unknown->assign(name);
+                return 0;
+            }
+            mask |= PolicyMask(1) << bit;
+        }
+        return mask;
+    }
+    
+    std::string name(size_t bit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bit < names.size() ? names[bit] : std::string();
+    }
+    
+    // All names in bit order
+    std::vector<std::string> all() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return names;
+    }
+    
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return names.size();
+    }
+};
@@ -0,0 +1,16 @@
+#include "moderation/prefilter.h"
+
+TokenPrefilter::TokenPrefilter(const DictionarySnapshot& terms, const AllowList* allow) {
+    // 16 bits per term: with four bits per key in one word, about 1-2% false positives
+    size_t words = 1;
+    while (words * 64 < terms.termCount() * 16) words *= 2;
+    bits.assign(words, 0);
+    
+    for (size_t i = 0; i < terms.termCount(); ++i) {
+        if (allow && allow->kind(terms.termId(static_cast<int>(i))) == AllowList::Phrase) continue;
+        std::string_view term = terms.term(static_cast<int>(i));
+        lengths |= lengthBit(term.size());
+        uint64_t h = hash(term);
+        bits[wordFor(h)] |= bitsFor(h);
+    }
+}
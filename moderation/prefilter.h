@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "moderation/allowlist.h"
+#include "moderation/dictionary_snapshot.h"
+
+// Rejects most tokens that are not banned before the Trie is read, for the token and fuzzy
+// modes. A token is checked against a bitmap of the term lengths, then against one 64-bit word
+// of a register-blocked Bloom filter over the term hashes, where each term sets four bits.
+// Both fit in a register or a cache line, against the several dependent loads of a Trie
+// descent. There are no false negatives; a false positive costs the descent it would have
+// cost without the filter.
+class TokenPrefilter {
+private:
+    uint64_t lengths = 0;        // Bit n: some term is n bytes long; bit 63: 63 bytes or more
+    std::vector<uint64_t> bits;  // A power of two of words
+    
+    static uint64_t lengthBit(size_t length) {
+        return 1ull << (length < 63 ? length : 63);
+    }
+    
+    // Eight bytes at a time; tokens are short, so this is a handful of multiplies
+    static uint64_t hash(std::string_view token) {
+        const char* data = token.data();
+        const size_t size = token.size();
+        uint64_t hash = size * 0x9e3779b97f4a7c15ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+        if (i < size) {
+            uint64_t word = 0;
+            std::memcpy(&word, data + i, size - i);
+            hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        return hash ^ (hash >> 33);
+    }
+    
+    static uint64_t bitsFor(uint64_t hash) {
+        return (1ull << (hash & 63)) | (1ull << ((hash >> 6) & 63)) | (1ull << ((hash >> 12) & 63))
+             | (1ull << ((hash >> 18) & 63));
+    }
+    
+    size_t wordFor(uint64_t hash) const {
+        return static_cast<size_t>(hash >> 32) & (bits.size() - 1);
+    }
+
+public:
+    // Filter for the terms, leaving out the allowlisted phrases among them
+    explicit TokenPrefilter(const DictionarySnapshot& terms, const AllowList* allow = nullptr);
+    
+    // False only if no term is the token
+    bool mayContain(std::string_view token) const {
+        if (!(lengths & lengthBit(token.size()))) return false;
+        uint64_t h = hash(token);
+        uint64_t want = bitsFor(h);
+        return (bits[wordFor(h)] & want) == want;
+    }
+    
+    size_t memoryBytes() const {
+        return bits.size() * sizeof(uint64_t) + sizeof(*this);
+    }
+};
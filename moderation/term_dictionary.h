@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Process-wide term interner. Every distinct term gets a dense id the first time it is seen, and
+// ids are never reused, so matching, the relationship graph, the statistics and the flag log all
+// work in ids and only turn them back into text for output. Reading a term by id takes no lock.
+class TermDictionary {
+public:
+    static constexpr uint32_t None = UINT32_MAX;
+
+private:
+    // Terms live in fixed-size chunks that never move; room for 2^26 terms
+    static constexpr size_t ChunkBits = 12;
+    static constexpr size_t ChunkSize = size_t(1) << ChunkBits;
+    static constexpr size_t MaxChunks = size_t(1) << 14;
+    
+    std::unique_ptr<std::atomic<std::string*>[]> chunks{new std::atomic<std::string*>[MaxChunks]()};
+    std::atomic<uint32_t> count{0};
+    mutable std::mutex mutex;
+    std::unordered_map<std::string_view, uint32_t> ids; // Views into the chunks
+
+public:
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+    
+    ~TermDictionary() {
+        for (size_t i = 0; i < MaxChunks; ++i) delete[] chunks[i].load();
+    }
+    
+    // Id of a term, assigning the next free one if the term is new
+    uint32_t intern(std::string_view term) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(term);
+        if (it != ids.end()) return it->second;
+        
+        uint32_t id = count.load(std::memory_order_relaxed);
+        std::string* chunk = chunks[id >> ChunkBits].load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new std::string[ChunkSize];
+            chunks[id >> ChunkBits].store(chunk, std::memory_order_release);
+        }
+        std::string& slot = chunk[id & (ChunkSize - 1)];
+        slot.assign(term);
+        ids.emplace(std::string_view(slot), id);
+        count.store(id + 1, std::memory_order_release);
+        return id;
+    }
+    
+    // Id of a term, or None if it was never interned
+    uint32_t find(std::string_view term) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(term);
+        return it == ids.end() ? None : it->second;
+    }
+    
+    // Text of an interned term; id must be below size()
+    std::string_view text(uint32_t id) const {
+        return chunks[id >> ChunkBits].load(std::memory_order_acquire)[id & (ChunkSize - 1)];
+    }
+    
+    size_t size() const {
+        return count.load(std::memory_order_acquire);
+    }
+    
+    size_t memoryBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = MaxChunks * sizeof(std::atomic<std::string*>);
+        bytes += ((count.load() + ChunkSize - 1) / ChunkSize) * ChunkSize * sizeof(std::string);
+        bytes += ids.bucket_count() * sizeof(void*) + ids.size() * (sizeof(std::string_view) + 2 * sizeof(void*));
+        return bytes;
+    }
+};
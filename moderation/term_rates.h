@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "moderation/epoch.h"
+
+// How often terms were flagged lately, over sliding windows of one minute, five minutes and one
+// hour, and which terms are bursting: flagged much faster in the last minute than over the rest
+// of the hour. TermStatistics counts since the process started; these counts age out.
+//
+// Every scanning thread counts its flags in its own shard, a small open-addressed table of
+// relaxed atomic counters, so recording a flag is one increment on a cache line no other
+// scanning thread writes. When the maintenance thread advances, it drains the shards into a
+// running count per term, then copies the running counts into each term's ring once per tick:
+// 10-second ticks for the short windows, minute ticks for the hour. The flags of a term in a
+// window are its running count minus the copy taken when the window opened, as of the last
+// advance. Shards, rings and the index over them are all allocated up front.
+class TermRates {
+public:
+    static constexpr int64_t FineSeconds = 10;
+    static constexpr size_t FineTicks = 32;     // Enough for the 5-minute window and the tick being filled
+    static constexpr int64_t CoarseSeconds = 60;
+    static constexpr size_t CoarseTicks = 64;   // Enough for the hour
+    
+    // Terms with a ring at once. A term is dropped once the hour holds none of its flags; when
+    // every ring is taken, a new term takes the ring of the term with the fewest flags in the
+    // hour, the longest unflagged of those.
+    static constexpr size_t TrackedTerms = 4096;
+    
+    // Counters in each thread's shard, and how far a term is looked for from its home slot. A
+    // counter is freed for another term once drained, so this bounds the distinct terms one
+    // thread flags between two advances; flags that find no counter are counted as untracked.
+    static constexpr size_t ShardSlots = 8192;
+    static constexpr size_t MaxProbes = 32;
+    
+    enum Window {
+        OneMinute = 0,
+        FiveMinutes = 1,
+        OneHour = 2,
+    };
+    static constexpr size_t WindowCount = 3;
+    
+    // A term bursts when its last minute runs at BurstFactor times its rate over the rest of the
+    // hour, with at least MinBurstFlags flags; the comparison waits for BaselineSeconds of history
+    static constexpr double BurstFactor = 5.0;
+    static constexpr uint64_t MinBurstFlags = 20;
+    static constexpr double BaselineSeconds = 300.0;
+    
+    // Flags of one term over one window
+    struct Rate {
+        uint64_t flags = 0;
+        double seconds = 0.0;   // Span the flags were counted over; shorter than the window early on
+        
+        double perMinute() const {
+            return seconds > 0.0 ? 60.0 * static_cast<double>(flags) / seconds : 0.0;
+        }
+    };
+    
+    struct Burst {
+        uint32_t termId = 0;
+        uint64_t flags = 0;             // In the last minute
+        double perMinute = 0.0;         // Over the last minute
+        double baselinePerMinute = 0.0; // Over the rest of the last hour
+        double ratio = 0.0;
+    };
+
+private:
+    // Each counter packs (term id + 1) << 32 with the flags not yet drained; zero is a counter
+    // never used. Only the owning thread changes the term of a counter, and only while its
+    // flags are zero; only advance() lowers the flags, by what it read.
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> counters{new std::atomic<uint64_t>[ShardSlots]()};
+        std::atomic<uint64_t> untracked{0};
+    };
+    
+    static constexpr uint64_t FlagMask = 0xffffffffull;
+    static constexpr uint32_t Unindexed = UINT32_MAX;
+    static constexpr size_t IndexSlots = 2 * TrackedTerms;
+    
+    // Running count of one term, and its copies at the start of each tick of both rings
+    struct Series {
+        uint32_t termId = 0;
+        uint32_t total = 0;
+        uint64_t drained = 0;   // Last advance that added flags
+        bool used = false;
+        std::array<uint32_t, FineTicks + CoarseTicks> copies{};
+    };
+    
+    // Where one ring's copies sit in every Series, ring-indexed by tick number
+    struct Ring {
+        int64_t tickSeconds;
+        size_t ticks;
+        size_t offset;
+        int64_t last = -1;      // Newest tick copied
+        int64_t first = -1;     // Oldest tick copied
+        
+        size_t slot(int64_t tick) const {
+            return offset + static_cast<size_t>(tick) % ticks;
+        }
+    };
+    
+    std::atomic<Shard*> shards[ThreadSlots::Max] = {};
+    
+    // Written by advance(), read by the queries
+    mutable std::mutex mutex;
+    std::unique_ptr<Series[]> series{new Series[TrackedTerms]};
+    std::unique_ptr<uint32_t[]> index{new uint32_t[IndexSlots]};   // Linear probing on term id; Unindexed if empty
+    std::vector<uint32_t> unused;
+    uint64_t advances = 0;
+    Ring fine{FineSeconds, FineTicks, 0};
+    Ring coarse{CoarseSeconds, CoarseTicks, FineTicks};
+    double started = clockSeconds();
+    
+    Shard& localShard() {
+        std::atomic<Shard*>& slot = shards[ThreadSlots::current()];
+        Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            // Slots are recycled when threads exit, so an existing shard simply keeps counting
+            shard = new Shard();
+            slot.store(shard, std::memory_order_release);
+        }
+        return *shard;
+    }
+    
+    static size_t hash(uint32_t termId) {
+        // splitmix64 finalizer, as in TermStatistics
+        uint64_t hash = termId + 0x9e3779b97f4a7c15ull;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        return static_cast<size_t>(hash ^ (hash >> 31));
+    }
+    
+    static double clockSeconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // Index slot holding the term, or the empty slot where it would go
+    size_t indexSlot(uint32_t termId) const {
+        size_t i = hash(termId) & (IndexSlots - 1);
+        while (index[i] != Unindexed && series[index[i]].termId != termId) i = (i + 1) & (IndexSlots - 1);
+        return i;
+    }
+    
+    const Series* find(uint32_t termId) const {
+        uint32_t at = index[indexSlot(termId)];
+        return at != Unindexed ? &series[at] : nullptr;
+    }
+    
+    // Free a term's ring, shifting the index entries after it back so no probe crosses a gap
+    void release(uint32_t at) {
+        size_t hole = indexSlot(series[at].termId);
+        for (size_t j = (hole + 1) & (IndexSlots - 1); index[j] != Unindexed; j = (j + 1) & (IndexSlots - 1)) {
+            size_t home = hash(series[index[j]].termId) & (IndexSlots - 1);
+            if (((j - home) & (IndexSlots - 1)) >= ((j - hole) & (IndexSlots - 1))) {
+                index[hole] = index[j];
+                hole = j;
+            }
+        }
+        index[hole] = Unindexed;
+        series[at] = Series();
+        unused.push_back(at);
+    }
+    
+    // Flags in the hour so far, as the ring holds them
+    uint32_t hourFlags(const Series& term) const {
+        return term.total - term.copies[coarse.slot(std::max(coarse.last - 3600 / CoarseSeconds, coarse.first))];
+    }
+    
+    // Add drained flags to a term's running count, giving it a ring if it has none
+    void add(uint32_t termId, uint32_t flags) {
+        size_t slot = indexSlot(termId);
+        if (index[slot] == Unindexed) {
+            if (unused.empty()) {
+                uint32_t fewest = 0;
+                for (uint32_t i = 1; i < TrackedTerms; ++i) {
+                    uint32_t flags = hourFlags(series[i]), least = hourFlags(series[fewest]);
+                    if (flags < least || (flags == least && series[i].drained < series[fewest].drained)) fewest = i;
+                }
+                release(fewest);
+                slot = indexSlot(termId);
+            }
+            // A new ring's copies are zero, which is right for every tick before the term was flagged
+            uint32_t at = unused.back();
+            unused.pop_back();
+            series[at].termId = termId;
+            series[at].used = true;
+            index[slot] = at;
+        }
+        series[index[slot]].total += flags;
+        series[index[slot]].drained = advances;
+    }
+    
+    // Copy the running counts into every tick of the ring up to `tick`. Ticks nobody copied on
+    // time get the same copy, so their flags count towards the oldest of them.
+    void rotate(Ring& ring, int64_t tick) {
+        if (tick <= ring.last) return;
+        if (ring.first < 0) ring.first = tick;
+        int64_t from = std::max(ring.last + 1, tick - static_cast<int64_t>(ring.ticks) + 1);
+        for (size_t i = 0; i < TrackedTerms; ++i) {
+            Series& term = series[i];
+            if (!term.used) continue;
+            for (int64_t t = from; t <= tick; ++t) term.copies[ring.slot(t)] = term.total;
+        }
+        ring.last = tick;
+    }
+    
+    // Flags in the last `ticks` ticks of the ring plus the one being filled
+    Rate count(const Ring& ring, const Series* term, int64_t ticks, double now) const {
+        Rate rate;
+        if (ring.last < 0) return rate;
+        int64_t from = std::max(ring.last - ticks, ring.first);
+        // Counts only grow, so the difference is right even after they wrap
+        if (term) rate.flags = term->total - term->copies[ring.slot(from)];
+        // The oldest tick began before anything was counted
+        rate.seconds = std::max(0.0, now - std::max(started, static_cast<double>(from * ring.tickSeconds)));
+        return rate;
+    }
+    
+    Rate rateOf(const Series* term, Window window, double now) const {
+        switch (window) {
+            case OneMinute: return count(fine, term, 60 / FineSeconds, now);
+            case FiveMinutes: return count(fine, term, 300 / FineSeconds, now);
+            default: return count(coarse, term, 3600 / CoarseSeconds, now);
+        }
+    }
+    
+    bool burstOf(uint32_t termId, const Series* term, double now, Burst& result) const {
+        Rate recent = rateOf(term, OneMinute, now);
+        Rate hour = rateOf(term, OneHour, now);
+        double baselineSeconds = hour.seconds - recent.seconds;
+        if (recent.flags < MinBurstFlags || baselineSeconds < BaselineSeconds) return false;
+        
+        // A term never seen before the last minute is compared with one flag over the baseline
+        uint64_t baselineFlags = hour.flags > recent.flags ? hour.flags - recent.flags : 0;
+        result.termId = termId;
+        result.flags = recent.flags;
+        result.perMinute = recent.perMinute();
+        result.baselinePerMinute = 60.0 * static_cast<double>(baselineFlags) / baselineSeconds;
+        result.ratio = result.perMinute / std::max(result.baselinePerMinute, 60.0 / baselineSeconds);
+        return result.ratio >= BurstFactor;
+    }
+
+public:
+    // The first copies are taken right away, so no flag goes uncounted
+    TermRates() {
+        std::fill(index.get(), index.get() + IndexSlots, Unindexed);
+        unused.reserve(TrackedTerms);
+        for (size_t i = TrackedTerms; i-- > 0;) unused.push_back(static_cast<uint32_t>(i));
+        advance();
+    }
+    
+    TermRates(const TermRates&) = delete;
+    TermRates& operator=(const TermRates&) = delete;
+    
+    ~TermRates() {
+        for (auto& shard : shards) delete shard.load();
+    }
+    
+    // Count one flag of a term; lock-free, called from scanning threads
+    void record(uint32_t termId) {
+        Shard& shard = localShard();
+        uint64_t key = (static_cast<uint64_t>(termId) + 1) << 32;
+        size_t home = hash(termId) & (ShardSlots - 1);
+        size_t spare = ShardSlots;
+        for (size_t probe = 0; probe < MaxProbes; ++probe) {
+            std::atomic<uint64_t>& counter = shard.counters[(home + probe) & (ShardSlots - 1)];
+            uint64_t word = counter.load(std::memory_order_relaxed);
+            if ((word & ~FlagMask) == key) {
+                counter.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if ((word & FlagMask) == 0 && spare == ShardSlots) spare = (home + probe) & (ShardSlots - 1);
+            if (word == 0) break;   // Terms are never placed past a counter never used
+        }
+        if (spare == ShardSlots) {
+            shard.untracked.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Drained counters are only read by advance(), so the owner may give this one a new term
+        shard.counters[spare].store(key | 1, std::memory_order_relaxed);
+    }
+    
+    // Drain the shards and open the ticks that have begun; the maintenance thread calls this at
+    // least once per tick, and the statistics screen before it reads. Terms with no flag left
+    // in the hour give their rings back.
+    void advance() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++advances;
+        for (const auto& slot : shards) {
+            Shard* shard = slot.load(std::memory_order_acquire);
+            if (!shard) continue;
+            for (size_t i = 0; i < ShardSlots; ++i) {
+                uint64_t word = shard->counters[i].load(std::memory_order_relaxed);
+                auto flags = static_cast<uint32_t>(word & FlagMask);
+                if (flags == 0) continue;
+                shard->counters[i].fetch_sub(flags, std::memory_order_relaxed);
+                add(static_cast<uint32_t>((word >> 32) - 1), flags);
+            }
+        }
+        
+        auto second = static_cast<int64_t>(clockSeconds());
+        rotate(fine, second / FineSeconds);
+        int64_t hourTick = coarse.last;
+        rotate(coarse, second / CoarseSeconds);
+        if (coarse.last == hourTick) return;
+        for (uint32_t i = 0; i < TrackedTerms; ++i) {
+            if (series[i].used && hourFlags(series[i]) == 0) release(i);
+        }
+    }
+    
+    // Flags of a term over a window, as of the last advance; O(1)
+    Rate rate(uint32_t termId, Window window) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return rateOf(find(termId), window, clockSeconds());
+    }
+    
+    // Compare a term's last minute with the rest of its hour. False while the hour holds less than
+    // BaselineSeconds of history before the last minute, or if the term is not bursting.
+    bool burst(uint32_t termId, Burst& result) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return burstOf(termId, find(termId), clockSeconds(), result);
+    }
+    
+    // Terms bursting right now, strongest first, at most `limit` of them; checks every ring
+    std::vector<Burst> bursts(size_t limit) const {
+        std::vector<Burst> found;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            double now = clockSeconds();
+            for (size_t i = 0; i < TrackedTerms; ++i) {
+                Burst candidate;
+                if (series[i].used && burstOf(series[i].termId, &series[i], now, candidate)) found.push_back(candidate);
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const Burst& a, const Burst& b) { return a.ratio > b.ratio; });
+        if (found.size() > limit) found.resize(limit);
+        return found;
+    }
+    
+    // Flags that found no free counter in their thread's shard, and were not counted
+    uint64_t untracked() const {
+        uint64_t total = 0;
+        for (const auto& slot : shards) {
+            Shard* shard = slot.load(std::memory_order_acquire);
+            if (shard) total += shard->untracked.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+    
+    // Fixed footprint: the rings and their index, and the shards in use
+    size_t memoryBytes() const {
+        size_t bytes = TrackedTerms * (sizeof(Series) + sizeof(uint32_t)) + IndexSlots * sizeof(uint32_t);
+        for (const auto& slot : shards) {
+            if (slot.load()) bytes += sizeof(Shard) + ShardSlots * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+};
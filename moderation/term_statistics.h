@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "moderation/epoch.h"
+
+// Space-Saving heavy-hitter summary. It tracks at most `capacity` terms; a term whose true
+// count exceeds total / capacity is guaranteed to be tracked, and every tracked count is an
+// overestimate by at most its recorded error.
+class SpaceSaving {
+public:
+    struct Entry {
+        uint32_t termId;
+        uint64_t count;
+        uint64_t error;
+    };
+
+private:
+    size_t capacity;
+    std::vector<Entry> heap; // Min-heap on count
+    std::unordered_map<uint32_t, size_t> positions;
+    
+    void swapEntries(size_t a, size_t b) {
+        std::swap(heap[a], heap[b]);
+        positions[heap[a].termId] = a;
+        positions[heap[b].termId] = b;
+    }
+    
+    void siftDown(size_t i) {
+        while (true) {
+            size_t smallest = i;
+            size_t left = 2 * i + 1;
+            size_t right = left + 1;
+            if (left < heap.size() && heap[left].count < heap[smallest].count) smallest = left;
+            if (right < heap.size() && heap[right].count < heap[smallest].count) smallest = right;
+            if (smallest == i) return;
+            swapEntries(i, smallest);
+            i = smallest;
+        }
+    }
+    
+    void siftUp(size_t i) {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            swapEntries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+public:
+    explicit SpaceSaving(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+    
+    void add(uint32_t termId, uint64_t increment = 1) {
+        auto it = positions.find(termId);
+        if (it != positions.end()) {
+            heap[it->second].count += increment;
+            siftDown(it->second);
+            return;
+        }
+        
+        if (heap.size() < capacity) {
+            heap.push_back({termId, increment, 0});
+            positions[termId] = heap.size() - 1;
+            siftUp(heap.size() - 1);
+            return;
+        }
+        
+        // Evict the smallest counter; the newcomer inherits its count as error
+        Entry& victim = heap[0];
+        positions.erase(victim.termId);
+        victim.error = victim.count;
+        victim.count += increment;
+        victim.termId = termId;
+        positions[termId] = 0;
+        siftDown(0);
+    }
+    
+    const std::vector<Entry>& entries() const { return heap; }
+};
+
+// Term counters for the statistics screen. Every thread updates its own shard, holding a
+// Count-Min sketch for per-term frequency and a Space-Saving summary for heavy hitters, so
+// scanning threads never share a cache line. Shards are merged lazily when read, and the
+// memory stays fixed no matter how many distinct terms are seen.
+class TermStatistics {
+public:
+    static constexpr size_t SketchDepth = 4;
+    static constexpr size_t SketchWidth = 4096;
+    static constexpr size_t HeavyHitterCapacity = 256;
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint32_t>[]> sketch{new std::atomic<uint32_t>[SketchDepth * SketchWidth]()};
+        std::mutex mutex; // Only contended while a reader merges the shard
+        SpaceSaving heavyHitters{HeavyHitterCapacity};
+        std::atomic<uint64_t> updates{0};
+    };
+    
+    std::atomic<Shard*> shards[ThreadSlots::Max] = {};
+    
+    // Merged heavy hitters, rebuilt only when some shard changed since the last read
+    std::mutex mergeMutex;
+    std::vector<SpaceSaving::Entry> merged;
+    std::vector<uint64_t> mergedUpdates = std::vector<uint64_t>(ThreadSlots::Max, 0);
+    
+    Shard& localShard() {
+        std::atomic<Shard*>& slot = shards[ThreadSlots::current()];
+        Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            // Slots are recycled when threads exit, so an existing shard simply keeps counting
+            shard = new Shard();
+            slot.store(shard, std::memory_order_release);
+        }
+        return *shard;
+    }
+    
+    static size_t cell(uint32_t termId, size_t row) {
+        // splitmix64 finalizer, then Kirsch-Mitzenmacher double hashing
+        uint64_t hash = termId + 0x9e3779b97f4a7c15ull;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        hash ^= hash >> 31;
+        uint64_t h = (hash >> 32) + row * (hash | 1);
+        return row * SketchWidth + (h % SketchWidth);
+    }
+    
+    void mergeIfStale() {
+        bool stale = false;
+        for (size_t i = 0; i < ThreadSlots::Max; ++i) {
+            Shard* shard = shards[i].load(std::memory_order_acquire);
+            if (shard && shard->updates.load(std::memory_order_relaxed) != mergedUpdates[i]) stale = true;
+        }
+        if (!stale) return;
+        
+        std::unordered_map<uint32_t, SpaceSaving::Entry> combined;
+        for (size_t i = 0; i < ThreadSlots::Max; ++i) {
+            Shard* shard = shards[i].load(std::memory_order_acquire);
+            if (!shard) continue;
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            mergedUpdates[i] = shard->updates.load(std::memory_order_relaxed);
+            for (const auto& entry : shard->heavyHitters.entries()) {
+                auto [it, inserted] = combined.emplace(entry.termId, entry);
+                if (!inserted) {
+                    it->second.count += entry.count;
+                    it->second.error += entry.error;
+                }
+            }
+        }
+        
+        merged.clear();
+        for (auto& [termId, entry] : combined) merged.push_back(entry);
+        size_t keep = std::min(merged.size(), HeavyHitterCapacity);
+        std::partial_sort(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(keep), merged.end(),
+            [](const auto& a, const auto& b) { return a.count > b.count; });
+        merged.resize(keep);
+    }
+
+public:
+    TermStatistics() = default;
+    TermStatistics(const TermStatistics&) = delete;
+    TermStatistics& operator=(const TermStatistics&) = delete;
+    
+    ~TermStatistics() {
+        for (auto& shard : shards) delete shard.load();
+    }
+    
+    // Count one occurrence of a flagged term; called from scanning threads
+    void record(uint32_t termId) {
+        Shard& shard = localShard();
+        for (size_t row = 0; row < SketchDepth; ++row) {
+            shard.sketch[cell(termId, row)].fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.heavyHitters.add(termId);
+        shard.updates.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Estimated number of occurrences; never below the true count
+    uint64_t estimate(uint32_t termId) const {
+        uint64_t best = UINT64_MAX;
+        for (size_t row = 0; row < SketchDepth; ++row) {
+            uint64_t sum = 0;
+            for (const auto& slot : shards) {
+                Shard* shard = slot.load(std::memory_order_acquire);
+                if (shard) sum += shard->sketch[cell(termId, row)].load(std::memory_order_relaxed);
+            }
+            best = std::min(best, sum);
+        }
+        return best;
+    }
+    
+    // The k most frequent terms, most frequent first
+    std::vector<SpaceSaving::Entry> topK(size_t k) {
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        mergeIfStale();
+        return std::vector<SpaceSaving::Entry>(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(std::min(k, merged.size())));
+    }
+    
+    // Fixed footprint of the shards in use
+    size_t memoryBytes() const {
+        size_t bytes = 0;
+        for (const auto& slot : shards) {
+            if (slot.load()) bytes += sizeof(Shard) + SketchDepth * SketchWidth * sizeof(uint32_t)
+                                    + HeavyHitterCapacity * (sizeof(SpaceSaving::Entry) + 24);
+        }
+        return bytes;
+    }
+};
@@ -0,0 +1,110 @@
+#include "moderation/text.h"
+
+#include <iostream>
+
+#include "moderation/unicode.h"
+
+std::string normalizeTerm(const std::string& raw) {
+    // Case fold non-ASCII characters first, as findMatches does with scanned text
+    static thread_local Utf8Normalizer normalizer;
+    std::string_view input = normalizer.normalize(raw) ? std::string_view(normalizer.text()) : std::string_view(raw);
+    
+    const unsigned char* classes = TextClass::table();
+    std::string term;
+    term.reserve(input.size());
+    
+    for (char ch : input) {
+        unsigned char c = classes[static_cast<unsigned char>(ch)];
+        if (c == TextClass::Skip) continue;
+        if (c == TextClass::Space && (term.empty() || term.back() == ' ')) continue;
+        term.push_back(static_cast<char>(c));
+    }
+    
+    if (!term.empty() && term.back() == ' ') term.pop_back();
+    return term;
+}
+
+// Parse a policy field, "@eu,@kids", into a mask; false if the field is not one
+static bool parsePolicies(std::string_view field, PolicyRegistry* policies, PolicyMask& mask) {
+    if (field.empty() || field[0] != '@') return false;
+    mask = 0;
+    while (!field.empty()) {
+        size_t comma = field.find(',');
+        std::string_view name = field.substr(0, comma);
+        field = comma == std::string_view::npos ? std::string_view() : field.substr(comma + 1);
+        if (name.size() < 2 || name[0] != '@' || name.find_first_of(" \t") != std::string_view::npos) return false;
+        if (!policies) continue;
+        int bit = policies->intern(name.substr(1));
+        if (bit == PolicyRegistry::None) {
+            std::cerr << "Too many policies (at most " << PolicyRegistry::MaxPolicies << "); ignoring " << name << std::endl;
+            continue;
+        }
+        mask |= PolicyMask(1) << bit;
+    }
+    if (!policies) mask = AllPolicies;
+    return true;
+}
+
+std::vector<std::string> readTermList(std::istream& input, std::vector<TermInfo>* info, PolicyRegistry* policies) {
+    std::vector<std::string> terms;
+    std::string line;
+    while (std::getline(input, line)) {
+        // Trailing tab-separated fields are a severity and a policy list, in either order;
+        // anything else is part of the term
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        TermInfo settings;
+        bool hasSeverity = false;
+        bool hasPolicies = false;
+        while (true) {
+            size_t tab = line.rfind('\t');
+            if (tab == std::string::npos || tab + 1 == line.size()) break;
+            std::string_view field = std::string_view(line).substr(tab + 1);
+            
+            unsigned long value = 0;
+            size_t digits = 0;
+            while (digits < field.size() && digits < 6 && std::isdigit(static_cast<unsigned char>(field[digits]))) {
+                value = value * 10 + static_cast<unsigned long>(field[digits++] - '0');
+            }
+            PolicyMask mask = 0;
+            if (!hasSeverity && digits == field.size() && value <= UINT16_MAX) {
+                settings.severity = static_cast<uint16_t>(value);
+                hasSeverity = true;
+            } else if (!hasPolicies && parsePolicies(field, policies, mask)) {
+                // A list of nothing but ignored names leaves the term under no policy at all
+                settings.policies = mask;
+                hasPolicies = true;
+            } else {
+                break;
+            }
+            line.resize(tab);
+        }
+        
+        // Lowercase, drop punctuation and collapse whitespace so phrases match scanned text
+        std::string term = normalizeTerm(line);
+        
+        if (!term.empty()) {
+            terms.push_back(term);
+            if (info) info->push_back(settings);
+        }
+    }
+    return terms;
+}
+
+void appendJsonString(std::string& out, std::string_view text) {
+    static const char* hex = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : text) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if (c < 0x20) {
+            out += "\\u00";
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xF]);
+        } else {
+            out.push_back(ch);
+        }
+    }
+    out.push_back('"');
+}
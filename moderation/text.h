@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/policy.h"
+
+// Matching modes supported by the content scanner
+enum class MatchMode {
+    WordBoundary, // Terms must start and end on a whitespace boundary (default)
+    Substring,    // Terms may also appear inside longer words
+    Token,        // Legacy per-token Trie lookup
+    Fuzzy         // Per-token lookup that also tolerates leetspeak, repeats and a few typos
+};
+
+// A single dictionary hit reported by the scanner
+struct TermMatch {
+    size_t offset;           // Byte offset of the first matched character in the raw text
+    size_t length;           // Length of the match in the raw text, including skipped punctuation
+    uint32_t termId;         // Dictionary entry that matched
+};
+
+// Byte classes used while normalizing text on the fly
+namespace TextClass {
+    constexpr unsigned char Skip = 0;   // Punctuation, dropped like the legacy tokenizer does
+    constexpr unsigned char Space = ' '; // Any whitespace, collapsed to a single space
+    
+    // Map every byte to its normalized form: lowercase, ' ' or Skip
+    inline const unsigned char* table() {
+        static const auto classes = [] {
+            std::array<unsigned char, 256> t{};
+            for (int c = 0; c < 256; ++c) {
+                if (std::isspace(c)) {
+                    t[c] = Space;
+                } else if (std::ispunct(c)) {
+                    t[c] = Skip;
+                } else {
+                    t[c] = static_cast<unsigned char>(std::tolower(c));
+                }
+            }
+            return t;
+        }();
+        return classes.data();
+    }
+}
+
+// Score a banned term adds to a verdict when the list gives it none; a verdict denies a message
+// once the scores of its matches add up to the threshold, which is 1 by default
+constexpr uint16_t DefaultSeverity = 1;
+
+// Normalize a dictionary entry the same way scanned text is normalized
+std::string normalizeTerm(const std::string& raw);
+
+// Settings of one banned term, kept in step with the term list
+struct TermInfo {
+    uint16_t severity = DefaultSeverity;
+    PolicyMask policies = AllPolicies;
+};
+
+// Read a banned words list, one term per line, skipping lines that normalize to nothing. A line
+// may end in tab-separated fields: a severity from 0 to 65535, and the policies the term belongs
+// to as a list of @names ("scam\t5\t@eu,@kids"). A term without policies applies under all of
+// them. The settings of each term go to *info, if given, in step with the terms; policy names
+// get their bits from *policies, and are ignored without one.
+std::vector<std::string> readTermList(std::istream& input, std::vector<TermInfo>* info = nullptr,
+                                      PolicyRegistry* policies = nullptr);
+
+// Append text as a JSON string literal
+void appendJsonString(std::string& out, std::string_view text);
+
+// 64-bit FNV-1a, used for content hashes in the flag log
+inline uint64_t hashTerm(std::string_view term) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : term) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,66 @@
+#include "moderation/tokenizer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+std::vector<std::string> referenceTokenize(const std::string& text) {
+    std::vector<std::string> tokens;
+    std::string lowerText = text;
+    std::transform(lowerText.begin(), lowerText.end(), lowerText.begin(), ::tolower);
+    
+    std::istringstream iss(lowerText);
+    std::string word;
+    
+    while (iss >> word) {
+        // Remove punctuation
+        word.erase(std::remove_if(word.begin(), word.end(),
+            [](char c) { return std::ispunct(static_cast<unsigned char>(c)); }), word.end());
+        tokens.push_back(word);
+    }
+    
+    return tokens;
+}
+
+bool runTokenizerSelfTest(int iterations) {
+    const std::string alphabet = std::string("aZqM09 \t\n\r\v\f.,!?-'\"@[`{~_") + "\x80\xc3\xa9\xff" + std::string(1, '\0');
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    auto next = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    
+    bool ok = true;
+    for (auto kernel : {TokenizerKernels::Kernel::Scalar, TokenizerKernels::Kernel::SSE2, TokenizerKernels::Kernel::AVX2}) {
+        if (!TokenizerKernels::supported(kernel)) continue;
+        Tokenizer tokenizer(kernel);
+        int failures = 0;
+        
+        for (int i = 0; i < iterations; ++i) {
+            // Lengths up to 200 bytes cover several vector blocks and every tail length
+            std::string text(next() % 200, ' ');
+            for (char& c : text) c = alphabet[next() % alphabet.size()];
+            
+            tokenizer.tokenize(text);
+            std::vector<std::string> expected = referenceTokenize(text);
+            const auto& spans = tokenizer.tokens();
+            
+            bool same = spans.size() == expected.size();
+            for (size_t t = 0; same && t < spans.size(); ++t) {
+                same = tokenizer.normalized(spans[t]) == expected[t];
+            }
+            if (!same) {
+                ok = false;
+                ++failures;
+            }
+        }
+        
+        std::cout << "Tokenizer kernel " << tokenizer.kernelName() << ": "
+                  << (failures ? std::to_string(failures) + " mismatches" : std::string("OK")) << std::endl;
+    }
+    
+    return ok;
+}
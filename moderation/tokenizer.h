@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "moderation/text.h"
+
+// One whitespace-delimited token: where it sits in the raw text and where its
+// lowercased, punctuation-free form sits in the tokenizer buffer
+struct TokenSpan {
+    uint32_t offset;     // Raw byte offset of the first byte of the token
+    uint32_t length;     // Raw length, including punctuation
+    uint32_t normOffset; // Start of the normalized token in the tokenizer buffer
+    uint32_t normLength; // Normalized length; zero for tokens made only of punctuation
+};
+
+// Vectorized lowercase/classify kernels. Each one lowercases a block of bytes into out and
+// returns bit masks of the whitespace and punctuation bytes it saw.
+namespace TokenizerKernels {
+    struct BlockMasks {
+        uint64_t space;
+        uint64_t punct;
+    };
+    
+    enum class Kernel { Scalar, SSE2, AVX2 };
+    
+    // Portable version, also used for the tail of the text that does not fill a vector
+    inline BlockMasks scalarBlock(const unsigned char* in, unsigned char* out, size_t n) {
+        const unsigned char* classes = TextClass::table();
+        BlockMasks masks{0, 0};
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = classes[in[i]];
+            if (c == TextClass::Space) masks.space |= uint64_t(1) << i;
+            if (c == TextClass::Skip && in[i] != 0) masks.punct |= uint64_t(1) << i;
+            out[i] = (c == TextClass::Space || c == TextClass::Skip) ? in[i] : c;
+        }
+        return masks;
+    }
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // Byte-wise range test: lo <= v <= hi on signed lanes, which keeps bytes >= 0x80 out of every range
+    inline __m128i inRange(__m128i v, char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+    }
+    
+    inline BlockMasks sse2Block(const unsigned char* in, unsigned char* out) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        __m128i upper = inRange(v, 'A', 'Z');
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+        
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange(v, '\t', '\r'));
+        __m128i punct = _mm_or_si128(_mm_or_si128(inRange(v, '!', '/'), inRange(v, ':', '@')),
+                                     _mm_or_si128(inRange(v, '[', '`'), inRange(v, '{', '~')));
+        return {static_cast<uint32_t>(_mm_movemask_epi8(space)), static_cast<uint32_t>(_mm_movemask_epi8(punct))};
+    }
+    
+    __attribute__((target("avx2")))
+    inline __m256i inRange256(__m256i v, char lo, char hi) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v));
+    }
+    
+    __attribute__((target("avx2")))
+    inline BlockMasks avx2Block(const unsigned char* in, unsigned char* out) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+        __m256i upper = inRange256(v, 'A', 'Z');
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))));
+        
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange256(v, '\t', '\r'));
+        __m256i punct = _mm256_or_si256(_mm256_or_si256(inRange256(v, '!', '/'), inRange256(v, ':', '@')),
+                                        _mm256_or_si256(inRange256(v, '[', '`'), inRange256(v, '{', '~')));
+        return {static_cast<uint32_t>(_mm256_movemask_epi8(space)), static_cast<uint32_t>(_mm256_movemask_epi8(punct))};
+    }
+#endif
+    
+    inline bool supported(Kernel kernel) {
+#if defined(__x86_64__) || defined(_M_X64)
+        if (kernel == Kernel::SSE2) return true;
+        if (kernel == Kernel::AVX2) return __builtin_cpu_supports("avx2");
+#endif
+        return kernel == Kernel::Scalar;
+    }
+    
+    // Best kernel for the CPU we are running on, detected once
+    inline Kernel best() {
+        static const Kernel kernel = supported(Kernel::AVX2) ? Kernel::AVX2
+                                   : supported(Kernel::SSE2) ? Kernel::SSE2 : Kernel::Scalar;
+        return kernel;
+    }
+    
+    inline const char* name(Kernel kernel) {
+        switch (kernel) {
+            case Kernel::AVX2: return "avx2";
+            case Kernel::SSE2: return "sse2";
+            default: return "scalar";
+        }
+    }
+}
+
+// Splits text into whitespace-delimited tokens, lowercasing them and dropping punctuation
+// like the original istringstream path, without allocating once its buffers have grown
+class Tokenizer {
+private:
+    TokenizerKernels::Kernel kernel;
+    std::vector<TokenSpan> spans;
+    std::vector<unsigned char> buffer; // Lowercased copy of the text; tokens are compacted in place
+    
+    // Finish the token [start, end): squeeze out punctuation if it had any and record its span
+    void closeToken(size_t start, size_t end, bool hasPunct) {
+        size_t normLength = end - start;
+        if (hasPunct) {
+            const unsigned char* classes = TextClass::table();
+            unsigned char* token = buffer.data() + start;
+            normLength = 0;
+            for (size_t i = 0; i < end - start; ++i) {
+                if (classes[token[i]] != TextClass::Skip || token[i] == 0) token[normLength++] = token[i];
+            }
+        }
+        spans.push_back({static_cast<uint32_t>(start), static_cast<uint32_t>(end - start),
+                         static_cast<uint32_t>(start), static_cast<uint32_t>(normLength)});
+    }
+    
+    template <size_t Width, typename Block>
+    void run(const unsigned char* data, size_t size, Block block) {
+        bool inToken = false;
+        bool hasPunct = false;
+        size_t start = 0;
+        
+        for (size_t pos = 0; pos < size; pos += Width) {
+            size_t n = std::min(Width, size - pos);
+            TokenizerKernels::BlockMasks masks = (n == Width)
+                ? block(data + pos, buffer.data() + pos)
+                : TokenizerKernels::scalarBlock(data + pos, buffer.data() + pos, n);
+            
+            // Walk the whitespace transitions of this block with bit scans
+            uint64_t valid = (n == 64) ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+            size_t i = 0;
+            while (i < n) {
+                uint64_t pending = (inToken ? masks.space : ~masks.space & valid) >> i;
+                size_t next = pending ? i + static_cast<size_t>(__builtin_ctzll(pending)) : n;
+                
+                if (inToken) {
+                    uint64_t segment = (next - i == 64) ? ~uint64_t(0) : (uint64_t(1) << (next - i)) - 1;
+                    hasPunct = hasPunct || ((masks.punct >> i) & segment) != 0;
+                    if (next < n) {
+                        closeToken(start, pos + next, hasPunct);
+                        inToken = false;
+                    }
+                } else if (next < n) {
+                    start = pos + next;
+                    inToken = true;
+                    hasPunct = false;
+                }
+                i = next;
+            }
+        }
+        
+        if (inToken) closeToken(start, size, hasPunct);
+    }
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // Compiled for AVX2 as a whole so the block kernel is inlined into the transition loop
+    __attribute__((target("avx2"), flatten))
+    void runAvx2(const unsigned char* data, size_t size) {
+        run<32>(data, size, TokenizerKernels::avx2Block);
+    }
+#endif
+
+public:
+    explicit Tokenizer(TokenizerKernels::Kernel kernel = TokenizerKernels::best()) : kernel(kernel) {}
+    
+    // Tokenize text, replacing the previous result
+    void tokenize(std::string_view text) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        spans.clear();
+        if (buffer.size() < text.size()) buffer.resize(text.size());
+        
+        switch (kernel) {
+#if defined(__x86_64__) || defined(_M_X64)
+            case TokenizerKernels::Kernel::AVX2:
+                runAvx2(data, text.size());
+                break;
+            case TokenizerKernels::Kernel::SSE2:
+                run<16>(data, text.size(), TokenizerKernels::sse2Block);
+                break;
+#endif
+            default:
+                run<16>(data, text.size(), [](const unsigned char* in, unsigned char* out) {
+                    return TokenizerKernels::scalarBlock(in, out, 16);
+                });
+        }
+    }
+    
+    const std::vector<TokenSpan>& tokens() const { return spans; }
+    
+    std::string_view normalized(const TokenSpan& span) const {
+        return std::string_view(reinterpret_cast<const char*>(buffer.data()) + span.normOffset, span.normLength);
+    }
+    
+    const char* kernelName() const { return TokenizerKernels::name(kernel); }
+};
+
+// The original tokenizer, kept as the reference the SIMD kernels are checked against
+std::vector<std::string> referenceTokenize(const std::string& text);
+
+// Differential check of every supported tokenizer kernel against the reference on random text
+bool runTokenizerSelfTest(int iterations = 20000);
@@ -0,0 +1,227 @@
+#include "moderation/unicode.h"
+
+#include <iostream>
+
+#include "moderation/unicode_tables.h"
+
+namespace Utf8 {
+    uint32_t decode(const unsigned char* data, size_t size, size_t& length) {
+        length = 1;
+        unsigned char lead = data[0];
+        if (lead < 0x80) return lead;
+        
+        size_t trailing;
+        uint32_t codePoint;
+        uint32_t smallest;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            trailing = 1;
+            codePoint = lead & 0x1F;
+            smallest = 0x80;
+        } else if ((lead & 0xF0) == 0xE0) {
+            trailing = 2;
+            codePoint = lead & 0x0F;
+            smallest = 0x800;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            trailing = 3;
+            codePoint = lead & 0x07;
+            smallest = 0x10000;
+        } else {
+            return Invalid;
+        }
+        
+        if (size <= trailing) return Invalid;
+        for (size_t k = 1; k <= trailing; ++k) {
+            if ((data[k] & 0xC0) != 0x80) return Invalid;
+            codePoint = (codePoint << 6) | (data[k] & 0x3F);
+        }
+        if (codePoint < smallest || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) return Invalid;
+        
+        length = trailing + 1;
+        return codePoint;
+    }
+    
+    void append(std::string& out, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out.push_back(static_cast<char>(codePoint));
+        } else if (codePoint < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else if (codePoint < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+    
+    CharInfo classify(uint32_t codePoint) {
+        using namespace UnicodeTables;
+        if (codePoint >= Limit) {
+            // Past the tables only the tag characters and supplementary variation selectors need dropping
+            bool skip = codePoint >= 0xE0000 && codePoint <= 0xE0FFF;
+            return {skip ? Kind::Skip : Kind::Keep, codePoint};
+        }
+        
+        uint32_t block = blockIndex[codePoint >> BlockShift];
+        const Record& record = records[blocks[(block << BlockShift) | (codePoint & ((1u << BlockShift) - 1))]];
+        return {static_cast<Kind>(record.kind), static_cast<uint32_t>(static_cast<int32_t>(codePoint) + record.foldDelta)};
+    }
+}
+
+bool Utf8Normalizer::normalize(std::string_view text) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t size = text.size();
+    size_t i = Utf8::findNonAscii(data, size, 0);
+    if (i == size) return false;
+    
+    buffer.clear();
+    starts.clear();
+    ends.clear();
+    auto copyAscii = [&](size_t from, size_t to) {
+        buffer.append(text.data() + from, to - from);
+        for (size_t k = from; k < to; ++k) {
+            starts.push_back(static_cast<uint32_t>(k));
+            ends.push_back(static_cast<uint32_t>(k + 1));
+        }
+    };
+    copyAscii(0, i);
+    
+    while (i < size) {
+        size_t length;
+        uint32_t codePoint = Utf8::decode(data + i, size - i, length);
+        size_t before = buffer.size();
+        if (codePoint == Utf8::Invalid) {
+            // Not UTF-8: pass the byte through, where it matches only itself
+            buffer.push_back(text[i]);
+        } else {
+            Utf8::CharInfo info = Utf8::classify(codePoint);
+            if (info.kind == Utf8::Kind::Space) {
+                buffer.push_back(' ');
+            } else if (info.kind == Utf8::Kind::Keep) {
+                Utf8::append(buffer, info.folded);
+            }
+        }
+        for (size_t k = before; k < buffer.size(); ++k) {
+            starts.push_back(static_cast<uint32_t>(i));
+            ends.push_back(static_cast<uint32_t>(i + length));
+        }
+        i += length;
+        
+        // Text is mostly ASCII even when it is not all ASCII: copy whole runs of it at once
+        size_t next = Utf8::findNonAscii(data, size, i);
+        copyAscii(i, next);
+        i = next;
+    }
+    return true;
+}
+
+bool runUnicodeSelfTest(int iterations) {
+    const std::vector<std::string> pieces = {
+        "a", "Z", " ", ".", "0", "\xc3\x89", "\xc3\xa9", "\xce\xa3", "\xcf\x82", "\xd0\x96", "\xe1\xba\x9e",
+        "\xe2\x80\x83", "\xe2\x80\x94", "\xc2\xad", "\xef\xb8\x8f", "\xf0\x9f\x98\x80", "\xf0\x90\x90\x80",
+        "\xe2\x84\xaa", "\x80", "\xff", "\xc3", "\xed\xa0\x80", "\xe0\x80\xaf", std::string(1, '\0')
+    };
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    auto next = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    
+    // The normalizer without its ASCII fast path: every character decoded and classified
+    auto reference = [](const std::string& text, std::string& out, std::vector<uint32_t>& from) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        out.clear();
+        from.clear();
+        for (size_t i = 0, length = 1; i < text.size(); i += length) {
+            uint32_t codePoint = Utf8::decode(data + i, text.size() - i, length);
+            size_t before = out.size();
+            if (codePoint == Utf8::Invalid || codePoint < 0x80) {
+                out.push_back(text[i]);
+            } else if (Utf8::classify(codePoint).kind == Utf8::Kind::Space) {
+                out.push_back(' ');
+            } else if (Utf8::classify(codePoint).kind == Utf8::Kind::Keep) {
+                Utf8::append(out, Utf8::classify(codePoint).folded);
+            }
+            from.insert(from.end(), out.size() - before, static_cast<uint32_t>(i));
+        }
+    };
+    
+    bool ok = true;
+    for (auto kernel : {TokenizerKernels::Kernel::Scalar, TokenizerKernels::Kernel::SSE2, TokenizerKernels::Kernel::AVX2}) {
+        if (!TokenizerKernels::supported(kernel)) continue;
+        int failures = 0;
+        
+        for (int i = 0; i < iterations; ++i) {
+            // Mostly ASCII, with a non-ASCII byte somewhere in a fifth of the strings
+            std::string text;
+            size_t count = next() % 120;
+            bool ascii = next() % 5 != 0;
+            for (size_t p = 0; p < count; ++p) text += pieces[next() % (ascii ? 5 : pieces.size())];
+            
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+            size_t from = text.empty() ? 0 : next() % text.size();
+            size_t expected = from;
+            while (expected < text.size() && data[expected] < 0x80) ++expected;
+            if (Utf8::findNonAscii(data, text.size(), from, kernel) != expected) {
+                ok = false;
+                ++failures;
+            }
+        }
+        
+        std::cout << "ASCII search kernel " << TokenizerKernels::name(kernel) << ": "
+                  << (failures ? std::to_string(failures) + " mismatches" : std::string("OK")) << std::endl;
+    }
+    
+    Utf8Normalizer normalizer;
+    std::string expected;
+    std::vector<uint32_t> expectedStarts;
+    int failures = 0;
+    for (int i = 0; i < iterations; ++i) {
+        std::string text;
+        size_t count = next() % 120;
+        for (size_t p = 0; p < count; ++p) text += pieces[next() % pieces.size()];
+        
+        reference(text, expected, expectedStarts);
+        bool same;
+        if (!normalizer.normalize(text)) {
+            same = Utf8::isAscii(text) && expected == text;
+        } else {
+            same = normalizer.text() == expected;
+            for (size_t b = 0; same && b < expected.size(); ++b) {
+                TermMatch match{b, 1, 0};
+                normalizer.remap(match);
+                same = match.offset == expectedStarts[b];
+            }
+        }
+        if (!same) {
+            ok = false;
+            ++failures;
+        }
+    }
+    std::cout << "UTF-8 normalizer: " << (failures ? std::to_string(failures) + " mismatches" : std::string("OK")) << std::endl;
+    
+    // A few foldings the tables must get right
+    const std::pair<const char*, const char*> folds[] = {
+        {"\xc3\x89T\xc3\x89", "\xc3\xa9T\xc3\xa9"},                       // ÉTÉ
+        {"\xce\xa3\xce\x91\xce\xa3", "\xcf\x83\xce\xb1\xcf\x83"},         // ΣΑΣ
+        {"\xe2\x84\xaa", "k"},                                            // Kelvin sign
+        {"s\xc2\xad" "c\xe2\x80\x8b" "am", "scam"},                       // Soft hyphen, zero width space
+        {"a\xe2\x80\x83" "b", "a b"},                                     // Em space
+        {"\xd0\x9f\xd0\xa0\xd0\x98\xd0\x92\xd0\x95\xd0\xa2",              // ПРИВЕТ
+         "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82"}
+    };
+    for (const auto& fold : folds) {
+        if (!normalizer.normalize(fold.first) || normalizer.text() != fold.second) {
+            std::cout << "UTF-8 normalizer: wrong folding of \"" << fold.first << "\"" << std::endl;
+            ok = false;
+        }
+    }
+    
+    return ok;
+}
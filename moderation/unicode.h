@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "moderation/text.h"
+#include "moderation/tokenizer.h"
+
+// UTF-8 decoding and the Unicode side of normalization. ASCII is left to TextClass, which the
+// matchers apply on the fly; everything else is case folded and classified from the generated
+// tables in unicode_tables.h (see tools/generate_unicode_tables.py).
+namespace Utf8 {
+    // Vectorized searches for the first byte >= 0x80, one per tokenizer kernel
+    inline size_t scalarFindNonAscii(const unsigned char* data, size_t size, size_t from) {
+        size_t i = from;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            if (word & 0x8080808080808080ull) break;
+        }
+        while (i < size && data[i] < 0x80) ++i;
+        return i;
+    }
+
+#if defined(__x86_64__) || defined(_M_X64)
+    inline size_t sse2FindNonAscii(const unsigned char* data, size_t size, size_t from) {
+        size_t i = from;
+        for (; i + 16 <= size; i += 16) {
+            int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+            if (mask) return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+        return scalarFindNonAscii(data, size, i);
+    }
+    
+    __attribute__((target("avx2")))
+    inline size_t avx2FindNonAscii(const unsigned char* data, size_t size, size_t from) {
+        size_t i = from;
+        for (; i + 32 <= size; i += 32) {
+            int mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+            if (mask) return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+        return sse2FindNonAscii(data, size, i);
+    }
+#endif
+    
+    inline size_t findNonAscii(const unsigned char* data, size_t size, size_t from,
+                               TokenizerKernels::Kernel kernel = TokenizerKernels::best()) {
+        switch (kernel) {
+#if defined(__x86_64__) || defined(_M_X64)
+            case TokenizerKernels::Kernel::AVX2: return avx2FindNonAscii(data, size, from);
+            case TokenizerKernels::Kernel::SSE2: return sse2FindNonAscii(data, size, from);
+#endif
+            default: return scalarFindNonAscii(data, size, from);
+        }
+    }
+    
+    // Nothing to do for the Unicode side of normalization: every byte is ASCII
+    inline bool isAscii(std::string_view text) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        return findNonAscii(data, text.size(), 0) == text.size();
+    }
+    
+    // Decode the code point starting at data[0], storing its encoded length. Invalid, overlong
+    // and truncated sequences decode as the single lead byte, with Invalid as the code point.
+    static constexpr uint32_t Invalid = 0xFFFFFFFF;
+    uint32_t decode(const unsigned char* data, size_t size, size_t& length);
+    
+    void append(std::string& out, uint32_t codePoint);
+    
+    enum class Kind : uint8_t { Keep, Space, Skip };
+    
+    struct CharInfo {
+        Kind kind;
+        uint32_t folded; // Simple case folding; the code point itself when it has none
+    };
+    
+    // How a non-ASCII code point normalizes: folded and kept, read as whitespace, or dropped
+    // like punctuation
+    CharInfo classify(uint32_t codePoint);
+}
+
+// Case folds the non-ASCII characters of a message into a buffer the matchers scan instead of
+// the raw text, remembering where each normalized byte came from so matches can be reported
+// in raw offsets. ASCII runs are copied as they are, since the matchers fold ASCII themselves.
+class Utf8Normalizer {
+private:
+    std::string buffer;
+    std::vector<uint32_t> starts; // Raw offset of the character each normalized byte came from
+    std::vector<uint32_t> ends;   // Raw offset just past that character
+
+public:
+    // Normalize text into text(); returns false, doing nothing, if the text is pure ASCII
+    bool normalize(std::string_view text);
+    
+    const std::string& text() const { return buffer; }
+    
+    // Raw span [rawStart, rawEnd) of the character normalized byte i came from
+    size_t rawStart(size_t i) const { return starts[i]; }
+    size_t rawEnd(size_t i) const { return ends[i]; }
+    
+    // Turn a match over text() into the same match over the raw text
+    void remap(TermMatch& match) const {
+        size_t end = match.offset + match.length;
+        match.offset = starts[match.offset];
+        match.length = ends[end - 1] - match.offset;
+    }
+};
+
+// Differential check of the vectorized ASCII searches and of the normalizer on random text
+bool runUnicodeSelfTest(int iterations = 20000);
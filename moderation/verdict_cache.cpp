@@ -0,0 +1,220 @@
+#include "moderation/verdict_cache.h"
+
+#include <algorithm>
+
+#include "moderation/tokenizer.h"
+
+namespace {
+    uint64_t rotate(uint64_t value, unsigned bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+    
+    uint64_t finish(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        return hash ^ (hash >> 33);
+    }
+}
+
+VerdictCache::VerdictCache(size_t bytes, bool nearDuplicates) : shards(new Shard[ShardCount]) {
+    size_t entryBytes = nearDuplicates ? bytes - bytes / 4 : bytes;
+    setsPerShard = std::max<size_t>(1, entryBytes / (ShardCount * Ways * sizeof(Entry)));
+    if (nearDuplicates) nearPerShard = std::max<size_t>(1, bytes / 4 / (ShardCount * sizeof(NearEntry)));
+    
+    for (size_t s = 0; s < ShardCount; ++s) {
+        shards[s].entries.resize(setsPerShard * Ways);
+        shards[s].hands.resize(setsPerShard);
+        shards[s].near.resize(nearPerShard);
+    }
+}
+
+VerdictCache::Key VerdictCache::key(std::string_view text, uint64_t salt) {
+    const uint64_t prime1 = 0x9e3779b185ebca87ull;
+    const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+    const char* data = text.data();
+    const size_t size = text.size();
+    uint64_t a = salt + prime1;
+    uint64_t b = (salt ^ size) + prime2;
+    
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t x, y;
+        std::memcpy(&x, data + i, 8);
+        std::memcpy(&y, data + i + 8, 8);
+        a = rotate(a + x * prime2, 31) * prime1;
+        b = rotate(b + y * prime1, 29) * prime2;
+    }
+    if (i < size) {
+        uint64_t x = 0, y = 0;
+        size_t rest = size - i;
+        std::memcpy(&x, data + i, std::min<size_t>(rest, 8));
+        if (rest > 8) std::memcpy(&y, data + i + 8, rest - 8);
+        a = rotate(a + x * prime2, 31) * prime1;
+        b = rotate(b + y * prime1, 29) * prime2;
+    }
+    
+    uint64_t hash = finish(a + rotate(b, 17) + size);
+    return {hash, finish(b ^ hash)};
+}
+
+uint64_t VerdictCache::simHash(const std::string& text) {
+    static thread_local Tokenizer tokenizer;
+    tokenizer.tokenize(text);
+    if (tokenizer.tokens().size() < MinNearTokens) return 0;
+    
+    int weights[64] = {};
+    for (const auto& span : tokenizer.tokens()) {
+        uint64_t hash = finish(hashTerm(tokenizer.normalized(span)));
+        for (unsigned bit = 0; bit < 64; ++bit) weights[bit] += ((hash >> bit) & 1) ? 1 : -1;
+    }
+    
+    uint64_t result = 0;
+    for (unsigned bit = 0; bit < 64; ++bit) {
+        if (weights[bit] > 0) result |= 1ull << bit;
+    }
+    return result;
+}
+
+VerdictCache::Entry* VerdictCache::findEntry(Shard& shard, const Key& key, uint64_t version) const {
+    Entry* set = &shard.entries[(key.hash % setsPerShard) * Ways];
+    for (size_t way = 0; way < Ways; ++way) {
+        Entry& entry = set[way];
+        if (entry.hash == key.hash && entry.check == key.check && entry.version == version) {
+            entry.referenced = true;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+VerdictCache::Entry& VerdictCache::victim(Shard& shard, const Key& key, uint64_t version) {
+    size_t setIndex = key.hash % setsPerShard;
+    Entry* set = &shard.entries[setIndex * Ways];
+    
+    // An entry computed against an older dictionary is as good as empty
+    for (size_t way = 0; way < Ways; ++way) {
+        if (set[way].version != version) return set[way];
+    }
+    
+    uint8_t& hand = shard.hands[setIndex];
+    while (set[hand].referenced) {
+        set[hand].referenced = false;
+        hand = static_cast<uint8_t>((hand + 1) % Ways);
+    }
+    Entry& entry = set[hand];
+    hand = static_cast<uint8_t>((hand + 1) % Ways);
+    ++shard.evictions;
+    return entry;
+}
+
+bool VerdictCache::findMatches(const Key& key, uint64_t version, std::vector<TermMatch>& matches) {
+    Shard& shard = shardFor(key.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry* entry = findEntry(shard, key, version);
+    if (!entry) {
+        ++shard.misses;
+        return false;
+    }
+    ++shard.hits;
+    matches.insert(matches.end(), entry->matches, entry->matches + entry->matchCount);
+    return true;
+}
+
+void VerdictCache::storeMatches(const Key& key, uint64_t version, const std::vector<TermMatch>& matches, size_t first) {
+    size_t count = matches.size() - first;
+    if (count > MaxMatches) return;
+    
+    Shard& shard = shardFor(key.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (findEntry(shard, key, version)) return; // Another thread got there first
+    Entry& entry = victim(shard, key, version);
+    entry.hash = key.hash;
+    entry.check = key.check;
+    entry.version = version;
+    entry.referenced = false;
+    entry.flagged = count > 0;
+    entry.score = 0;
+    entry.matchCount = static_cast<uint8_t>(count);
+    std::copy(matches.begin() + static_cast<std::ptrdiff_t>(first), matches.end(), entry.matches);
+}
+
+bool VerdictCache::findVerdict(const Key& key, uint64_t version, Verdict& verdict) {
+    Shard& shard = shardFor(key.hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry* entry = findEntry(shard, key, version);
+    if (!entry) {
+        ++shard.misses;
+        return false;
+    }
+    ++shard.hits;
+    verdict.flagged = entry->flagged;
+    verdict.score = entry->score;
+    return true;
+}
+
+bool VerdictCache::findNearVerdict(uint64_t simHash, uint64_t salt, uint64_t version, Verdict& verdict) {
+    if (!simHash || !nearPerShard) return false;
+    for (unsigned band = 0; band < 4; ++band) {
+        uint64_t slot = bandSlot(band, simHash, salt);
+        Shard& shard = shardFor(slot);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const NearEntry& near = shard.near[slot % nearPerShard];
+        if (near.version == version && near.salt == salt && __builtin_popcountll(near.simHash ^ simHash) <= static_cast<int>(NearBits)) {
+            ++shard.nearHits;
+            verdict.flagged = near.flagged;
+            verdict.score = near.score;
+            return true;
+        }
+    }
+    return false;
+}
+
+void VerdictCache::storeVerdict(const Key& key, uint64_t simHash, uint64_t salt, uint64_t version, const Verdict& verdict) {
+    {
+        Shard& shard = shardFor(key.hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!findEntry(shard, key, version)) {
+            Entry& entry = victim(shard, key, version);
+            entry.hash = key.hash;
+            entry.check = key.check;
+            entry.version = version;
+            entry.referenced = false;
+            entry.flagged = verdict.flagged;
+            entry.score = verdict.score;
+            entry.matchCount = 0;
+        }
+    }
+    
+    // Only denials are shared with near-duplicates: an approval must not carry over to a copy
+    // that differs by the one word that matters
+    if (!simHash || !nearPerShard || !verdict.flagged) return;
+    
+    // Direct-mapped: a newer message simply takes the slot of each of its bands
+    for (unsigned band = 0; band < 4; ++band) {
+        uint64_t slot = bandSlot(band, simHash, salt);
+        Shard& shard = shardFor(slot);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.near[slot % nearPerShard] = {simHash, salt, version, verdict.score, verdict.flagged};
+    }
+}
+
+VerdictCache::Stats VerdictCache::stats(uint64_t liveVersion) const {
+    Stats result;
+    for (size_t s = 0; s < ShardCount; ++s) {
+        Shard& shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.hits += shard.hits;
+        result.nearHits += shard.nearHits;
+        result.misses += shard.misses;
+        result.evictions += shard.evictions;
+        for (const Entry& entry : shard.entries) {
+            if (entry.version == liveVersion) ++result.entries;
+        }
+        result.capacity += shard.entries.size();
+        result.bytes += shard.entries.size() * sizeof(Entry) + shard.hands.size() + shard.near.size() * sizeof(NearEntry);
+    }
+    result.bytes += ShardCount * sizeof(Shard);
+    return result;
+}
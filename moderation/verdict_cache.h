@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "moderation/dictionary_version.h"
+#include "moderation/text.h"
+
+// Fixed-memory cache of scan results for spam waves that repeat the same text. Results are
+// keyed by a 128-bit hash of the raw message, so cached match offsets stay valid, and by what
+// was asked (mode, threshold). Each entry records the dictionary version it was computed
+// against: a newer version makes it a miss, and it is overwritten in place, so publishing a
+// version needs no flush. Shards are locked separately; within a shard a hash selects a set
+// of Ways entries, which are evicted in CLOCK order.
+//
+// With near-duplicate matching on, verdict-only denials are also indexed by the SimHash of the
+// message's tokens, split into four 16-bit bands: two messages within three differing bits
+// share a band, so a probe per band finds any of them.
+class VerdictCache {
+public:
+    static constexpr size_t MaxMatches = 4;     // Messages with more matches are not cached
+    static constexpr size_t Ways = 4;
+    static constexpr size_t ShardCount = 64;
+    static constexpr unsigned NearBits = 3;     // SimHash bits two near-duplicates may differ in
+    static constexpr size_t MinNearTokens = 8;  // Shorter messages are too easy to confuse
+    
+    struct Key {
+        uint64_t hash;
+        uint64_t check;
+    };
+    
+    // Counters since the cache was created, plus its size
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t nearHits = 0;  // Misses answered by a near-duplicate
+        uint64_t evictions = 0;
+        size_t entries = 0;     // Entries computed against the live dictionary version
+        size_t capacity = 0;
+        size_t bytes = 0;
+        
+        double hitRatio() const {
+            uint64_t lookups = hits + misses;
+            return lookups ? static_cast<double>(hits + nearHits) / static_cast<double>(lookups) : 0.0;
+        }
+    };
+
+private:
+    struct Entry {
+        uint64_t hash = 0;
+        uint64_t check = 0;
+        uint64_t version = 0;       // 0: never used
+        uint32_t score = 0;
+        uint8_t matchCount = 0;
+        bool flagged = false;
+        bool referenced = false;
+        TermMatch matches[MaxMatches];
+    };
+    
+    struct NearEntry {
+        uint64_t simHash = 0;
+        uint64_t salt = 0;
+        uint64_t version = 0;
+        uint32_t score = 0;
+        bool flagged = false;
+    };
+    
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;             // setsPerShard sets of Ways entries
+        std::vector<uint8_t> hands;             // CLOCK hand of each set
+        std::vector<NearEntry> near;
+        uint64_t hits = 0;
+        uint64_t nearHits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+    
+    std::unique_ptr<Shard[]> shards;
+    size_t setsPerShard = 1;
+    size_t nearPerShard = 0;
+    
+    Shard& shardFor(uint64_t hash) const {
+        return shards[hash >> 58];
+    }
+    
+    Entry* findEntry(Shard& shard, const Key& key, uint64_t version) const;
+    Entry& victim(Shard& shard, const Key& key, uint64_t version);
+    
+    static uint64_t bandSlot(unsigned band, uint64_t simHash, uint64_t salt) {
+        uint64_t h = ((simHash >> (16 * band)) & 0xFFFF) | (static_cast<uint64_t>(band) << 16);
+        h = (h ^ salt) * 0xff51afd7ed558ccdull;
+        return h ^ (h >> 29);
+    }
+
+public:
+    // Split about `bytes` of memory between the shards; a quarter of it goes to the
+    // near-duplicate index when that is enabled
+    VerdictCache(size_t bytes, bool nearDuplicates);
+    
+    VerdictCache(const VerdictCache&) = delete;
+    VerdictCache& operator=(const VerdictCache&) = delete;
+    
+    bool nearDuplicates() const {
+        return nearPerShard > 0;
+    }
+    
+    // Two independent 64-bit lanes over 16 bytes at a time, in the style of xxHash; salt
+    // separates results asked for in different ways
+    static Key key(std::string_view text, uint64_t salt);
+    
+    // Salt for the matches of a message in a mode, or for its verdict in a mode against a threshold
+    static uint64_t matchSalt(MatchMode mode) {
+        return static_cast<uint64_t>(mode) + 1;
+    }
+    
+    static uint64_t verdictSalt(MatchMode mode, uint32_t threshold) {
+        return (static_cast<uint64_t>(threshold) << 32) | (static_cast<uint64_t>(mode) + 0x100);
+    }
+    
+    // SimHash of the tokens of text, or 0 if it has fewer than MinNearTokens of them
+    static uint64_t simHash(const std::string& text);
+    
+    // Append the cached matches of a message; false on a miss
+    bool findMatches(const Key& key, uint64_t version, std::vector<TermMatch>& matches);
+    
+    // Remember matches[first, end) for the message
+    void storeMatches(const Key& key, uint64_t version, const std::vector<TermMatch>& matches, size_t first);
+    
+    // Cached verdict for the message; false on a miss
+    bool findVerdict(const Key& key, uint64_t version, Verdict& verdict);
+    
+    // Cached denial of a message whose SimHash is within NearBits of simHash
+    bool findNearVerdict(uint64_t simHash, uint64_t salt, uint64_t version, Verdict& verdict);
+    
+    void storeVerdict(const Key& key, uint64_t simHash, uint64_t salt, uint64_t version, const Verdict& verdict);
+    
+    Stats stats(uint64_t liveVersion) const;
+};
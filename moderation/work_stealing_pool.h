@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool. Each worker owns a deque: it takes work from the front of its own
+// queue and, when that runs dry, steals from the back of the other workers' queues.
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queuedTasks{0};
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<bool> stopping{false};
+    
+    static int& currentWorker() {
+        static thread_local int index = -1;
+        return index;
+    }
+    
+    bool popLocal(size_t index, std::function<void()>& task) {
+        WorkerQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    
+    bool steal(size_t thief, std::function<void()>& task) {
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkerQueue& victim = *queues[(thief + offset) % queues.size()];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+    
+    void workerLoop(size_t index) {
+        currentWorker() = static_cast<int>(index);
+        std::function<void()> task;
+        
+        while (true) {
+            if (popLocal(index, task) || steal(index, task)) {
+                queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+                task();
+                task = nullptr;
+                continue;
+            }
+            
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping.load() || queuedTasks.load() > 0; });
+            if (stopping.load() && queuedTasks.load() == 0) return;
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t threadCount) {
+        threadCount = std::max<size_t>(1, threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+    
+    // Runs every task that was already submitted, then joins the workers
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    // Queue a task: on the caller's own queue from inside a worker, round-robin otherwise
+    void submit(std::function<void()> task) {
+        int worker = currentWorker();
+        size_t index = (worker >= 0 && static_cast<size_t>(worker) < queues.size())
+            ? static_cast<size_t>(worker)
+            : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedTasks.fetch_add(1);
+        }
+        wake.notify_one();
+    }
+    
+    size_t size() const { return threads.size(); }
+};
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Generate moderation/unicode_tables.h from Python's copy of the Unicode character database.
+
+Every code point below LIMIT gets a record: its class for matching (kept, whitespace or
+skipped like punctuation) and the delta to its simple case folding. Records are deduplicated,
+and so are the blocks of 2^BLOCK_SHIFT consecutive record indexes, which leaves a two-stage
+table of a few kilobytes. Code points at and above LIMIT are classified in moderation/unicode.cpp.
+
+Usage: tools/generate_unicode_tables.py > moderation/unicode_tables.h
+"""
+
+import sys
+import unicodedata
+
+LIMIT = 0x20000
+BLOCK_SHIFT = 5
+
+KEEP, SPACE, SKIP = 0, 1, 2
+
+
+def simple_fold(ch):
+    # Simple case folding maps one code point to one code point; where full folding expands
+    # ("ß" to "ss") fall back to the lowercase mapping, or leave the character alone
+    for folded in (ch.casefold(), ch.lower()):
+        if len(folded) == 1:
+            return ord(folded)
+    return ord(ch)
+
+
+def classify(cp):
+    if cp < 0x80 or 0xD800 <= cp <= 0xDFFF:
+        # ASCII is classified by TextClass; surrogates never decode
+        return KEEP
+    category = unicodedata.category(chr(cp))
+    if category in ('Zs', 'Zl', 'Zp') or cp == 0x85:
+        return SPACE
+    if category[0] in 'PS' or category in ('Cc', 'Cf') or 0xFE00 <= cp <= 0xFE0F or 0xE0100 <= cp <= 0xE01EF:
+        return SKIP
+    return KEEP
+
+
+def record(cp):
+    kind = classify(cp)
+    delta = simple_fold(chr(cp)) - cp if kind == KEEP and cp >= 0x80 else 0
+    return (delta, kind)
+
+
+def above_limit(cp):
+    # Must agree with Utf8::classify for code points the tables do not cover
+    return (0, SKIP) if 0xE0000 <= cp <= 0xE0FFF else (0, KEEP)
+
+
+def main():
+    for cp in range(LIMIT, 0x110000):
+        if unicodedata.category(chr(cp)) != 'Cn' and record(cp) != above_limit(cp):
+            sys.exit('U+%04X is not covered by the rule for code points above the tables' % cp)
+
+    records = {}
+    blocks = {}
+    block_index = []
+    for start in range(0, LIMIT, 1 << BLOCK_SHIFT):
+        block = tuple(records.setdefault(record(cp), len(records)) for cp in range(start, start + (1 << BLOCK_SHIFT)))
+        block_index.append(blocks.setdefault(block, len(blocks)))
+    if len(records) > 256 or len(blocks) > 256:
+        sys.exit('tables no longer fit in bytes; change BLOCK_SHIFT or the index types')
+
+    def rows(values, per_line=16):
+        lines = []
+        for i in range(0, len(values), per_line):
+            lines.append('        ' + ', '.join(values[i:i + per_line]) + ',')
+        return '\n'.join(lines)
+
+    kinds = ['Keep', 'Space', 'Skip']
+    out = []
+    out.append('#pragma once')
+    out.append('')
+    out.append('#include <cstdint>')
+    out.append('')
+    out.append('// Generated by tools/generate_unicode_tables.py from Unicode %s; do not edit' % unicodedata.unidata_version)
+    out.append('namespace UnicodeTables {')
+    out.append('    constexpr uint32_t Limit = 0x%X;' % LIMIT)
+    out.append('    constexpr unsigned BlockShift = %d;' % BLOCK_SHIFT)
+    out.append('    ')
+    out.append('    enum Kind : uint8_t { Keep, Space, Skip };')
+    out.append('    ')
+    out.append('    struct Record {')
+    out.append('        int32_t foldDelta; // Added to the code point to get its simple case folding')
+    out.append('        Kind kind;')
+    out.append('    };')
+    out.append('    ')
+    out.append('    inline constexpr Record records[%d] = {' % len(records))
+    out.append(rows(['{%d, %s}' % (delta, kinds[kind]) for delta, kind in records], 6))
+    out.append('    };')
+    out.append('    ')
+    out.append('    // Block of each run of 2^BlockShift code points')
+    out.append('    inline constexpr uint8_t blockIndex[%d] = {' % len(block_index))
+    out.append(rows([str(b) for b in block_index], 24))
+    out.append('    };')
+    out.append('    ')
+    out.append('    // Record of each code point within its block')
+    out.append('    inline constexpr uint8_t blocks[%d] = {' % (len(blocks) << BLOCK_SHIFT))
+    flat = [str(r) for block in blocks for r in block]
+    out.append(rows(flat, 32))
+    out.append('    };')
+    out.append('}')
+    print('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()